@@ -0,0 +1,39 @@
+#version 330 core
+// FXAA, after Timothy Lottes' console version
+
+uniform sampler2D uTex;
+uniform vec2 uInvSize;
+
+smooth in vec2 vTexCoord;
+out vec4 oColor;
+
+#define FXAA_REDUCE_MIN (1.0 / 128.0)
+#define FXAA_REDUCE_MUL (1.0 / 8.0)
+#define FXAA_SPAN_MAX 8.0
+
+void main()
+{
+	vec3 rgbNW = texture( uTex, vTexCoord + vec2( -1.0, -1.0 ) * uInvSize ).rgb;
+	vec3 rgbNE = texture( uTex, vTexCoord + vec2( 1.0, -1.0 ) * uInvSize ).rgb;
+	vec3 rgbSW = texture( uTex, vTexCoord + vec2( -1.0, 1.0 ) * uInvSize ).rgb;
+	vec3 rgbSE = texture( uTex, vTexCoord + vec2( 1.0, 1.0 ) * uInvSize ).rgb;
+	vec4 rgbaM = texture( uTex, vTexCoord );
+	vec3 luma = vec3( 0.299, 0.587, 0.114 );
+	float lumaNW = dot( rgbNW, luma );
+	float lumaNE = dot( rgbNE, luma );
+	float lumaSW = dot( rgbSW, luma );
+	float lumaSE = dot( rgbSE, luma );
+	float lumaM = dot( rgbaM.rgb, luma );
+	float lumaMin = min( lumaM, min( min( lumaNW, lumaNE ), min( lumaSW, lumaSE ) ) );
+	float lumaMax = max( lumaM, max( max( lumaNW, lumaNE ), max( lumaSW, lumaSE ) ) );
+
+	vec2 dir = vec2( -( ( lumaNW + lumaNE ) - ( lumaSW + lumaSE ) ), ( ( lumaNW + lumaSW ) - ( lumaNE + lumaSE ) ) );
+	float dirReduce = max( ( lumaNW + lumaNE + lumaSW + lumaSE ) * ( 0.25 * FXAA_REDUCE_MUL ), FXAA_REDUCE_MIN );
+	float rcpDirMin = 1.0 / ( min( abs( dir.x ), abs( dir.y ) ) + dirReduce );
+	dir = clamp( dir * rcpDirMin, vec2( -FXAA_SPAN_MAX ), vec2( FXAA_SPAN_MAX ) ) * uInvSize;
+
+	vec3 rgbA = 0.5 * ( texture( uTex, vTexCoord + dir * ( 1.0 / 3.0 - 0.5 ) ).rgb + texture( uTex, vTexCoord + dir * ( 2.0 / 3.0 - 0.5 ) ).rgb );
+	vec3 rgbB = rgbA * 0.5 + 0.25 * ( texture( uTex, vTexCoord + dir * -0.5 ).rgb + texture( uTex, vTexCoord + dir * 0.5 ).rgb );
+	float lumaB = dot( rgbB, luma );
+	oColor = vec4( ( lumaB < lumaMin || lumaB > lumaMax ) ? rgbA : rgbB, rgbaM.a );
+}
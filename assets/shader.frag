@@ -7,10 +7,32 @@
 #version 400
 
 out vec4    oColor;
+#ifdef NO_GEOMETRY
+// no geometry stage, the facet normal comes from screen space derivatives
+in vec3     tePosition;
+in vec3     tePatchDistance;
+#ifdef CROWD
+in vec4     teColor;
+#endif
+uniform mat3    ciNormalMatrix;
+uniform float   uTessLevelInner;
+#else
 in vec3     gFacetNormal;
 in vec3     gTriDistance;
 in vec3     gPatchDistance;
 in float    gPrimitive;
+#ifdef CROWD
+in vec4     gColor;
+#endif
+#endif
+
+#ifdef DISPLACE
+in vec2     teTexCoord;
+uniform sampler2D   uHeightMap;
+#endif
+
+uniform float iBeatPhase;   // 0..1 inside the current beat
+uniform float iBeatPulse;   // 1 on the beat, decays to 0
 
 const vec3 lightPosition    = vec3( 0.5, 0.2, 1.0 );
 const vec3 diffuseColor     = vec3( 0.5, 0.2, 1.0 );
@@ -26,13 +48,40 @@ float amplify(float d, float scale, float offset)
 
 void main()
 {
-    vec3 N      = normalize(gFacetNormal);
+#ifdef DISPLACE
+    // coloured by the height map itself, as fx.glsl shades its hit point
+    oColor      = vec4( texture( uHeightMap, teTexCoord ).rgb, 1.0 );
+    return;
+#endif
+#ifdef NO_GEOMETRY
+    vec3 facetNormal    = ciNormalMatrix * cross(dFdx(tePosition), dFdy(tePosition));
+    // distance to the rings of the tessellation lattice stands in for the triangle edges
+    vec3 lattice        = tePatchDistance * uTessLevelInner;
+    vec3 triDistance    = 2.0 * abs(lattice - round(lattice));
+    vec3 patchDistance  = tePatchDistance;
+#ifdef CROWD
+    vec4 instanceColor  = teColor;
+#endif
+#else
+    vec3 facetNormal    = gFacetNormal;
+    vec3 triDistance    = gTriDistance;
+    vec3 patchDistance  = gPatchDistance;
+#ifdef CROWD
+    vec4 instanceColor  = gColor;
+#endif
+#endif
+    vec3 N      = normalize(facetNormal);
     vec3 L      = lightPosition;
     float NoL   = abs(dot(N, L));
+#ifdef CROWD
+    vec3 color  = ambientColor + NoL * instanceColor.rgb;
+#else
     vec3 color  = ambientColor + NoL * diffuseColor;
+#endif
     
-    float d1    = min(min(gTriDistance.x, gTriDistance.y), gTriDistance.z);
-    float d2    = min(min(gPatchDistance.x, gPatchDistance.y), gPatchDistance.z);
+    float d1    = min(min(triDistance.x, triDistance.y), triDistance.z);
+    float d2    = min(min(patchDistance.x, patchDistance.y), patchDistance.z);
     color       = amplify(d1, 40, -0.5) * amplify(d2, 60, -0.5) * color;
+    color      *= 1.0 + 0.5 * iBeatPulse;
     oColor      = vec4( color, 1.0 );
 }
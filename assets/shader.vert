@@ -8,8 +8,14 @@
 
 in vec4         ciPosition;
 out vec3        vPosition;
+#ifdef CROWD
+flat out int    vInstance;
+#endif
 
 void main()
 {
     vPosition = ciPosition.xyz;
+#ifdef CROWD
+    vInstance = gl_InstanceID;
+#endif
 }
@@ -0,0 +1,24 @@
+#version 330 core
+// bilinear upscale of the rendered region with an unsharp mask
+
+uniform sampler2D uTex;
+uniform vec2 uScale;		// rendered region over texture size
+uniform vec2 uInvSize;		// texel size of the texture
+uniform float uSharpness;
+
+smooth in vec2 vTexCoord;
+out vec4 oColor;
+
+void main()
+{
+	// clamped half a texel inside the region, so nothing outside it bleeds in
+	vec2 lo = 0.5 * uInvSize;
+	vec2 hi = uScale - 0.5 * uInvSize;
+	vec2 uv = clamp( vTexCoord * uScale, lo, hi );
+	vec4 center = texture( uTex, uv );
+	vec3 blur = 0.25 * ( texture( uTex, clamp( uv + vec2( uInvSize.x, 0.0 ), lo, hi ) ).rgb
+		+ texture( uTex, clamp( uv - vec2( uInvSize.x, 0.0 ), lo, hi ) ).rgb
+		+ texture( uTex, clamp( uv + vec2( 0.0, uInvSize.y ), lo, hi ) ).rgb
+		+ texture( uTex, clamp( uv - vec2( 0.0, uInvSize.y ), lo, hi ) ).rgb );
+	oColor = vec4( clamp( center.rgb + uSharpness * ( center.rgb - blur ), 0.0, 1.0 ), center.a );
+}
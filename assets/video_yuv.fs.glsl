@@ -0,0 +1,20 @@
+#version 330 core
+
+uniform sampler2D uTexY;
+uniform sampler2D uTexU;
+uniform sampler2D uTexV;
+uniform mat3 uYuvToRgb;
+uniform vec3 uYuvOffset;
+
+in VertexData
+{
+	vec2 texcoord0;
+} vVertex;
+
+out vec4 oFragColor;
+
+void main()
+{
+	vec3 yuv = vec3( texture( uTexY, vVertex.texcoord0 ).r, texture( uTexU, vVertex.texcoord0 ).r, texture( uTexV, vVertex.texcoord0 ).r );
+	oFragColor = vec4( clamp( uYuvToRgb * ( yuv - uYuvOffset ), 0.0, 1.0 ), 1.0 );
+}
@@ -0,0 +1,54 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Anti-aliasing of the scene render target.
+ The window stays single-sampled; the scene is either rendered into a
+ multisampled FBO and resolved once per frame, filtered by an FXAA pass,
+ or left as is. resolve() returns the one texture the frame should use.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+#include <functional>
+
+typedef std::shared_ptr<class SkyAntiAlias> SkyAntiAliasRef;
+
+class SkyAntiAlias {
+public:
+	enum class Mode { NONE, MSAA, FXAA };
+	struct Result {
+		Mode		mode;
+		int			samples;
+		double		gpuMs;			// scene plus resolve, per frame
+		double		meanError;		// against a supersampled reference, 0..1
+		double		edgeError;		// same, only where the reference has edges
+	};
+
+	static SkyAntiAliasRef create(const ci::ivec2 &size, Mode mode = Mode::MSAA, int samples = 4) { return SkyAntiAliasRef(new SkyAntiAlias(size, mode, samples)); }
+
+	// reallocates the scene target, not meant to be called every frame
+	void					setMode(Mode mode, int samples = 4);
+	Mode					getMode() const { return mMode; }
+	int						getSamples() const { return mMode == Mode::MSAA ? mSamples : 1; }
+	std::string				getModeName() const;
+
+	// render the scene into this target
+	const ci::gl::FboRef&	getSceneFbo() const { return mSceneFbo; }
+	// once per frame, after the scene: the multisample resolve or the FXAA pass
+	ci::gl::Texture2dRef	resolve();
+
+	// renders the scene in every mode and compares against a 4x supersampled render
+	static std::vector<Result>	benchmark(const ci::ivec2 &size, const std::function<void(const ci::gl::FboRef&)> &renderScene, int frames = 120);
+private:
+	SkyAntiAlias(const ci::ivec2 &size, Mode mode, int samples);
+
+	ci::ivec2				mSize;
+	Mode					mMode;
+	int						mSamples;
+	ci::gl::FboRef			mSceneFbo;
+	ci::gl::FboRef			mFxaaFbo;
+	ci::gl::GlslProgRef		mFxaaShader;
+};
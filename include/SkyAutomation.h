@@ -0,0 +1,84 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Keyframe automation of uniforms on a beat clock.
+ Every curve of a cue lives in the same flat arrays: keys are stored end
+ to end, each curve keeps a cursor on its current segment, and evaluate()
+ first gathers the two keys and the easing polynomial of every curve, then
+ interpolates all of them with SSE, four curves per instruction. Cues are
+ saved as a small binary file of those arrays.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef std::shared_ptr<class SkyAutomation> SkyAutomationRef;
+
+class SkyAutomation {
+public:
+	// shape of the segment that starts at a key, STEP holds the key value until the next one
+	enum class Ease : uint8_t { STEP, LINEAR, SMOOTH, IN, OUT };
+	struct Key {
+		float				beat = 0.0f;
+		float				value = 0.0f;
+		Ease				ease = Ease::LINEAR;
+	};
+	struct BenchmarkResults {
+		size_t				curves = 0;
+		size_t				keys = 0;
+		double				gatherNs = 0.0;		// per curve
+		double				simdNs = 0.0;
+		double				scalarNs = 0.0;
+		float				maxError = 0.0f;	// between the two paths
+	};
+	static const uint32_t	kMagic = 0x41594B53;	// "SKYA"
+	static const uint32_t	kVersion = 1;
+
+	static SkyAutomationRef	create() { return SkyAutomationRef(new SkyAutomation()); }
+	// nullptr if the file is missing, truncated or of another version
+	static SkyAutomationRef	load(const std::string &path);
+	bool					save(const std::string &path) const;
+
+	// target is a VDUniforms index, keys are sorted by beat, a curve with loopBeats repeats
+	size_t					addCurve(int target, std::vector<Key> keys, float loopBeats = 0.0f);
+	void					clear();
+	size_t					getNumCurves() const { return mTargets.size(); }
+	size_t					getNumKeys() const { return mKeyBeats.size(); }
+	// beats of the longest curve that does not loop
+	float					getLength() const;
+
+	// every curve at beat, in one pass; values line up with getTargets()
+	void					evaluate(double beat);
+	const std::vector<int32_t>&	getTargets() const { return mTargets; }
+	const float*			getValues() const { return mValues.data(); }
+	// scalar interpolation instead of SSE, for comparison
+	void					setSimd(bool enable) { mSimd = enable; }
+
+	static BenchmarkResults	benchmark(size_t numCurves, size_t keysPerCurve, int frames);
+private:
+	SkyAutomation() {}
+
+	void					gather(double beat);
+	void					interpolateSimd();
+	void					interpolateScalar();
+
+	// per curve
+	std::vector<int32_t>	mTargets;
+	std::vector<uint32_t>	mFirstKey;
+	std::vector<uint32_t>	mNumKeys;
+	std::vector<float>		mLoopBeats;
+	std::vector<uint32_t>	mCursors;
+	// per key, all curves end to end
+	std::vector<float>		mKeyBeats;
+	std::vector<float>		mKeyValues;
+	std::vector<uint8_t>	mKeyEases;
+	// gathered by evaluate(), padded to a multiple of four
+	std::vector<float>		mFrom, mTo, mT, mC1, mC2, mC3, mValues;
+	bool					mSimd = true;
+};
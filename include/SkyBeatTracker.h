@@ -0,0 +1,121 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Incremental onset and tempo tracker.
+ The audio thread feeds blocks through process(), the render thread reads
+ the published tempo, beat phase and beat pulse through getState().
+ Cost per block is bounded: one-pole band filters per sample, and one
+ autocorrelation update over the tempo lag range per hop.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+typedef std::shared_ptr<class SkyBeatTracker> SkyBeatTrackerRef;
+
+class SkyBeatTracker {
+public:
+	struct Format {
+		Format() {}
+		Format&		hopSize(size_t frames) { mHopSize = frames; return *this; }
+		Format&		bpmRange(float minBpm, float maxBpm) { mMinBpm = minBpm; mMaxBpm = maxBpm; return *this; }
+		Format&		historySeconds(float seconds) { mHistorySeconds = seconds; return *this; }
+
+		size_t		mHopSize = 512;
+		float		mMinBpm = 70.0f;
+		float		mMaxBpm = 180.0f;
+		float		mHistorySeconds = 6.0f;
+	};
+	// snapshot of the tracker as seen from the render thread
+	struct State {
+		float		bpm = 0.0f;
+		float		phase = 0.0f;		// 0..1 position inside the current beat
+		float		pulse = 0.0f;		// 1 on the beat, decays towards 0
+		float		confidence = 0.0f;
+		float		latencyMs = 0.0f;	// analysis delay plus audio to render hand-off
+		bool		locked = false;
+	};
+	// result of an offline run over a whole buffer
+	struct Analysis {
+		float				bpm = 0.0f;
+		float				confidence = 0.0f;
+		std::vector<double>	beatTimes;	// seconds
+	};
+	// an analysis against the tempo a file is known to have
+	struct Check {
+		float		errorBpm = 0.0f;
+		bool		octave = false;		// locked on half or double the tempo
+		bool		passed = false;
+	};
+
+	static SkyBeatTrackerRef create(float sampleRate, const Format &format = Format())
+	{
+		return SkyBeatTrackerRef(new SkyBeatTracker(sampleRate, format));
+	}
+	SkyBeatTracker(float sampleRate, const Format &format = Format());
+
+	// audio thread: mono samples, any block size
+	void					process(const float *samples, size_t numFrames);
+	// render thread: extrapolates the beat phase to the time of the call
+	State					getState();
+	void					reset();
+
+	float					getSampleRate() const { return mSampleRate; }
+	size_t					getHopSize() const { return mHopSize; }
+	// delay introduced by the analysis itself, without the hand-off
+	float					getAnalysisLatencyMs() const;
+
+	// runs the tracker over a complete buffer as fast as possible, used to check against files of known tempo
+	static Analysis			analyze(const float *samples, size_t numFrames, float sampleRate, const Format &format = Format());
+	static Check			check(const Analysis &analysis, float expectedBpm, float toleranceBpm = 1.0f);
+private:
+	void					processHop();
+	void					updateTempo();
+	void					updatePhase();
+	void					alignPhase();
+	void					publish();
+	float					lagToBpm(float lag) const;
+
+	float					mSampleRate;
+	size_t					mHopSize;
+	float					mHopRate;		// hops per second
+
+	// band split
+	float					mLowState = 0.0f, mMidState = 0.0f;
+	float					mLowCoef, mMidCoef;
+	float					mBandEnergy[3] = { 0.0f, 0.0f, 0.0f };
+	float					mPrevBandLog[3] = { 0.0f, 0.0f, 0.0f };
+	size_t					mHopFill = 0;
+
+	// onset envelope history, ring buffer indexed by hop count
+	std::vector<float>		mOnsets;
+	uint64_t				mHop = 0;
+	float					mOnsetMean = 0.0f, mOnsetVar = 0.0f;
+
+	// decaying autocorrelation per lag, in hops
+	size_t					mMinLag, mMaxLag;
+	std::vector<float>		mAcf;
+	std::vector<float>		mPrior;
+	float					mPeriod = 0.0f;		// hops per beat, 0 until locked
+	float					mCandidatePeriod = 0.0f;
+	int						mCandidateHops = 0;
+	float					mConfidence = 0.0f;
+
+	// beat prediction
+	double					mNextBeat = 0.0;	// in hops
+	double					mLastBeat = -1.0;
+	std::vector<double>		*mBeatLog = nullptr;
+
+	// published to the render thread
+	std::atomic<float>		mPublishedBpm{ 0.0f };
+	std::atomic<float>		mPublishedConfidence{ 0.0f };
+	std::atomic<double>		mPublishedBeatAge{ 0.0 };	// seconds since last beat at publish time
+	std::atomic<int64_t>	mPublishedAt{ 0 };			// steady clock, ns
+	float					mHandOffMs = 0.0f;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cinder/audio/Node.h"
+#include "cinder/audio/Source.h"
+#include "cinder/audio/Context.h"
+#include "cinder/Log.h"
+
+#include "SkyBeatTracker.h"
+
+typedef std::shared_ptr<class SkyBeatTrackerNode> SkyBeatTrackerNodeRef;
+
+// Pulled by the audio context without being connected to the output, feeds the tracker from the audio thread.
+class SkyBeatTrackerNode : public ci::audio::NodeAutoPullable {
+public:
+	SkyBeatTrackerNode(const Format &format = Format())
+		: NodeAutoPullable(format)
+	{
+		setChannelMode(ChannelMode::SPECIFIED);
+		setNumChannels(1);
+		mTracker = SkyBeatTracker::create((float)ci::audio::master()->getSampleRate());
+	}
+
+	const SkyBeatTrackerRef&	getTracker() const { return mTracker; }
+
+	// decodes a whole file and runs the tracker offline over it
+	static SkyBeatTracker::Analysis analyzeFile(const ci::DataSourceRef &dataSource)
+	{
+		auto source = ci::audio::load(dataSource);
+		auto buffer = source->loadBuffer();
+		SkyBeatTracker::Analysis analysis;
+		if (!buffer->getNumFrames()) return analysis;
+
+		// down-mix to mono in place of the first channel
+		float *mono = buffer->getChannel(0);
+		for (size_t ch = 1; ch < buffer->getNumChannels(); ch++) {
+			const float *channel = buffer->getChannel(ch);
+			for (size_t i = 0; i < buffer->getNumFrames(); i++) mono[i] += channel[i];
+		}
+		analysis = SkyBeatTracker::analyze(mono, buffer->getNumFrames(), (float)source->getSampleRate());
+		CI_LOG_I("analyzed " << buffer->getNumFrames() / (float)source->getSampleRate() << "s, bpm " << analysis.bpm << " confidence " << analysis.confidence << " beats " << analysis.beatTimes.size());
+		return analysis;
+	}
+protected:
+	void initialize() override
+	{
+		if (mTracker->getSampleRate() != (float)getSampleRate()) {
+			CI_LOG_W("beat tracker sample rate changed to " << getSampleRate());
+			mTracker = SkyBeatTracker::create((float)getSampleRate());
+		}
+	}
+	void process(ci::audio::Buffer *buffer) override
+	{
+		mTracker->process(buffer->getChannel(0), buffer->getNumFrames());
+	}
+private:
+	SkyBeatTrackerRef			mTracker;
+};
@@ -0,0 +1,66 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Field of mesh instances drawn in one instanced GL_PATCHES call.
+ Instance state is kept as structure of arrays and animated four at a
+ time with SSE, culled against the view frustum in the same pass, and
+ only the visible transforms and colours are written to the SSBO that
+ the CROWD variant of the tessellation shaders reads by gl_InstanceID.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Ssbo.h"
+
+typedef std::shared_ptr<class SkyCrowd> SkyCrowdRef;
+
+class SkyCrowd {
+public:
+	// std430 layout of one element of the Instances buffer
+	struct Instance {
+		ci::mat4			model;
+		ci::vec4			color;
+	};
+	struct Stats {
+		size_t				count = 0;
+		size_t				visible = 0;
+		double				updateMs = 0.0;		// animation, culling and packing
+		double				uploadMs = 0.0;
+	};
+
+	static SkyCrowdRef create(size_t count) { return SkyCrowdRef(new SkyCrowd(count)); }
+
+	// lays out a new field, the buffer grows to fit
+	void					setCount(size_t count);
+	size_t					getCount() const { return mCount; }
+	// radius of the field on the ground plane
+	float					getRadius() const { return mRadius; }
+	// a camera looking over the whole field
+	ci::CameraPersp			getCamera(float aspect, double time) const;
+
+	// render thread: animates, culls against viewProjection and uploads the visible instances
+	void					update(double time, const ci::mat4 &viewProjection);
+	// draws the visible instances of the batch mesh with its CROWD shader, uniforms already set
+	void					draw(const ci::gl::BatchRef &batch);
+
+	const Stats&			getStats() const { return mStats; }
+private:
+	SkyCrowd(size_t count);
+
+	void					animate(size_t first, float time, const ci::vec4 planes[6]);
+	void					pack(size_t index, float sinAngle, float cosAngle, float y);
+
+	size_t					mCount = 0;
+	float					mRadius = 1.0f;
+	// structure of arrays, padded to a multiple of 4
+	std::vector<float>		mX, mY, mZ;			// base position
+	std::vector<float>		mAxisX, mAxisY, mAxisZ;
+	std::vector<float>		mPhase, mSpin, mBob, mScale;
+	std::vector<ci::vec4>	mColors;
+
+	std::vector<Instance>	mVisible;
+	ci::gl::SsboRef			mSsbo;
+	Stats					mStats;
+};
@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Dropped file ingestion.
+ Each dropped file is classified by extension, then read through a memory
+ mapping, parsed or decoded on a worker thread, and compiled or uploaded on
+ the GPU upload thread. Items report their stage and progress while they
+ load, and are handed back from poll() only once complete, so the render
+ thread activates a new source between frames and never waits for one.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/Filesystem.h"
+
+#include "SkyAutomation.h"
+#include "SkyGpuUploader.h"
+#include "SkyShaderCache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<class SkyDropIngest> SkyDropIngestRef;
+
+class SkyDropIngest {
+public:
+	enum class Kind { SHADER, IMAGE, VIDEO, FOLDER, AUTOMATION, OTHER };
+	enum class Stage { QUEUED, READING, PARSING, DECODING, COMPILING, UPLOADING, READY, FAILED };
+	struct Format {
+		Format() {}
+		Format&		numThreads(size_t threads) { mNumThreads = threads; return *this; }
+		Format&		textureFormat(const ci::gl::Texture2d::Format &format) { mTextureFormat = format; return *this; }
+
+		size_t						mNumThreads = 2;
+		ci::gl::Texture2d::Format	mTextureFormat;
+	};
+	struct Item {
+		ci::fs::path				path;
+		Kind						kind = Kind::OTHER;
+		std::atomic<Stage>			stage{ Stage::QUEUED };
+		std::atomic<float>			progress{ 0.0f };	// of the whole item
+		size_t						bytes = 0;
+		double						startTime = 0.0;
+		double						totalMs = 0.0;		// drop to completion, set by poll()
+
+		// valid once READY
+		SkyShaderProgramRef			program;	// SHADER
+		ci::gl::Texture2dRef		texture;	// IMAGE
+		std::vector<ci::fs::path>	stills;		// FOLDER, the images it contains
+		SkyAutomationRef			automation;	// AUTOMATION
+	};
+	typedef std::shared_ptr<Item> ItemRef;
+	struct Stats {
+		uint64_t	queued = 0;
+		uint64_t	ready = 0;
+		uint64_t	failed = 0;
+		uint64_t	bytesRead = 0;
+		double		lastMs = 0.0;		// drop to completion
+	};
+
+	static SkyDropIngestRef create(const SkyGpuUploaderRef &uploader, const SkyShaderCacheRef &shaderCache, const Format &format = Format()) { return SkyDropIngestRef(new SkyDropIngest(uploader, shaderCache, format)); }
+	~SkyDropIngest();
+
+	static Kind				classify(const ci::fs::path &path);
+	static const char*		getStageName(Stage stage);
+
+	// render thread: queues the file, OTHER items complete at once for the caller to forward
+	void					add(const ci::fs::path &path);
+	// render thread, between frames: items that completed since the last call, READY or FAILED, in completion order
+	std::vector<ItemRef>	poll();
+	// items still loading, for the progress display
+	const std::vector<ItemRef>&	getPending() const { return mPending; }
+	const Stats&			getStats() const { return mStats; }
+private:
+	SkyDropIngest(const SkyGpuUploaderRef &uploader, const SkyShaderCacheRef &shaderCache, const Format &format);
+
+	void					workerFn();
+	void					ingest(const ItemRef &item);
+	void					ingestShader(const ItemRef &item, const uint8_t *data, size_t size);
+	void					ingestImage(const ItemRef &item, const uint8_t *data, size_t size);
+	void					ingestFolder(const ItemRef &item);
+	// touches every page of the mapping so a slow disk shows as read progress
+	static void				prefault(const ItemRef &item, const uint8_t *data, size_t size, float from, float to);
+	void					complete(const ItemRef &item, Stage stage);
+
+	SkyGpuUploaderRef		mUploader;
+	SkyShaderCacheRef		mShaderCache;
+	Format					mFormat;
+	Stats					mStats;
+
+	// render thread only
+	std::vector<ItemRef>	mPending;
+
+	// shared with the workers
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	std::deque<ItemRef>		mQueue;
+	std::deque<ItemRef>		mCompleted;
+	bool					mRunning = true;
+	std::vector<std::thread>	mThreads;
+};
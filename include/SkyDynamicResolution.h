@@ -0,0 +1,72 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Dynamic render resolution.
+ GPU time of the scene is measured with timer queries read a few frames
+ late, and the render size steps down when it misses the target or up
+ when it comfortably beats it. The scene target is allocated once at the
+ full size and rendered into a smaller viewport, then a sharpening
+ upscale brings it back to the fixed output size.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+typedef std::shared_ptr<class SkyDynamicResolution> SkyDynamicResolutionRef;
+
+class SkyDynamicResolution {
+public:
+	struct Format {
+		Format() {}
+		Format&		targetMilliseconds(float ms) { mTargetMilliseconds = ms; return *this; }
+		Format&		minScale(float scale) { mMinScale = scale; return *this; }
+		Format&		numLevels(int levels) { mNumLevels = levels; return *this; }
+		Format&		sharpness(float sharpness) { mSharpness = sharpness; return *this; }
+
+		float		mTargetMilliseconds = 14.0f;	// leaves headroom under 60 fps for the ui and the blit
+		float		mMinScale = 0.5f;
+		int			mNumLevels = 6;
+		float		mSharpness = 0.4f;
+	};
+
+	static SkyDynamicResolutionRef create(const ci::ivec2 &outputSize, const Format &format = Format()) { return SkyDynamicResolutionRef(new SkyDynamicResolution(outputSize, format)); }
+	~SkyDynamicResolution();
+
+	void					setEnabled(bool enabled);
+	bool					isEnabled() const { return mEnabled; }
+
+	// around the scene render, resolve and upscale of a frame; the level for the next frame is picked in endFrame()
+	void					beginFrame();
+	void					endFrame();
+
+	// region of the full size target to render this frame, anchored at the origin
+	ci::ivec2				getRenderSize() const { return mEnabled ? mLevels[mLevel] : mOutputSize; }
+	float					getScale() const { return (float)getRenderSize().x / mOutputSize.x; }
+	float					getGpuMilliseconds() const { return mGpuMs; }
+	// the rendered region of scene stretched to the output size, or scene itself at full resolution
+	ci::gl::Texture2dRef	upscale(const ci::gl::Texture2dRef &scene);
+private:
+	SkyDynamicResolution(const ci::ivec2 &outputSize, const Format &format);
+
+	static const int		kNumQueries = 4;
+
+	ci::ivec2				mOutputSize;
+	Format					mFormat;
+	std::vector<ci::ivec2>	mLevels;		// largest first
+	int						mLevel = 0;
+	bool					mEnabled = false;
+
+	GLuint					mQueries[kNumQueries];
+	int						mQueryWrite = 0;
+	int						mQueryRead = 0;
+	float					mGpuMs = 0.0f;
+	int						mOverFrames = 0;
+	int						mUnderFrames = 0;
+	int						mCooldown = 0;
+	double					mLastLog = 0.0;
+
+	ci::gl::FboRef			mOutputFbo;
+	ci::gl::GlslProgRef		mUpscaleShader;
+};
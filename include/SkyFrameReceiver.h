@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Receiver for frames shared by other applications, Spout on Windows and
+ POSIX shared memory elsewhere. Senders are discovered on a background
+ thread, so the render thread only ever receives from a sender that is
+ known to exist. Textures come from a pool keyed by size: when the sender
+ changes resolution the frame is received into a pooled texture of the
+ new size in the same call instead of being dropped.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+typedef std::shared_ptr<class SkyFrameReceiver> SkyFrameReceiverRef;
+
+class SkyFrameReceiver {
+public:
+	struct SenderInfo {
+		std::string				name;
+		ci::ivec2				size;
+	};
+	class TexturePool {
+	public:
+		// a texture of that size not referenced outside the pool, created only the first time
+		ci::gl::Texture2dRef	acquire(const ci::ivec2 &size);
+		void					reserve(const ci::ivec2 &size);
+		size_t					getNumCreated() const { return mCreated; }
+	private:
+		std::map<std::pair<int, int>, std::vector<ci::gl::Texture2dRef>>	mTextures;
+		size_t					mCreated = 0;
+	};
+	class Backend {
+	public:
+		virtual ~Backend() {}
+		// discovery thread
+		virtual std::vector<SenderInfo>	listSenders() = 0;
+		// render thread: the newest frame of the sender in a pooled texture, false if there is no new frame
+		virtual bool			receive(const SenderInfo &sender, TexturePool &pool, ci::gl::Texture2dRef &texture) = 0;
+	};
+
+	// an empty name follows the active sender, or the first one found
+	static SkyFrameReceiverRef create(const std::string &senderName = "") { return SkyFrameReceiverRef(new SkyFrameReceiver(senderName)); }
+	~SkyFrameReceiver();
+
+	// render thread, the last received texture, nullptr until a sender has been found
+	ci::gl::Texture2dRef	receiveTexture();
+
+	bool					isConnected() const { return mConnected; }
+	std::string				getSenderName() const;
+	void					setSenderName(const std::string &name);
+	uint64_t				getNumReceived() const { return mReceived; }
+	const TexturePool&		getPool() const { return mPool; }
+private:
+	SkyFrameReceiver(const std::string &senderName);
+	void					discoveryFn();
+
+	std::unique_ptr<Backend>	mBackend;
+	TexturePool				mPool;
+	ci::gl::Texture2dRef	mTexture;
+	bool					mConnected = false;
+	uint64_t				mReceived = 0;
+
+	// published by the discovery thread
+	mutable std::mutex		mMutex;
+	std::condition_variable	mCondition;
+	std::string				mWanted;
+	SenderInfo				mSender;
+	std::vector<ci::ivec2>	mSizes;			// of every sender seen, so the pool is ready for a switch
+	bool					mRunning = true;
+	std::thread				mThread;
+};
@@ -0,0 +1,106 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ GPU upload worker.
+ Each upload thread owns a GL context shared with the render context and
+ builds meshes, textures and programs there. A finished build is fenced
+ and only handed back once the GPU has passed the fence, so update() never
+ waits: it just swaps in resources that are ready. Vertex array objects are
+ not shared between contexts, so meshes come back as VboMeshes and their
+ VAO is made by the batch that takes them, on the render thread.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/Surface.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+typedef std::shared_ptr<class SkyGpuUploader> SkyGpuUploaderRef;
+
+class SkyGpuUploader {
+public:
+	struct Format {
+		Format() {}
+		Format&		numContexts(size_t contexts) { mNumContexts = contexts; return *this; }
+		Format&		readyPerFrame(size_t jobs) { mReadyPerFrame = jobs; return *this; }
+
+		size_t		mNumContexts = 1;
+		size_t		mReadyPerFrame = 4;		// swaps done by one update()
+	};
+	struct Stats {
+		uint64_t	submitted = 0;
+		uint64_t	completed = 0;
+		uint64_t	failed = 0;
+		size_t		pendingCount = 0;
+		double		lastBuildMs = 0.0;
+		double		maxBuildMs = 0.0;
+	};
+
+	// render thread, the upload contexts share objects with the current context
+	static SkyGpuUploaderRef create(const Format &format = Format()) { return SkyGpuUploaderRef(new SkyGpuUploader(format)); }
+	~SkyGpuUploader();
+
+	// any thread: build runs on an upload thread and may throw, ready runs from update() with what build returned
+	template<typename Build, typename Ready>
+	void					submit(const std::string &name, Build build, Ready ready);
+
+	void					uploadTexture(const std::string &name, const ci::Surface8uRef &surface, const ci::gl::Texture2d::Format &format, const std::function<void(const ci::gl::Texture2dRef&)> &ready);
+	void					compileProgram(const std::string &name, const ci::gl::GlslProg::Format &format, const std::function<void(const ci::gl::GlslProgRef&)> &ready);
+
+	// render thread, once per frame: swaps in at most readyPerFrame finished jobs, never waits on the GPU
+	void					update();
+	// render thread: blocks until every submitted job has been swapped in, for startup and benchmarks
+	void					finish();
+	bool					isIdle() { return getStats().pendingCount == 0; }
+	Stats					getStats();
+private:
+	SkyGpuUploader(const Format &format);
+
+	struct Job {
+		std::string				name;
+		std::function<void()>	build;
+		std::function<void()>	ready;
+		ci::gl::SyncRef			fence;
+		bool					failed = false;
+		double					buildMs = 0.0;
+	};
+	typedef std::shared_ptr<Job> JobRef;
+
+	void					enqueue(const JobRef &job);
+	void					workerFn(ci::gl::ContextRef context);
+	void					complete(const JobRef &job);
+
+	Format					mFormat;
+
+	// render thread only
+	std::deque<JobRef>		mFenced;
+
+	// shared with the upload threads and other submitters
+	Stats					mStats;
+	std::mutex				mMutex;
+	std::condition_variable	mCondition, mBuiltCondition;
+	std::deque<JobRef>		mJobs;
+	std::deque<JobRef>		mBuilt;
+	bool					mRunning = true;
+	std::vector<std::thread>	mThreads;
+};
+
+template<typename Build, typename Ready>
+void SkyGpuUploader::submit(const std::string &name, Build build, Ready ready)
+{
+	typedef typename std::decay<decltype(build())>::type Result;
+	auto result = std::make_shared<Result>();
+	auto job = std::make_shared<Job>();
+	job->name = name;
+	job->build = [result, build] { *result = build(); };
+	job->ready = [result, ready] { ready(*result); };
+	enqueue(job);
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Append-only journal of keyed float values.
+ record() only queues the change; a background thread appends queued
+ records to <name>.journal every flush interval and periodically compacts
+ the latest values into <name>.snapshot through a temporary file and an
+ atomic rename. A crash loses at most one flush interval of edits.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<class SkyJournal> SkyJournalRef;
+
+class SkyJournal {
+public:
+	struct Format {
+		Format() {}
+		Format&		flushMilliseconds(int ms) { mFlushMilliseconds = ms; return *this; }
+		Format&		compactSeconds(int seconds) { mCompactSeconds = seconds; return *this; }
+		Format&		compactBytes(size_t bytes) { mCompactBytes = bytes; return *this; }
+
+		int			mFlushMilliseconds = 500;
+		int			mCompactSeconds = 30;
+		size_t		mCompactBytes = 64 << 10;
+	};
+	typedef std::map<uint32_t, float> Values;
+
+	// basePath without extension, the snapshot and journal are replayed before the writer starts
+	static SkyJournalRef create(const std::string &basePath, const Format &format = Format()) { return SkyJournalRef(new SkyJournal(basePath, format)); }
+	~SkyJournal();
+
+	// latest value of every key, as restored at startup and updated by record()
+	const Values&		getValues() const { return mValues; }
+	bool				get(uint32_t key, float &value) const;
+	// render thread: queues the value if it differs from the last recorded one
+	void				record(uint32_t key, float value);
+	// writes pending records and stops the writer, without compacting
+	void				close();
+
+	uint64_t			getNumFlushed() const { return mFlushed.load(); }
+	uint64_t			getNumCompactions() const { return mCompactions.load(); }
+private:
+	SkyJournal(const std::string &basePath, const Format &format);
+
+	struct Record {
+		uint32_t		key;
+		float			value;
+		uint32_t		check;
+	};
+	static Record		makeRecord(uint32_t key, float value);
+	static bool			isValid(const Record &record);
+	static size_t		readRecords(const std::string &path, size_t offset, Values &values);
+
+	void				writerFn();
+	void				flush(std::vector<Record> &records);
+	void				compact();
+
+	std::string			mJournalPath, mSnapshotPath;
+	Format				mFormat;
+	Values				mValues;		// render thread
+
+	std::mutex			mMutex;
+	std::condition_variable	mCondition;
+	std::vector<Record>	mPending;
+	bool				mRunning = true;
+	std::thread			mThread;
+
+	// writer thread
+	FILE				*mJournal = nullptr;
+	size_t				mJournalBytes = 0;
+	Values				mCompacted;
+	std::atomic<uint64_t>	mFlushed{ 0 };
+	std::atomic<uint64_t>	mCompactions{ 0 };
+};
@@ -0,0 +1,112 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Procedural meshes regenerated every frame without allocation.
+ Positions and indices live in one persistently mapped arena split into
+ three regions: each frame the next region is rewritten in place, rows of
+ the surface spread over a pool of threads, and drawn with a base vertex
+ offset. A fence after the draw guards the region until the GPU is done
+ with it, so parameters can change every frame with no buffer
+ reallocation and no driver stall. Without GL_ARB_buffer_storage the
+ regions are filled from a staging copy with glBufferSubData.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Sync.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef std::shared_ptr<class SkyMeshStream> SkyMeshStreamRef;
+
+class SkyMeshStream {
+public:
+	enum class Shape { TORUS, TORUS_KNOT, SPHERE };
+	struct Params {
+		Params() {}
+		Params&		shape(Shape shape) { mShape = shape; return *this; }
+		// along the ring or the knot, or from pole to pole
+		Params&		rings(int rings) { mRings = rings; return *this; }
+		// around the tube, or around the sphere
+		Params&		segments(int segments) { mSegments = segments; return *this; }
+		Params&		radius(float radius) { mRadius = radius; return *this; }
+		Params&		tubeRadius(float radius) { mTubeRadius = radius; return *this; }
+		// a (p, q) torus knot winds p times around the axis and q times through the hole
+		Params&		turns(int p, int q) { mP = p; mQ = q; return *this; }
+
+		Shape		mShape = Shape::TORUS_KNOT;
+		int			mRings = 256;
+		int			mSegments = 24;
+		float		mRadius = 1.0f;
+		float		mTubeRadius = 0.2f;
+		int			mP = 2;
+		int			mQ = 3;
+	};
+	struct Vertex {
+		float		x, y, z;
+	};
+	struct Stats {
+		uint64_t	frames = 0;
+		uint64_t	stalls = 0;			// the region's fence had not passed yet
+		double		stallMs = 0.0;
+		double		generateMs = 0.0;	// last frame
+		size_t		vertices = 0;
+		size_t		indices = 0;
+		bool		persistent = false;
+	};
+
+	static SkyMeshStreamRef	create(size_t maxVertices = 256 << 10, size_t numThreads = 0) { return SkyMeshStreamRef(new SkyMeshStream(maxVertices, numThreads)); }
+	~SkyMeshStream();
+
+	// render thread, once per frame: writes the next region, rings and segments are scaled down to fit the arena
+	void					update(const Params &params);
+	// render thread: the last region written as GL_PATCHES of three, into the shader's ciPosition
+	void					draw(const ci::gl::GlslProgRef &shader);
+	const Stats&			getStats() const { return mStats; }
+
+	// vertex and quad rows of the surface, params already fitted
+	static void				getRows(const Params &params, int &vertexRows, int &quadRows);
+	static void				generateRows(const Params &params, int rowBegin, int rowEnd, Vertex *vertices, uint32_t *indices);
+private:
+	SkyMeshStream(size_t maxVertices, size_t numThreads);
+
+	static const int		kNumRegions = 3;
+	static const int		kIndicesPerVertex = 6;
+
+	Params					fit(const Params &params) const;
+	void					workerFn(size_t worker);
+	void					generate(size_t chunk, size_t numChunks);
+
+	size_t					mMaxVertices;
+	size_t					mMaxIndices;
+	Stats					mStats;
+
+	ci::gl::VboRef			mVertexBuffer;
+	ci::gl::VboRef			mIndexBuffer;
+	Vertex					*mVertices = nullptr;	// mapped, or the staging copy
+	uint32_t				*mIndices = nullptr;
+	std::vector<Vertex>		mStagingVertices;
+	std::vector<uint32_t>	mStagingIndices;
+	ci::gl::SyncRef			mFences[kNumRegions];
+	ci::gl::VaoRef			mVao;
+	int						mVaoLocation = -1;
+	int						mRegion = -1;			// written last
+	size_t					mNumIndices = 0;
+
+	// the frame being generated
+	Params					mParams;
+	Vertex					*mRegionVertices = nullptr;
+	uint32_t				*mRegionIndices = nullptr;
+
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	std::condition_variable	mDoneCondition;
+	bool					mRunning = true;
+	uint64_t				mGeneration = 0;
+	size_t					mPending = 0;
+	std::vector<std::thread>	mThreads;
+};
@@ -0,0 +1,164 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ MIDI control change mapping.
+ Sources push raw messages from their own thread into a lock-free single
+ producer queue: a device is fed from the RtMidi callback thread, a replay
+ from a thread that plays back a text file of timed messages, so mappings
+ can be exercised without hardware. Once per frame the mapper drains every
+ source, resolves each CC through a channel x controller table, scales it
+ into the uniform range and eases the uniform towards it. Learn mode binds
+ the next CC that arrives. Mappings persist as JSON.
+ */
+
+#pragma once
+
+#include "cinder/Filesystem.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RtMidiIn;
+
+struct SkyMidiEvent {
+	uint8_t					status = 0;		// 0xB0 | channel for a control change
+	uint8_t					data1 = 0;
+	uint8_t					data2 = 0;
+	int64_t					time = 0;		// steady clock nanoseconds at arrival
+};
+
+// single producer, single consumer, drops messages when full
+class SkyMidiQueue {
+public:
+	static const size_t		kCapacity = 1024;
+
+	bool					push(const SkyMidiEvent &event);
+	bool					pop(SkyMidiEvent &event);
+	uint64_t				getNumDropped() const { return mDropped.load(); }
+private:
+	std::array<SkyMidiEvent, kCapacity>	mEvents;
+	alignas(64) std::atomic<size_t>		mHead{ 0 };		// next write, producer
+	alignas(64) std::atomic<size_t>		mTail{ 0 };		// next read, consumer
+	std::atomic<uint64_t>				mDropped{ 0 };
+};
+
+typedef std::shared_ptr<class SkyMidiSource> SkyMidiSourceRef;
+typedef std::shared_ptr<class SkyMidiMapper> SkyMidiMapperRef;
+
+class SkyMidiSource {
+public:
+	virtual ~SkyMidiSource() {}
+
+	// render thread
+	bool					pop(SkyMidiEvent &event) { return mQueue.pop(event); }
+	const std::string&		getName() const { return mName; }
+	uint64_t				getNumDropped() const { return mQueue.getNumDropped(); }
+
+	static int64_t			now();
+protected:
+	SkyMidiQueue			mQueue;
+	std::string				mName;
+};
+
+class SkyMidiDevice : public SkyMidiSource {
+public:
+	static std::vector<std::string>	listPorts();
+	// by index or by part of the port name, nullptr if no port matches or it cannot be opened
+	static SkyMidiSourceRef	open(const std::string &port);
+	~SkyMidiDevice();
+private:
+	SkyMidiDevice();
+	static void				callback(double delta, std::vector<unsigned char> *message, void *user);
+
+	std::unique_ptr<RtMidiIn>	mIn;
+};
+
+class SkyMidiReplay : public SkyMidiSource {
+public:
+	// lines of "milliseconds channel controller value", # starts a comment; nullptr if the file has no messages
+	static SkyMidiSourceRef	create(const ci::fs::path &path, bool loop = false);
+	~SkyMidiReplay();
+
+	bool					isFinished() const { return mFinished.load(); }
+private:
+	SkyMidiReplay() {}
+	void					playFn();
+
+	std::vector<std::pair<double, SkyMidiEvent>>	mMessages;	// by time in milliseconds
+	bool					mLoop = false;
+	std::atomic<bool>		mRunning{ true };
+	std::atomic<bool>		mFinished{ false };
+	std::thread				mThread;
+};
+
+class SkyMidiMapper {
+public:
+	struct Mapping {
+		int					channel = 0;
+		int					controller = 0;
+		int					target = -1;			// VDUniforms index
+		float				min = 0.0f;
+		float				max = 1.0f;
+		float				smoothingMs = 30.0f;	// time constant, 0 jumps
+	};
+	struct Stats {
+		uint64_t			events = 0;
+		uint64_t			controlChanges = 0;
+		uint64_t			unmapped = 0;
+		uint64_t			dropped = 0;
+		double				meanLatencyMs = 0.0;	// arrival to the frame that applies it
+		double				maxLatencyMs = 0.0;
+	};
+
+	static SkyMidiMapperRef	create() { return SkyMidiMapperRef(new SkyMidiMapper()); }
+
+	void					addSource(const SkyMidiSourceRef &source) { mSources.push_back(source); }
+	const std::vector<SkyMidiSourceRef>&	getSources() const { return mSources; }
+
+	// replaces the mapping of the same control
+	void					map(const Mapping &mapping);
+	void					unmap(int channel, int controller);
+	const std::vector<Mapping>&	getMappings() const { return mMappings; }
+	// the next control change is mapped to target
+	void					learn(int target, float min = 0.0f, float max = 1.0f, float smoothingMs = 30.0f);
+	void					cancelLearn() { mLearning = false; }
+	bool					isLearning() const { return mLearning; }
+
+	// render thread, once per frame: drains the sources and eases every mapped uniform, returns true if learn mode bound a control
+	bool					update(double elapsedSeconds);
+	// uniforms that moved this frame
+	const std::vector<std::pair<int, float>>&	getChanges() const { return mChanges; }
+
+	bool					save(const ci::fs::path &path) const;
+	bool					load(const ci::fs::path &path);
+	const Stats&			getStats() const { return mStats; }
+	void					resetStats() { mStats = Stats(); mLatencySum = 0.0; }
+private:
+	SkyMidiMapper();
+
+	static int				getControl(int channel, int controller) { return ((channel & 15) << 7) | (controller & 127); }
+	void					rebuildTable();
+
+	struct State {
+		float				current = 0.0f;
+		float				goal = 0.0f;
+		bool				moving = false;
+		bool				initialized = false;
+	};
+
+	std::vector<SkyMidiSourceRef>	mSources;
+	std::vector<Mapping>			mMappings;
+	std::vector<State>				mStates;		// by mapping
+	std::array<int16_t, 16 * 128>	mTable;			// mapping by control, -1 when unmapped
+	std::vector<std::pair<int, float>>	mChanges;
+
+	bool					mLearning = false;
+	Mapping					mLearn;
+	Stats					mStats;
+	double					mLatencySum = 0.0;
+};
@@ -0,0 +1,46 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Feeds the final frame to a SkyNetSender.
+ The texture is read back into a small ring of pixel pack buffers and a
+ buffer is only mapped once its fence has passed, so the render thread
+ never waits on the readback. Rows stay bottom up as read back, the
+ receiving end uploads them the same way.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+
+#include "SkyNetStream.h"
+
+#include <deque>
+
+typedef std::shared_ptr<class SkyNetOutput> SkyNetOutputRef;
+
+class SkyNetOutput {
+public:
+	static SkyNetOutputRef	create(const SkyNetSenderRef &sender) { return SkyNetOutputRef(new SkyNetOutput(sender)); }
+
+	// render thread, once per frame, the texture must be RGBA
+	void					capture(const ci::gl::Texture2dRef &texture);
+	const SkyNetSenderRef&	getSender() const { return mSender; }
+private:
+	SkyNetOutput(const SkyNetSenderRef &sender) : mSender(sender) {}
+
+	struct Slot {
+		ci::gl::PboRef		pbo;
+		ci::gl::SyncRef		fence;
+		int64_t				timestamp = 0;
+	};
+	static const size_t		kNumSlots = 3;
+
+	SkyNetSenderRef			mSender;
+	ci::ivec2				mSize;
+	std::vector<Slot>		mSlots;
+	std::deque<size_t>		mFreeSlots;
+	std::deque<size_t>		mReadbackSlots;		// in capture order
+};
@@ -0,0 +1,238 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Frame stream to a remote receiver over TCP or UDP.
+ The frame is cut into horizontal bands of 64 pixel tile rows, each
+ delta coded by its own SkyTileEncoder on its own thread. The sender
+ never queues more than one encoded frame, a frame offered while the
+ previous one is still in flight is dropped at the source, so a slow link
+ costs frames and never latency. Over UDP band packets are split into
+ datagrams, paced to a bit rate, and a receiver that loses one asks for a
+ keyframe. The receiver decodes every band and only keeps the newest
+ complete frame.
+ */
+
+#pragma once
+
+#include "SkyTileCodec.h"
+
+// the asio bundled with Cinder, as the OSC block uses it
+#if ! defined( ASIO_STANDALONE )
+#define ASIO_STANDALONE 1
+#endif
+#include "asio/asio.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef std::shared_ptr<class SkyNetSender> SkyNetSenderRef;
+typedef std::shared_ptr<class SkyNetReceiver> SkyNetReceiverRef;
+
+class SkyNetStream {
+public:
+	enum class Protocol { TCP, UDP };
+	// before every band packet on TCP and every datagram on UDP
+	struct MessageHeader {
+		uint32_t				magic;
+		uint32_t				frame;
+		int64_t					timestamp;		// steady clock of the sender when the frame was offered, in ns
+		uint32_t				width;			// of the whole frame
+		uint32_t				height;
+		uint16_t				band;
+		uint16_t				numBands;
+		uint32_t				bandY;			// first row of the band
+		uint32_t				bandBytes;		// the whole band packet
+		uint32_t				offset;			// of this datagram in the band packet
+		uint32_t				chunkBytes;		// UDP, every datagram of the band but the last carries this much of it
+	};
+	static const uint32_t		kMagic = 0x4E594B53;			// "SKYN"
+	static const uint32_t		kKeyframeRequest = 0x4B594B53;	// "SKYK", receiver to sender over UDP
+
+	struct BenchmarkResults {
+		Protocol				protocol = Protocol::TCP;
+		double					offeredFps = 0.0;
+		double					sentFps = 0.0;
+		double					receivedFps = 0.0;
+		double					megabitsPerSecond = 0.0;
+		double					fullMegabitsPerSecond = 0.0;	// the same frames uncompressed
+		double					latencyMs = 0.0;
+		double					latencyMaxMs = 0.0;
+		double					encodeMs = 0.0;
+		uint64_t				dropped = 0;
+		uint64_t				incomplete = 0;
+		uint64_t				keyframeRequests = 0;
+	};
+
+	static int64_t				now();
+	// tile rows per band so that at most numBands bands cover the frame
+	static int					getBandRows(int height, int numBands);
+	// the largest band packet a sender writes for the band, header excluded
+	static size_t				getMaxBandBytes(const MessageHeader &header);
+	// false for a header no sender writes, checked before anything is allocated for it
+	static bool					isValid(const MessageHeader &header);
+	// a sender and a receiver over loopback, frames are a block moving over a gradient
+	static BenchmarkResults		benchmark(Protocol protocol, int width, int height, double fps, double seconds, uint16_t port = 9123);
+};
+
+class SkyNetSender {
+public:
+	struct Format {
+		Format() {}
+		Format&		protocol(SkyNetStream::Protocol protocol) { mProtocol = protocol; return *this; }
+		Format&		numBands(int bands) { mNumBands = bands; return *this; }
+		Format&		compress(bool enable = true) { mCompress = enable; return *this; }
+		Format&		keyframeInterval(int frames) { mKeyframeInterval = frames; return *this; }
+		Format&		datagramBytes(size_t bytes) { mDatagramBytes = bytes; return *this; }
+		Format&		megabitsPerSecond(double megabits) { mMegabitsPerSecond = megabits; return *this; }
+
+		SkyNetStream::Protocol	mProtocol = SkyNetStream::Protocol::TCP;
+		int			mNumBands = 0;				// 0 picks the hardware threads
+		bool		mCompress = true;
+		int			mKeyframeInterval = 120;	// 0 only sends keyframes when asked
+		size_t		mDatagramBytes = 1400;		// UDP, header included
+		double		mMegabitsPerSecond = 0.0;	// UDP pacing, 0 sends every datagram back to back
+	};
+	struct Stats {
+		uint64_t	offered = 0;
+		uint64_t	sent = 0;
+		uint64_t	dropped = 0;		// the previous frame was still being encoded or sent
+		uint64_t	keyframes = 0;
+		uint64_t	bytes = 0;
+		double		encodeMs = 0.0;		// last frame, slowest band
+		bool		connected = false;
+	};
+
+	static SkyNetSenderRef		create(const std::string &host, uint16_t port, const Format &format = Format()) { return SkyNetSenderRef(new SkyNetSender(host, port, format)); }
+	~SkyNetSender();
+
+	// any single thread, copies the frame unless the previous one is still in flight, rows as stored
+	bool						send(const uint8_t *rgba, int width, int height, int64_t timestamp = SkyNetStream::now());
+	Stats						getStats() const;
+private:
+	SkyNetSender(const std::string &host, uint16_t port, const Format &format);
+
+	void						encoderFn(int band);
+	void						networkFn();
+	bool						connect();
+	void						sendTcp(const std::vector<std::vector<uint8_t>> &messages);
+	void						sendUdp(const std::vector<std::vector<uint8_t>> &messages);
+
+	std::string					mHost;
+	uint16_t					mPort;
+	Format						mFormat;
+	int							mNumBands;
+
+	mutable std::mutex			mMutex;
+	std::condition_variable		mEncodeCondition;
+	std::condition_variable		mNetworkCondition;
+	bool						mRunning = true;
+	bool						mBusy = false;			// a frame is being encoded or sent
+	uint64_t					mGeneration = 0;		// bumped for every frame handed to the encoders
+	int							mPendingBands = 0;
+	bool						mEncoded = false;		// mMessages is ready for the network thread
+	std::atomic<bool>			mKeyframe{ true };		// the next frame is a keyframe in every band
+	Stats						mStats;
+
+	// the frame being encoded, written by send() only while idle
+	std::vector<uint8_t>		mFrame;
+	int							mWidth = 0;
+	int							mHeight = 0;
+	uint32_t					mFrameId = 0;
+	int64_t						mTimestamp = 0;
+	bool						mFrameKeyframe = false;
+	std::vector<std::vector<uint8_t>>	mMessages;		// one per band
+	std::vector<double>			mEncodeMs;
+
+	std::vector<std::thread>	mEncoders;
+	std::thread					mNetworkThread;
+
+	// network thread, the destructor shuts the sockets down under mSocketMutex to end a blocked send
+	asio::io_service			mIo;
+	std::mutex					mSocketMutex;
+	std::atomic<bool>			mStopping{ false };
+	std::unique_ptr<asio::ip::tcp::socket>	mTcp;
+	std::unique_ptr<asio::ip::udp::socket>	mUdp;
+	asio::ip::udp::endpoint		mUdpEndpoint;
+	int64_t						mLastAttempt = 0;
+};
+
+class SkyNetReceiver {
+public:
+	struct Stats {
+		uint64_t	frames = 0;			// complete frames decoded
+		uint64_t	taken = 0;			// handed out by receive()
+		uint64_t	stale = 0;			// complete, replaced by a newer one before receive() took it
+		uint64_t	incomplete = 0;		// a band was lost or failed to decode
+		uint64_t	keyframeRequests = 0;
+		uint64_t	bytes = 0;
+		double		latencyMs = 0.0;	// offered to complete, mean since the last resetStats, only meaningful on one machine
+		double		latencyMaxMs = 0.0;
+		bool		connected = false;
+	};
+
+	// listens on port, nullptr if it is taken
+	static SkyNetReceiverRef	create(uint16_t port, SkyNetStream::Protocol protocol = SkyNetStream::Protocol::TCP);
+	~SkyNetReceiver();
+
+	// any thread, copies the newest complete frame if it is newer than the last one taken
+	bool						receive(std::vector<uint8_t> &rgba, int &width, int &height);
+	Stats						getStats() const;
+	void						resetStats();
+private:
+	SkyNetReceiver(SkyNetStream::Protocol protocol);
+	bool						listen(uint16_t port);
+
+	void						acceptTcp();
+	void						readTcpHeader();
+	void						readTcpBody(const SkyNetStream::MessageHeader &header);
+	void						readUdp();
+	void						handleDatagram(size_t bytes);
+	// a frame of another size or banding starts the bands over
+	void						matchBands(const SkyNetStream::MessageHeader &header);
+	void						handleBand(const SkyNetStream::MessageHeader &header, const uint8_t *packet, size_t size);
+	void						requestKeyframe();
+
+	SkyNetStream::Protocol		mProtocol;
+	asio::io_service			mIo;
+	std::unique_ptr<asio::ip::tcp::acceptor>	mAcceptor;
+	std::unique_ptr<asio::ip::tcp::socket>	mTcp;
+	std::unique_ptr<asio::ip::udp::socket>	mUdp;
+	asio::ip::udp::endpoint		mSenderEndpoint;
+	std::vector<uint8_t>		mBuffer;
+	std::thread					mThread;
+
+	// network thread
+	struct Band {
+		SkyTileDecoder			decoder;
+		uint32_t				y = 0;
+		uint32_t				frame = 0;		// last frame decoded into it
+		// UDP reassembly
+		uint32_t				assemblingFrame = 0;
+		std::vector<uint8_t>	packet;
+		uint32_t				chunkBytes = 0;
+		std::vector<bool>		chunks;			// received, so a duplicate datagram counts once
+		size_t					received = 0;	// chunks
+		bool					assembled = true;
+	};
+	std::vector<Band>			mBands;
+	uint32_t					mWidth = 0;
+	uint32_t					mHeight = 0;
+	uint32_t					mFrame = 0;			// frame being completed
+	bool						mComplete = true;
+	int64_t						mLastRequest = 0;
+
+	// shared with receive()
+	mutable std::mutex			mMutex;
+	std::vector<uint8_t>		mLatest;
+	int							mLatestWidth = 0;
+	int							mLatestHeight = 0;
+	uint32_t					mLatestFrame = 0;
+	uint32_t					mTakenFrame = 0;
+	Stats						mStats;
+	uint64_t					mLatencyFrames = 0;
+};
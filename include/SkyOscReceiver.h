@@ -0,0 +1,138 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ OSC over UDP without allocation.
+ A dedicated thread receives into one fixed buffer and walks messages and
+ nested bundles in place. Addresses resolve through an open addressed
+ table built once from the routes, so the receive path never touches the
+ heap: every numeric argument becomes a (slot, value, due time) event in a
+ fixed lock-free queue. update() applies events whose bundle time has come,
+ keeps the newest value of each slot and reports the slots that changed.
+ */
+
+#pragma once
+
+// the asio bundled with Cinder, as the OSC block uses it
+#if ! defined( ASIO_STANDALONE )
+#define ASIO_STANDALONE 1
+#endif
+#include "asio/asio.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<class SkyOscReceiver> SkyOscReceiverRef;
+
+class SkyOscReceiver {
+public:
+	// the n-th numeric argument of a message to address goes to slot + n, arguments past numArguments are ignored
+	struct Route {
+		Route(const std::string &aAddress, int aSlot, int aNumArguments = 1) : address(aAddress), slot(aSlot), numArguments(aNumArguments) {}
+		std::string			address;
+		int					slot;
+		int					numArguments;	// at most kMaxArguments
+	};
+	struct Stats {
+		uint64_t			packets = 0;
+		uint64_t			messages = 0;
+		uint64_t			bundles = 0;
+		uint64_t			unrouted = 0;
+		uint64_t			malformed = 0;
+		uint64_t			dropped = 0;		// queue full
+		uint64_t			deferred = 0;		// held until their bundle time
+		uint64_t			applied = 0;
+		double				meanLatencyMs = 0.0;	// arrival, or bundle time, to update()
+		double				maxLatencyMs = 0.0;
+	};
+	struct BenchmarkResults {
+		int					rate = 0;			// messages per second asked for
+		uint64_t			sent = 0;
+		Stats				stats;
+		double				seconds = 0.0;
+	};
+	static const int		kMaxArguments = 16;
+
+	// nullptr if the port cannot be bound
+	static SkyOscReceiverRef	create(uint16_t port, const std::vector<Route> &routes);
+	~SkyOscReceiver();
+
+	// render thread, once per frame
+	void					update();
+	// slots that received a value since the last update, with their newest value
+	const std::vector<std::pair<int, float>>&	getChanges() const { return mChanges; }
+
+	// render thread
+	Stats					getStats() const;
+	void					resetStats();
+	uint16_t				getPort() const { return mPort; }
+
+	// loopback load test: a sender thread at rate messages per second, a tenth of them in timed bundles
+	static BenchmarkResults	benchmark(uint16_t port, int rate, double seconds);
+private:
+	SkyOscReceiver(const std::vector<Route> &routes);
+
+	struct Event {
+		int32_t				slot;
+		float				value;
+		int64_t				due;		// steady clock nanoseconds, 0 for immediately
+		int64_t				arrival;
+	};
+	struct Entry {
+		uint64_t			hash = 0;
+		uint32_t			offset = 0;	// in mNames
+		uint32_t			length = 0;
+		int32_t				slot = -1;	// -1 for an empty entry
+		int32_t				numArguments = 0;
+	};
+	static const size_t		kQueueCapacity = 1 << 14;
+	static const int		kMaxDepth = 8;		// of nested bundles
+
+	static uint64_t			hash(const char *text, size_t length);
+	// nullptr for an address without a route
+	const Entry*			findEntry(const char *address, size_t length) const;
+	static int64_t			now();
+	static uint64_t			ntpNow();
+	int64_t					getDue(uint64_t timetag) const;
+	void					receiveFn();
+	void					parsePacket(const char *data, size_t size, uint64_t timetag, int64_t arrival, int depth);
+	void					parseMessage(const char *data, size_t size, int64_t due, int64_t arrival);
+	bool					push(const Event &event);
+	bool					pop(Event &event);
+	void					apply(const Event &event, int64_t now);
+
+	// address table, immutable once the thread runs
+	std::vector<Entry>		mTable;
+	std::string				mNames;
+	int						mNumSlots = 0;
+
+	// receive thread
+	asio::io_service		mIo;
+	asio::ip::udp::socket	mSocket;
+	asio::ip::udp::endpoint	mSender;
+	std::array<char, 65536>	mBuffer;
+	uint16_t				mPort = 0;
+	std::atomic<bool>		mRunning{ true };
+	std::atomic<bool>		mStopped{ false };
+	std::thread				mThread;
+	// clock offset of the OSC time tags, NTP seconds in 32.32 fixed point
+	int64_t					mSteadyAtEpoch = 0;
+	uint64_t				mNtpAtEpoch = 0;
+
+	// single producer queue to the render thread
+	std::vector<Event>		mQueue;
+	alignas(64) std::atomic<size_t>	mHead{ 0 };
+	alignas(64) std::atomic<size_t>	mTail{ 0 };
+	std::atomic<uint64_t>	mPackets{ 0 }, mMessages{ 0 }, mBundles{ 0 }, mUnrouted{ 0 }, mMalformed{ 0 }, mDropped{ 0 };
+
+	// render thread
+	std::vector<Event>		mDeferred;		// reserved up front, events past capacity apply at once
+	std::vector<int32_t>	mChangeIndex;	// by slot, into mChanges or -1
+	std::vector<std::pair<int, float>>	mChanges;
+	uint64_t				mDeferredCount = 0, mApplied = 0;
+	double					mLatencySum = 0.0, mMaxLatency = 0.0;
+};
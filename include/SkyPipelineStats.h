@@ -0,0 +1,62 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Pipeline statistics of the scene draw.
+ ARB_pipeline_statistics_query counters are begun and ended around the
+ GL_PATCHES draws of a frame and read back a few frames late without
+ waiting, like the timer queries of the dynamic resolution. They show
+ how much the tessellation levels amplify each mesh: patches submitted,
+ evaluation shader invocations, geometry shader primitives and fragment
+ shader invocations. Without the extension only the primitives generated
+ by the last vertex stage are counted.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+typedef std::shared_ptr<class SkyPipelineStats> SkyPipelineStatsRef;
+
+class SkyPipelineStats {
+public:
+	struct Counters {
+		uint64_t			patches = 0;
+		uint64_t			evaluations = 0;	// tessellation evaluation shader invocations
+		uint64_t			geometryPrimitives = 0;
+		uint64_t			fragments = 0;
+		uint64_t			primitivesGenerated = 0;
+	};
+	// counts the draws of its lifetime, nothing for a null stats
+	class Scope {
+	public:
+		Scope(const SkyPipelineStatsRef &stats) : mStats(stats) { if (mStats) mStats->begin(); }
+		~Scope() { if (mStats) mStats->end(); }
+	private:
+		SkyPipelineStatsRef	mStats;
+	};
+
+	static SkyPipelineStatsRef	create() { return SkyPipelineStatsRef(new SkyPipelineStats()); }
+	~SkyPipelineStats();
+
+	// once per frame, on the draws to count
+	void					begin();
+	void					end();
+
+	bool					isSupported() const { return mSupported; }
+	// the latest frame read back
+	const Counters&			getCounters() const { return mCounters; }
+private:
+	SkyPipelineStats();
+
+	static const int		kNumFrames = 4;
+	static const int		kNumTargets = 5;
+
+	bool					mSupported = false;
+	int						mNumTargets = 1;
+	GLuint					mQueries[kNumFrames][kNumTargets];
+	int						mWrite = 0;
+	int						mRead = 0;
+	bool					mActive = false;
+	Counters				mCounters;
+};
@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Frame recorder to a PNG sequence or a raw Y4M file.
+ Each captured frame is read back into one of a fixed ring of pixel pack
+ buffers; once its fence has passed the buffer is mapped and handed,
+ still mapped, to a pool of encoder threads. The render thread never
+ waits: when every buffer is busy the frame is dropped and counted.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/Filesystem.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+typedef std::shared_ptr<class SkyRecorder> SkyRecorderRef;
+
+class SkyRecorder {
+public:
+	enum class Kind { PNG, Y4M };
+	struct Format {
+		Format() {}
+		Format&		kind(Kind kind) { mKind = kind; return *this; }
+		Format&		fps(int fps) { mFps = fps; return *this; }
+		Format&		numSlots(size_t slots) { mNumSlots = slots; return *this; }
+		Format&		numThreads(size_t threads) { mNumThreads = threads; return *this; }
+
+		Kind		mKind = Kind::Y4M;
+		int			mFps = 60;
+		size_t		mNumSlots = 12;		// readback buffers, the bound on memory and on encoder backlog
+		size_t		mNumThreads = 2;
+	};
+	struct Stats {
+		uint64_t	captured = 0;
+		uint64_t	written = 0;
+		uint64_t	dropped = 0;		// every buffer was busy
+		size_t		maxBusy = 0;		// most buffers in use at once
+	};
+
+	// path is a directory for PNG, the .y4m file otherwise; nullptr if it cannot be written
+	static SkyRecorderRef create(const ci::fs::path &path, const ci::ivec2 &size, const Format &format = Format());
+	~SkyRecorder();
+
+	// render thread, once per frame, the texture must be RGBA at the recorder size
+	void					capture(const ci::gl::Texture2dRef &texture);
+	// render thread, writes every frame already read back and joins the encoders
+	void					stop();
+
+	Stats					getStats() const;
+	const ci::fs::path&		getPath() const { return mPath; }
+
+	// rows bottom up as read back, stored deflate so the encoder cost is only the checksums
+	static void				encodePng(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &png);
+	// full range BT.601, 4:2:0, matches the C420jpeg header
+	static void				convertToI420(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &yuv);
+private:
+	SkyRecorder(const ci::fs::path &path, const ci::ivec2 &size, const Format &format);
+	bool					open();
+
+	struct Slot {
+		ci::gl::PboRef		pbo;
+		ci::gl::SyncRef		fence;
+		const uint8_t		*data = nullptr;	// mapped while owned by an encoder
+		uint64_t			sequence = 0;
+	};
+	void					collect(bool wait);
+	void					reclaim();
+	void					encoderFn();
+
+	ci::fs::path			mPath;
+	ci::ivec2				mSize;
+	Format					mFormat;
+	size_t					mFrameBytes;
+	bool					mStopped = false;
+	std::vector<Slot>		mSlots;
+
+	// render thread
+	std::deque<size_t>		mFreeSlots;
+	std::deque<size_t>		mReadbackSlots;		// in capture order
+	uint64_t				mSequence = 0;
+	Stats					mStats;
+
+	// shared with the encoders
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	std::deque<size_t>		mEncodeSlots;
+	std::deque<size_t>		mDoneSlots;
+	bool					mRunning = true;
+	std::vector<std::thread>	mThreads;
+	std::atomic<uint64_t>	mWritten{ 0 };
+
+	// Y4M frames are appended in sequence order
+	std::ofstream			mStream;
+	std::mutex				mWriteMutex;
+	std::condition_variable	mWriteCondition;
+	uint64_t				mNextWrite = 0;
+};
@@ -0,0 +1,75 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Compiled ISF / shadertoy programs, cached by preprocessed source hash.
+ Each program reflects its active uniforms once into a slot table, so
+ parameters are set by slot instead of by name every frame.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+#include "SkyShaderPreprocessor.h"
+
+#include <mutex>
+
+typedef std::shared_ptr<class SkyShaderProgram> SkyShaderProgramRef;
+typedef std::shared_ptr<class SkyShaderCache> SkyShaderCacheRef;
+
+class SkyShaderProgram {
+public:
+	SkyShaderProgram(const ci::gl::GlslProgRef &glsl, const SkyShaderPreprocessor::GeneratedRef &generated);
+
+	const ci::gl::GlslProgRef&						getGlslProg() const { return mGlsl; }
+	const SkyShaderPreprocessor::GeneratedRef&		getGenerated() const { return mGenerated; }
+	const std::vector<SkyShaderPreprocessor::Input>&	getInputs() const { return mGenerated->inputs; }
+
+	// resolve once, then set by slot; -1 when the shader does not use the uniform
+	int						findSlot(const std::string &name) const;
+	int						getInputSlot(size_t input) const { return mInputSlots[input]; }
+	// texture unit assigned to an image input, -1 for other inputs
+	int						getInputUnit(size_t input) const { return mInputUnits[input]; }
+
+	void					set(int slot, float value) const { if (slot >= 0) mGlsl->uniform(mLocations[slot], value); }
+	void					set(int slot, int value) const { if (slot >= 0) mGlsl->uniform(mLocations[slot], value); }
+	void					set(int slot, const ci::vec2 &value) const { if (slot >= 0) mGlsl->uniform(mLocations[slot], value); }
+	void					set(int slot, const ci::vec3 &value) const { if (slot >= 0) mGlsl->uniform(mLocations[slot], value); }
+	void					set(int slot, const ci::vec4 &value) const { if (slot >= 0) mGlsl->uniform(mLocations[slot], value); }
+	// ISF DEFAULT values for every non-image input
+	void					applyDefaults() const;
+private:
+	ci::gl::GlslProgRef						mGlsl;
+	SkyShaderPreprocessor::GeneratedRef		mGenerated;
+	std::vector<GLint>						mLocations;		// by slot
+	std::unordered_map<std::string, int>	mSlots;			// by uniform name
+	std::vector<int>						mInputSlots;
+	std::vector<int>						mInputUnits;
+};
+
+class SkyShaderCache {
+public:
+	static SkyShaderCacheRef create(const std::string &preamble, const std::string &vertex) { return SkyShaderCacheRef(new SkyShaderCache(preamble, vertex)); }
+
+	// nullptr if the shader does not compile, failures are remembered and not retried
+	SkyShaderProgramRef				get(const std::string &fragment);
+	const SkyShaderPreprocessorRef&	getPreprocessor() const { return mPreprocessor; }
+	size_t							getNumPrograms() { std::lock_guard<std::mutex> lock(mMutex); return mPrograms.size(); }
+
+	// the steps of get(), callable from any thread so a program can be compiled elsewhere
+	SkyShaderPreprocessor::GeneratedRef	preprocess(const std::string &fragment);
+	ci::gl::GlslProg::Format		getFormat(const SkyShaderPreprocessor::GeneratedRef &generated) const;
+	// true if the source was compiled before, program is nullptr if it failed
+	bool							find(uint64_t hash, SkyShaderProgramRef &program);
+	void							insert(uint64_t hash, const SkyShaderProgramRef &program);
+	// builds the program and logs its compile time, nullptr if it does not compile
+	static SkyShaderProgramRef		compile(const ci::gl::GlslProg::Format &format, const SkyShaderPreprocessor::GeneratedRef &generated);
+private:
+	SkyShaderCache(const std::string &preamble, const std::string &vertex);
+
+	SkyShaderPreprocessorRef		mPreprocessor;
+	std::string						mVertex;
+	std::mutex						mMutex;			// preprocessor and programs
+	std::unordered_map<uint64_t, SkyShaderProgramRef>	mPrograms;
+};
@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ ISF / shadertoy fragment shader preprocessor.
+ The uniform preamble (shadertoy.vd) is split into declarations once.
+ For each shader the ISF JSON header is parsed once, and only the
+ declarations the shader body actually references are emitted, so large
+ preambles do not cost compile time. Results are cached by source hash.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef std::shared_ptr<class SkyShaderPreprocessor> SkyShaderPreprocessorRef;
+
+class SkyShaderPreprocessor {
+public:
+	enum class InputType { IMAGE, FLOAT, BOOL, LONG, POINT2D, COLOR, EVENT, AUDIO };
+	struct Input {
+		std::string			name;
+		InputType			type = InputType::FLOAT;
+		float				value[4] = { 0.0f, 0.0f, 0.0f, 0.0f };	// DEFAULT, or zero
+		bool				referenced = false;
+	};
+	struct Generated {
+		std::string			source;
+		std::vector<Input>	inputs;
+		uint64_t			hash = 0;
+		size_t				emitted = 0;	// preamble declarations kept
+		size_t				skipped = 0;	// preamble declarations left out
+	};
+	typedef std::shared_ptr<const Generated> GeneratedRef;
+
+	static SkyShaderPreprocessorRef create(const std::string &preamble) { return SkyShaderPreprocessorRef(new SkyShaderPreprocessor(preamble)); }
+
+	// cached by the hash of the shader text
+	GeneratedRef			process(const std::string &shader);
+	void					clearCache() { mCache.clear(); }
+	size_t					getCacheSize() const { return mCache.size(); }
+
+	static uint64_t			hash(const std::string &text, uint64_t seed = 14695981039346656037ull);
+	// tolerant of the trailing commas found in hand written ISF headers, returns false if there is no header
+	static bool				parseIsfHeader(const std::string &shader, std::vector<Input> &inputs, size_t &headerEnd);
+private:
+	SkyShaderPreprocessor(const std::string &preamble);
+
+	struct Declaration {
+		Declaration(const std::string &aName, const std::string &aText, bool aEarly) : name(aName), text(aText), early(aEarly) {}
+		std::string			name;
+		std::string			text;
+		bool				early;			// uniforms and outputs go before defines and globals
+	};
+	static void				parseDeclarations(const std::string &text, std::vector<Declaration> &declarations, std::string &version);
+	static void				scanBody(const std::string &body, std::unordered_set<std::string> &identifiers, std::unordered_set<std::string> &declared, std::string &version);
+
+	std::vector<Declaration>	mPreamble;
+	std::vector<Declaration>	mIsfBuiltins;
+	std::string					mVersion;
+	uint64_t					mPreambleHash;
+	std::unordered_map<uint64_t, GeneratedRef>	mCache;
+};
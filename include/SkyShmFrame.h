@@ -0,0 +1,154 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Frame sharing through POSIX shared memory, the stand-in for Spout on
+ platforms without DirectX. A sender owns one segment named after it
+ holding a small header and three frame slots, rows top down. Frames go
+ round the slots, each guarded by its own sequence counter, and the
+ header names the newest complete one. The sender never waits and
+ readers take no lock: a copy is only torn if the sender laps the reader
+ twice while it copies, and the reader then retries on the newer frame.
+ Each slot also stamps its 64x64 tiles with the frame they last changed
+ in, so the sender only writes tiles that changed since the slot was last
+ written and a reader only copies tiles that changed since its last read.
+ */
+
+#pragma once
+
+#include "SkyTileCodec.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef std::shared_ptr<class SkyShmSender> SkyShmSenderRef;
+typedef std::shared_ptr<class SkyShmReader> SkyShmReaderRef;
+typedef std::shared_ptr<class SkyShmRegistry> SkyShmRegistryRef;
+
+struct SkyShmSenderInfo {
+	std::string				name;
+	int						width = 0;
+	int						height = 0;
+};
+
+class SkyShmSegment {
+public:
+	static const int			kNumSlots = 3;
+	struct Slot {
+		std::atomic<uint64_t>	sequence;		// 2 * frame once written, odd while being written
+		std::atomic<uint32_t>	width;
+		std::atomic<uint32_t>	height;
+	};
+	struct Header {
+		uint32_t				magic;
+		uint32_t				version;
+		uint64_t				capacity;		// bytes available for pixels in each slot
+		uint64_t				maxTiles;		// tile stamps available in each slot
+		std::atomic<uint64_t>	latest;			// newest complete frame, it lives in slot latest % kNumSlots
+		std::atomic<uint32_t>	closed;			// set when the sender goes away or outgrows the segment
+		Slot					slots[kNumSlots];
+	};
+	static const uint32_t		kMagic = 0x46594B53;	// "SKYF"
+	static const uint32_t		kVersion = 3;
+
+	~SkyShmSegment();
+	// nullptr on failure, create truncates an existing segment of the same name
+	static std::unique_ptr<SkyShmSegment>	create(const std::string &name, size_t capacity, size_t maxTiles);
+	static std::unique_ptr<SkyShmSegment>	open(const std::string &name);
+	static void				unlink(const std::string &name);
+	// senders currently published in the registry, by name
+	static std::vector<SkyShmSenderInfo>	list();
+
+	Header*					getHeader() const { return (Header *)mData; }
+	uint8_t*				getPixels(int slot) const { return mData + getPixelsOffset(getHeader()->maxTiles) + slot * getHeader()->capacity; }
+	// frame each tile of the slot last changed in
+	uint64_t*				getTileFrames(int slot) const { return (uint64_t *)(mData + getHeaderSize()) + slot * getHeader()->maxTiles; }
+private:
+	SkyShmSegment() {}
+	static std::string		getPath(const std::string &name);
+	// tile stamps follow the header, pixels start on a page so every slot copy is aligned
+	static size_t			getHeaderSize() { return 4096; }
+	static size_t			getPixelsOffset(size_t maxTiles) { return getHeaderSize() + ((kNumSlots * maxTiles * sizeof(uint64_t) + 4095) & ~(size_t)4095); }
+
+	uint8_t					*mData = nullptr;
+	size_t					mSize = 0;
+};
+
+class SkyShmSender {
+public:
+	struct BenchmarkResults {
+		int						width = 0;
+		int						height = 0;
+		int						numReaders = 0;
+		double					writerFps = 0.0;
+		double					writerMaxMs = 0.0;		// longest single send
+		double					readerFps = 0.0;		// mean over the readers
+		double					readerMinFps = 0.0;
+		double					latencyMs = 0.0;		// send start to read complete, mean
+		double					latencyMaxMs = 0.0;
+		uint64_t				torn = 0;
+		double					fullBytesPerFrame = 0.0;
+		double					sentBytesPerFrame = 0.0;	// pixels the sender wrote
+		double					readBytesPerFrame = 0.0;	// pixels a reader copied
+		double					packetBytesPerFrame = 0.0;	// the same frames as compressed tile packets
+	};
+
+	static SkyShmSenderRef	create(const std::string &name) { return SkyShmSenderRef(new SkyShmSender(name)); }
+	~SkyShmSender();
+
+	// rows top down, the segment is replaced when the frame outgrows it; false if another sender has the name
+	bool					send(const uint8_t *rgba, int width, int height);
+	// without tiles every frame is hashed for nothing and copied whole
+	void					setTiled(bool tiled) { mTiled = tiled; }
+	const std::string&		getName() const { return mName; }
+	uint64_t				getNumSent() const { return mSent; }
+	uint64_t				getBytesSent() const { return mBytesSent; }
+
+	// one sender and numReaders readers on their own threads, each with its own mapping; targetFps 0 sends as fast as it can.
+	// the frames are a block moving over black, the case tiles are made for
+	static BenchmarkResults	benchmark(int width, int height, int numReaders, double seconds, double targetFps = 0.0, bool tiled = true);
+private:
+	SkyShmSender(const std::string &name) : mName(name) {}
+
+	std::string				mName;
+	std::unique_ptr<SkyShmSegment>	mSegment;
+	SkyShmRegistryRef		mRegistry;		// set once the name is registered
+	int						mWidth = 0;
+	int						mHeight = 0;
+	bool					mTiled = true;
+	SkyTileEncoder			mTiles;
+	std::vector<uint64_t>	mTileFrames;	// frame each tile last changed in
+	uint64_t				mSent = 0;
+	uint64_t				mBytesSent = 0;
+};
+
+class SkyShmReader {
+public:
+	// nullptr if no sender of that name is published
+	static SkyShmReaderRef	open(const std::string &name);
+
+	// copies the newest complete frame if it is newer than the last one read.
+	// only changed tiles are copied when rgba is the same vector as last time
+	bool					read(std::vector<uint8_t> &rgba, int &width, int &height);
+	// frame number of the last frame read, frames are numbered from 1
+	uint64_t				getLastFrame() const { return mLastFrame; }
+	// the sender closed or replaced its segment, open the name again
+	bool					isClosed() const;
+	const std::string&		getName() const { return mName; }
+	uint64_t				getNumTorn() const { return mTorn; }
+	uint64_t				getBytesRead() const { return mBytesRead; }
+private:
+	SkyShmReader(const std::string &name, std::unique_ptr<SkyShmSegment> segment);
+
+	std::string				mName;
+	std::unique_ptr<SkyShmSegment>	mSegment;
+	uint64_t				mLastFrame = 0;
+	const uint8_t			*mLastData = nullptr;	// the buffer that holds mLastFrame
+	int						mWidth = 0;
+	int						mHeight = 0;
+	uint64_t				mTorn = 0;
+	uint64_t				mBytesRead = 0;
+};
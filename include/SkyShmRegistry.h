@@ -0,0 +1,81 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Registry of shared memory senders, itself a fixed layout shared memory
+ table. Slots are open addressed by the hash of the sender name and
+ claimed, published and released with compare and swap on one state word
+ per slot, so lookups take no lock and touch a slot or two whatever the
+ number of senders. Entries of processes that died are reclaimed by the
+ next reader that notices. Released slots become tombstones, and a run of
+ tombstones that ends at an empty slot is emptied again from its end, so
+ misses stay short after heavy churn.
+ */
+
+#pragma once
+
+#include "SkyShmFrame.h"
+
+typedef std::shared_ptr<class SkyShmRegistry> SkyShmRegistryRef;
+
+class SkyShmRegistry {
+public:
+	static const uint32_t		kCapacity = 1024;		// power of two
+	static const size_t			kMaxNameLength = 63;
+
+	// the registry of this user, created by the first process that needs it; nullptr if shared memory is unavailable
+	static SkyShmRegistryRef	get();
+	~SkyShmRegistry();
+
+	// false when the name is taken, too long or the table is full
+	bool						add(const std::string &name, int width, int height);
+	bool						remove(const std::string &name);
+	bool						update(const std::string &name, int width, int height);
+	bool						find(const std::string &name, SkyShmSenderInfo *info = nullptr) const;
+	std::vector<SkyShmSenderInfo>	list() const;
+	uint32_t					getCount() const;
+
+	static uint32_t				hash(const std::string &name);
+
+	struct StressResults {
+		int						processes = 0;
+		int						failed = 0;				// processes that got a wrong answer for a name only they use
+		int						rounds = 0;
+		int						contended = 0;			// rounds where other than one process won the same name
+		uint32_t				leaked = 0;				// entries left once every process exited and a dead one was reclaimed
+		uint32_t				tombstones = 0;			// left behind, each one lengthens the misses probing through it
+		double					seconds = 0.0;
+	};
+	// forks processes that add, find and remove senders at once, half of them over shared names; POSIX only,
+	// on a registry of its own that is unlinked afterwards
+	static StressResults		stress(int processes = 256, int operations = 200, int rounds = 50);
+private:
+	struct Slot {
+		std::atomic<uint64_t>	state;		// hash << 32 | generation << 2 | kind
+		std::atomic<uint32_t>	width;
+		std::atomic<uint32_t>	height;
+		std::atomic<int32_t>	pid;
+		char					name[kMaxNameLength + 1];
+	};
+	struct Header {
+		std::atomic<uint32_t>	magic;		// written last, once the table is initialized
+		uint32_t				version;
+		uint32_t				capacity;
+		std::atomic<uint32_t>	count;
+		Slot					slots[kCapacity];
+	};
+	enum Kind : uint64_t { EMPTY = 0, WRITING = 1, LIVE = 2, TOMBSTONE = 3 };
+
+	SkyShmRegistry(Header *header) : mHeader(header) {}
+	// maps the registry at the shared memory path, creating it if needed
+	static SkyShmRegistryRef	open(const std::string &path);
+	// index of the live slot holding name, or -1
+	int							findSlot(const std::string &name, uint32_t nameHash) const;
+	bool						isStale(Slot &slot, uint64_t state) const;
+	// empties the run of tombstones from index on if it ends at an empty slot
+	void						reclaim(uint32_t index) const;
+	// an empty slot reserved by reclaim(), waited for by adds; returns the state once it is released
+	uint64_t					waitReserved(Slot &slot, uint64_t state) const;
+
+	Header						*mHeader;
+};
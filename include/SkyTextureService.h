@@ -0,0 +1,108 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Asynchronous still image loader.
+ Images are decoded on a pool of worker threads, uploaded a few rows at a
+ time from update() so no single frame pays for a whole image, and kept
+ in an LRU cache bounded by a texture memory budget.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/Surface.h"
+#include "cinder/Filesystem.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+typedef std::shared_ptr<class SkyTextureService> SkyTextureServiceRef;
+
+class SkyTextureService {
+public:
+	struct Format {
+		Format() {}
+		Format&		budgetMegabytes(size_t megabytes) { mBudgetBytes = megabytes << 20; return *this; }
+		Format&		uploadKilobytesPerFrame(size_t kilobytes) { mUploadBytesPerFrame = kilobytes << 10; return *this; }
+		Format&		numThreads(size_t threads) { mNumThreads = threads; return *this; }
+		Format&		mipmap(bool enable = true) { mMipmap = enable; return *this; }
+
+		size_t		mBudgetBytes = 512 << 20;
+		size_t		mUploadBytesPerFrame = 8 << 20;
+		size_t		mNumThreads = 0;	// 0 picks half the hardware threads
+		bool		mMipmap = false;
+	};
+	struct Stats {
+		uint64_t	hits = 0;
+		uint64_t	misses = 0;
+		uint64_t	decoded = 0;
+		uint64_t	failed = 0;
+		uint64_t	evictions = 0;
+		uint64_t	evictedBytes = 0;
+		size_t		residentBytes = 0;
+		size_t		residentCount = 0;
+		size_t		pendingCount = 0;
+	};
+
+	static SkyTextureServiceRef create(const Format &format = Format()) { return SkyTextureServiceRef(new SkyTextureService(format)); }
+	~SkyTextureService();
+
+	// render thread: the texture when fully resident, otherwise nullptr and the image is queued
+	ci::gl::Texture2dRef	fetch(const ci::fs::path &path);
+	// queues an image without counting a hit or a miss, used to warm the cache ahead of a cue
+	void					prefetch(const ci::fs::path &path);
+	// render thread, once per frame: hands decoded images to the uploader and uploads the next slice
+	void					update();
+	// render thread: makes a texture uploaded elsewhere resident under path, evicting as needed
+	void					insert(const ci::fs::path &path, const ci::gl::Texture2dRef &texture);
+	// the format every resident texture is created with
+	ci::gl::Texture2d::Format	getTextureFormat() const;
+
+	void					setBudgetMegabytes(size_t megabytes);
+	size_t					getBudgetBytes() const { return mFormat.mBudgetBytes; }
+	const Stats&			getStats() const { return mStats; }
+private:
+	SkyTextureService(const Format &format);
+
+	enum class State { DECODING, DECODED, UPLOADING, RESIDENT, FAILED };
+	struct Job {
+		ci::fs::path		path;
+		ci::Surface8uRef	surface;
+	};
+	typedef std::shared_ptr<Job> JobRef;
+	struct Entry {
+		State							state = State::DECODING;
+		ci::Surface8uRef				surface;
+		ci::gl::Texture2dRef			texture;
+		int								uploadedRows = 0;
+		size_t							bytes = 0;
+		std::list<std::string>::iterator	lru;
+	};
+
+	void					enqueue(const std::string &key, const ci::fs::path &path);
+	void					workerFn();
+	bool					uploadSlice(Entry &entry, size_t &budget);
+	void					evictFor(size_t bytes, const std::string &keep);
+	void					touch(Entry &entry);
+
+	Format					mFormat;
+	Stats					mStats;
+
+	// render thread only
+	std::unordered_map<std::string, Entry>	mEntries;
+	std::list<std::string>	mLru;			// most recently used first
+	std::deque<std::string>	mUploadQueue;
+
+	// shared with the workers
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	std::deque<JobRef>		mJobs;
+	std::deque<JobRef>		mFinished;
+	bool					mRunning = true;
+	std::vector<std::thread>	mThreads;
+};
@@ -0,0 +1,95 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Dirty tile delta coding of RGBA frames.
+ The encoder hashes every 64x64 tile with SSE2 and keeps the hashes of
+ the previous frame, so a packet only carries a bitmap of the changed
+ tiles and their pixels, optionally squeezed by a small LZ77 coder of the
+ LZ4 family. The decoder keeps the full frame and patches it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class SkyTileCodec {
+public:
+	static const int			kTileSize = 64;
+	struct PacketHeader {
+		uint32_t				magic;
+		uint32_t				width;
+		uint32_t				height;
+		uint32_t				frame;
+		uint32_t				flags;
+		uint32_t				numTiles;			// tiles in the frame, the bitmap has one bit each
+		uint32_t				rawBytes;			// pixels of the changed tiles
+		uint32_t				payloadBytes;		// as stored after the bitmap
+	};
+	static const uint32_t		kMagic = 0x54594B53;	// "SKYT"
+	static const uint32_t		KEYFRAME = 1;
+	static const uint32_t		COMPRESSED = 2;
+	// larger frames come from a damaged or hostile packet
+	static const int			kMaxDimension = 8192;
+
+	static int					getNumColumns(int width) { return (width + kTileSize - 1) / kTileSize; }
+	static int					getNumRows(int height) { return (height + kTileSize - 1) / kTileSize; }
+	static size_t				getTileBytes(int width, int height, int tile);
+	static uint64_t				hashTile(const uint8_t *rgba, size_t rowBytes, int width, int height);
+	// copies tile from src to dst, both frames of the given size
+	static void					copyTile(uint8_t *dst, const uint8_t *src, int width, int height, int tile);
+
+	// appends the compressed bytes to dst
+	static void					compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst);
+	// false unless src decodes to exactly size bytes
+	static bool					decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t size);
+};
+
+class SkyTileEncoder {
+public:
+	struct Stats {
+		uint64_t				frames = 0;
+		uint64_t				fullBytes = 0;		// what copying whole frames would have cost
+		uint64_t				rawBytes = 0;		// bitmap and changed tiles
+		uint64_t				packetBytes = 0;	// as sent, after compression
+	};
+
+	// hashes the frame and marks the tiles that differ from the previous one, returns how many
+	int							diff(const uint8_t *rgba, int width, int height);
+	bool						isDirty(int tile) const { return mDirty[tile] != 0; }
+	// diff, then the packet replaces the contents of packet
+	void						encode(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &packet, bool compress);
+	// the next packet carries every tile, for a receiver that joined late or lost a packet
+	void						requestKeyframe() { mKeyframe = true; }
+
+	const Stats&				getStats() const { return mStats; }
+private:
+	std::vector<uint64_t>		mHashes;
+	std::vector<uint8_t>		mDirty;
+	std::vector<uint8_t>		mRaw;
+	int							mWidth = 0;
+	int							mHeight = 0;
+	uint32_t					mFrame = 0;
+	bool						mKeyframe = true;
+	Stats						mStats;
+};
+
+class SkyTileDecoder {
+public:
+	// false for a delta that does not follow a keyframe of the same size, a damaged packet or one over kMaxDimension
+	bool						decode(const uint8_t *packet, size_t size);
+	const std::vector<uint8_t>&	getPixels() const { return mPixels; }
+	int							getWidth() const { return mWidth; }
+	int							getHeight() const { return mHeight; }
+	uint32_t					getFrame() const { return mFrame; }
+private:
+	std::vector<uint8_t>		mPixels;
+	std::vector<uint8_t>		mRaw;
+	int							mWidth = 0;
+	int							mHeight = 0;
+	uint32_t					mFrame = 0;
+	bool						mValid = false;
+};
@@ -0,0 +1,67 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Cached ImGui layer.
+ The UI is laid out and rendered into a texture only when it can have
+ changed: for a few frames after input on its window, when the data it
+ shows changes, at most maxRate times a second, and at idleRate so
+ animated widgets keep moving. The other frames submit no ImGui window at
+ all and the cached texture is composited over the window instead. The
+ ImGui block renders in the window's post draw signal, so the cache binds
+ its framebuffer just before that and composites just after.
+ */
+
+#pragma once
+
+#include "cinder/app/Window.h"
+#include "cinder/gl/gl.h"
+#include "cinder/Signals.h"
+
+typedef std::shared_ptr<class SkyUiCache> SkyUiCacheRef;
+
+class SkyUiCache {
+public:
+	struct Format {
+		Format() {}
+		Format&		maxRate(float rate) { mMaxRate = rate; return *this; }
+		Format&		idleRate(float rate) { mIdleRate = rate; return *this; }
+		Format&		inputFrames(int frames) { mInputFrames = frames; return *this; }
+
+		float		mMaxRate = 20.0f;		// redraws per second when only the data changes
+		float		mIdleRate = 2.0f;
+		int			mInputFrames = 4;		// ImGui resolves hover and clicks over a few frames
+	};
+	struct Stats {
+		uint64_t	frames = 0;
+		uint64_t	redraws = 0;
+		double		lastBuildMs = 0.0;		// layout and render of the last redraw, CPU side
+	};
+
+	static SkyUiCacheRef	create(const ci::app::WindowRef &window, const Format &format = Format()) { return SkyUiCacheRef(new SkyUiCache(window, format)); }
+
+	// in the window's draw, true if the UI is to be built this frame; dataVersion changes whenever the shown data does
+	bool					beginFrame(uint64_t dataVersion);
+	// redraw on the next frames
+	void					invalidate() { mInputFrames = mFormat.mInputFrames; }
+
+	const ci::app::WindowRef&	getWindow() const { return mWindow; }
+	const Stats&			getStats() const { return mStats; }
+private:
+	SkyUiCache(const ci::app::WindowRef &window, const Format &format);
+
+	void					preRender();
+	void					postRender();
+
+	Format					mFormat;
+	ci::app::WindowRef		mWindow;
+	std::vector<ci::signals::ScopedConnection>	mConnections;
+	ci::gl::FboRef			mFbo;
+	bool					mShown = false;		// beginFrame() was called this frame
+	bool					mRedraw = false;
+	int						mInputFrames = 0;
+	uint64_t				mVersion = 0;
+	double					mLastRedraw = -1.0;
+	double					mBuildStart = 0.0;
+	Stats					mStats;
+};
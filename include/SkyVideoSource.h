@@ -0,0 +1,94 @@
+/*
+ Copyright (c) 2013-2022, Bruce Lane - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Raw Y4M video source.
+ A worker thread reads frames straight into mapped pixel unpack buffers,
+ the render thread only unmaps the due frame, starts the asynchronous
+ upload of the Y, U and V planes and converts to RGB in a shader.
+ Playback follows the time passed to update(), stale frames are dropped.
+ */
+
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/Filesystem.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+typedef std::shared_ptr<class SkyVideoSource> SkyVideoSourceRef;
+
+class SkyVideoSource {
+public:
+	// returns nullptr if the file cannot be opened or is not a supported Y4M stream
+	static SkyVideoSourceRef create(const ci::fs::path &path, size_t numSlots = 4);
+	~SkyVideoSource();
+
+	// render thread, time in seconds on the render clock
+	void						update(double time);
+	// RGB output, valid once the first frame has been shown
+	const ci::gl::Texture2dRef&	getTexture() const { return mTexture; }
+
+	ci::ivec2					getSize() const { return ci::ivec2(mWidth, mHeight); }
+	float						getFps() const { return mFps; }
+	const ci::fs::path&			getPath() const { return mPath; }
+	uint64_t					getNumShown() const { return mShown; }
+	uint64_t					getNumDropped() const { return mDropped; }
+	uint64_t					getNumLate() const { return mLate; }
+private:
+	enum class Chroma { C420, C422, C444, MONO };
+	struct Slot {
+		ci::gl::PboRef			pbo;
+		uint8_t					*data = nullptr;	// mapped while owned by the decoder
+		int64_t					frame = -1;
+		ci::gl::SyncRef			fence;
+	};
+
+	SkyVideoSource(const ci::fs::path &path);
+	bool						open();
+	bool						parseHeader(const std::string &header);
+	void						allocate(size_t numSlots);
+	void						decodeThreadFn();
+	bool						readFrame(uint8_t *dst);
+	void						mapSlot(size_t index);
+	void						upload(Slot &slot);
+	void						convert();
+
+	ci::fs::path				mPath;
+	std::ifstream				mStream;
+	std::streamoff				mFirstFrame = 0;
+	int							mWidth = 0, mHeight = 0;
+	int							mChromaWidth = 0, mChromaHeight = 0;
+	Chroma						mChroma = Chroma::C420;
+	bool						mFullRange = false;
+	float						mFps = 25.0f;
+	size_t						mLumaBytes = 0, mChromaBytes = 0, mFrameBytes = 0;
+
+	std::vector<Slot>			mSlots;
+	// decoder side, guarded by mMutex
+	std::mutex					mMutex;
+	std::condition_variable		mCondition;
+	std::deque<size_t>			mFreeSlots;
+	std::deque<size_t>			mReadySlots;
+	bool						mRunning = false;
+	int64_t						mDecoded = 0;
+	std::thread					mThread;
+	// render side
+	std::vector<size_t>			mFencedSlots;
+	double						mStartTime = -1.0;
+	int64_t						mCurrentFrame = -1;
+	uint64_t					mShown = 0, mDropped = 0, mLate = 0;
+
+	ci::gl::Texture2dRef		mTexY, mTexU, mTexV;
+	ci::gl::FboRef				mFbo;
+	ci::gl::Texture2dRef		mTexture;
+	ci::gl::GlslProgRef			mYuvShader;
+	ci::mat3					mYuvToRgb;
+	ci::vec3					mYuvOffset;
+};
@@ -21,6 +21,12 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/audio/audio.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 
 // Animation
 #include "VDAnimation.h"
@@ -34,15 +40,71 @@
 #include "VDParams.h"
 // Mix
 #include "VDMix.h"
+// Tempo
+#include "SkyBeatTrackerNode.h"
+// Video
+#include "SkyVideoSource.h"
+// Stills
+#include "SkyTextureService.h"
+// ISF
+#include "SkyShaderCache.h"
+// Autosave
+#include "SkyJournal.h"
+// Anti-aliasing
+#include "SkyAntiAlias.h"
+// Dynamic resolution
+#include "SkyDynamicResolution.h"
+// Pipeline statistics
+#include "SkyPipelineStats.h"
+// Crowd
+#include "SkyCrowd.h"
+// Recorder
+#include "SkyRecorder.h"
+// Shared frame input
+#include "SkyFrameReceiver.h"
+#include "SkyShmFrame.h"
+#include "SkyShmRegistry.h"
+// Network output
+#include "SkyNetOutput.h"
+// Procedural meshes
+#include "SkyMeshStream.h"
+// Background GPU uploads
+#include "SkyGpuUploader.h"
+// Dropped files
+#include "SkyDropIngest.h"
+// Automation
+#include "SkyAutomation.h"
+// MIDI control
+#include "SkyMidi.h"
+// OSC control
+#include "SkyOscReceiver.h"
 
 // UI
 #define IMGUI_DISABLE_OBSOLETE_FUNCTIONS 1
 #include "VDUI.h"
+#include "SkyUiCache.h"
 #define IM_ARRAYSIZE(_ARR)			((int)(sizeof(_ARR)/sizeof(*_ARR)))
 using namespace ci;
 using namespace ci::app;
 using namespace videodromm;
 
+// keys of the values kept in the autosave journal
+enum SkyJournalKey : uint32_t {
+	JOURNAL_TESS_INNER = 1,
+	JOURNAL_TESS_OUTER,
+	JOURNAL_MESH,
+	// VDUniforms index is added to this one
+	JOURNAL_UNIFORM = 0x1000
+};
+
+// slots of the OSC routes, below OSC_UNIFORMS a slot is a VDUniforms index
+enum SkyOscSlot : int {
+	OSC_UNIFORMS = 128,
+	OSC_TESS_INNER = 1000,
+	OSC_TESS_OUTER,
+	OSC_MESH
+};
+
 class BatchassSkyApp : public App {
 public:
 	BatchassSkyApp();
@@ -90,9 +152,146 @@ private:
 
 	gl::BatchRef				mBatch;
 	float						mInnerLevel, mOuterLevel;
+	// scene shaders with and without the geometry stage, [0] without
+	gl::GlslProgRef				createSceneShader(bool crowd, bool geometryStage, bool displace = false);
+	gl::GlslProgRef				mSceneShaders[2];
+	gl::GlslProgRef				mCrowdShaders[2];
+	bool						mGeometryStage = true;
+	void						setGeometryStage(bool enabled);
+	void						benchmarkGeometryStage();
 	// fbo
-	void						renderSceneToFbo();
+	void						renderSceneToFbo(const gl::FboRef &fbo, const ivec2 &size, double time);
+	void						setSceneUniforms(const gl::GlslProgRef &shader);
+	// every fixed mesh at every tessellation level and output size, offscreen, saved as CSV next to the journal
+	void						benchmarkScene();
+	// displacement, a tessellated grid lifted by the video instead of the ray-marched height field of fx.glsl
+	gl::BatchRef				mDisplaceBatch;
+	bool						mDisplaceMode = false;
+	float						mDisplaceHeight = 0.25f;
+	gl::Texture2dRef			getHeightMap() const;
+	void						drawDisplacement(const gl::Texture2dRef &heightMap, const ivec2 &size);
+	void						benchmarkDisplacement();
 	gl::FboRef					mRenderFbo;
+	// anti-aliasing, mRenderFbo is the scene target of the current mode
+	SkyAntiAliasRef				mAntiAlias;
+	gl::Texture2dRef			mSceneTexture;
+	void						cycleAntiAlias();
+	void						benchmarkAntiAlias();
+	// dynamic resolution, renders into a corner of mRenderFbo and upscales
+	SkyDynamicResolutionRef		mDynamicResolution;
+	// pipeline statistics of the scene draw of the window, shown next to the tessellation levels and logged with the frame timings
+	SkyPipelineStatsRef			mPipelineStats;
+	bool						mCountPipeline = false;
+	double						mPipelineLogTime = 0.0;
+	void						logPipelineStats();
+	void						drawScenePanel();
+	// tempo
+	void						setupBeatTracker();
+	void						analyzeBpm(const fs::path &path, float expectedBpm, float toleranceBpm);
+	audio::InputDeviceNodeRef	mBeatInput;
+	SkyBeatTrackerNodeRef		mBeatTrackerNode;
+	float						mBeatPhase = 0.0f;
+	float						mBeatPulse = 0.0f;
+	bool						mBeatLocked = false;
+	// automation cue, its beats advance with IBPM and follow the tracker phase once locked
+	SkyAutomationRef			mAutomation;
+	double						mAutomationBeat = 0.0;
+	double						mAutomationTime = 0.0;
+	void						playAutomation(const SkyAutomationRef &automation);
+	void						updateAutomation();
+	void						benchmarkAutomation();
+	// MIDI control changes mapped to uniforms, the mappings are saved whenever they change
+	SkyMidiMapperRef			mMidi;
+	fs::path					mMidiPath;
+	double						mMidiTime = 0.0;
+	double						mMidiLogTime = 0.0;
+	int							mMidiLearnTarget = 0;
+	float						mMidiLearnMin = 0.0f;
+	float						mMidiLearnMax = 1.0f;
+	void						updateMidi();
+	void						drawMidiPanel();
+	// UI, cached in a texture and redrawn on input, data change or at a capped rate, in the output window or an operator window
+	SkyUiCacheRef				mUiCache;
+	app::WindowRef				mOperatorWindow;
+	void						drawUi();
+	uint64_t					getUiVersion();
+	void						drawOperator();
+	// OSC, /sky/uniform/<index> sets uniforms, the app's own parameters have the slots OSC_TESS_INNER, OSC_TESS_OUTER and OSC_MESH
+	SkyOscReceiverRef			mOsc;
+	uint16_t					mOscPort = 7000;
+	double						mOscLogTime = 0.0;
+	void						startOsc();
+	void						updateOsc();
+	void						benchmarkOsc();
+	int							mLoggedBpm = 0;
+	// video
+	std::vector<SkyVideoSourceRef>	mVideoSources;
+	void						drawBackground(const ivec2 &size);
+	// stills
+	SkyTextureServiceRef		mTextureService;
+	std::vector<fs::path>		mStills;
+	size_t						mStillIndex = 0;
+	gl::Texture2dRef			mStillTexture;
+	void						showStill(size_t index);
+	// ISF
+	SkyShaderCacheRef			mShaderCache;
+	SkyShaderProgramRef			mIsfProgram;
+	int							mIsfRenderSizeSlot = -1;
+	int							mIsfTimeSlot = -1;
+	void						setIsfProgram(const SkyShaderProgramRef &program);
+	// dropped files load in the background and are activated by update() once complete
+	SkyDropIngestRef			mIngest;
+	void						activateDrop(const SkyDropIngest::ItemRef &item);
+	void						drawIngestProgress();
+	// crowd, instances of the current mesh drawn by the CROWD variant of the shaders
+	gl::BatchRef				mCrowdBatch;
+	SkyCrowdRef					mCrowd;
+	bool						mCrowdMode = false;
+	void						toggleCrowd();
+	void						benchmarkCrowd();
+	// recorder, captures the scene texture every frame
+	SkyRecorderRef				mRecorder;
+	void						toggleRecording(bool pngSequence);
+	// frames shared by other applications, drawn behind the scene
+	SkyFrameReceiverRef			mFrameReceiver;
+	gl::Texture2dRef			mReceivedTexture;
+	void						benchmarkShm();
+	void						stressShmRegistry();
+	// network stream of the scene texture, and the receiving end for a preview station
+	SkyNetOutputRef				mNetOutput;
+	std::string					mNetHost = "127.0.0.1";
+	uint16_t					mNetPort = 9123;
+	SkyNetStream::Protocol		mNetProtocol = SkyNetStream::Protocol::TCP;
+	SkyNetReceiverRef			mNetReceiver;
+	gl::Texture2dRef			mNetTexture;
+	std::vector<uint8_t>		mNetPixels;
+	double						mNetLogTime = 0.0;
+	bool						parseNetAddress(const std::string &address);
+	void						toggleNetOutput();
+	void						updateNetReceiver();
+	void						benchmarkNet();
+	// mesh, 1 to 7 are fixed meshes, 8 to 10 are regenerated every frame by mMeshStream
+	int							mMeshIndex = 7;
+	int							mMeshRequest = 7;		// the last fixed mesh asked for, older uploads are dropped
+	void						setMesh(int index);
+	SkyMeshStreamRef			mMeshStream;
+	bool						mMeshStreaming = false;
+	SkyMeshStream::Shape		mStreamShape = SkyMeshStream::Shape::TORUS_KNOT;
+	double						mMeshLogTime = 0.0;
+	void						updateMeshStream();
+	// shader variants and fixed meshes are built off the render thread
+	SkyGpuUploaderRef			mUploader;
+	// autosave
+	SkyJournalRef				mJournal;
+	std::vector<int>			mJournaledUniforms;
+	bool						mSessionDirty = false;
+	double						mLastEditTime = 0.0;
+	void						restoreJournal();
+	void						updateJournal();
+	void						markSessionDirty();
+	void						saveSession();
+	// command line checks, non-zero once one of them failed
+	int							mExitCode = 0;
 };
 
 
@@ -126,18 +325,30 @@ BatchassSkyApp::BatchassSkyApp() : mSpoutOut("Sky", app::getWindowSize())
 	mFadeInDelay = true;
 
 	// SKY
-	// create a batch with our tesselation shader
-	auto format = gl::GlslProg::Format()
-		.vertex(loadAsset("shader.vert"))
-		.fragment(loadAsset("shader.frag"))
-		.geometry(loadAsset("shader.geom"))
-		.tessellationCtrl(loadAsset("shader.cont"))
-		.tessellationEval(loadAsset("shader.eval"));
-	auto shader = gl::GlslProg::create(format);
-	mBatch = gl::Batch::create(geom::TorusKnot(), shader);
+	// create a batch with our tesselation shader, the first frame needs it
+	mSceneShaders[1] = createSceneShader(false, true);
+	mBatch = gl::Batch::create(geom::TorusKnot(), mSceneShaders[1]);
+	// the other variants compile on the upload thread, a failed build leaves its mode unavailable
+	mUploader = SkyGpuUploader::create();
+	mUploader->submit("geometry stage off shader", [this] { return createSceneShader(false, false); }, [this](const gl::GlslProgRef &glsl) {
+		mSceneShaders[0] = glsl;
+	});
+	// the same stages with per instance transforms, needs shader storage buffers
+	mUploader->submit("crowd shaders", [this] { return std::make_pair(createSceneShader(true, true), createSceneShader(true, false)); },
+		[this](const std::pair<gl::GlslProgRef, gl::GlslProgRef> &glsl) {
+		mCrowdShaders[1] = glsl.first;
+		mCrowdShaders[0] = glsl.second;
+		mCrowdBatch = gl::Batch::create(mBatch->getVboMesh(), mCrowdShaders[mGeometryStage]);
+	});
+	// a coarse grid, the tessellator supplies the detail
+	mUploader->submit("displacement", [this] { return std::make_pair(createSceneShader(false, false, true), gl::VboMesh::create(geom::Plane().size(vec2(2.0f)).subdivisions(ivec2(16)))); },
+		[this](const std::pair<gl::GlslProgRef, gl::VboMeshRef> &built) {
+		mDisplaceBatch = gl::Batch::create(built.second, built.first);
+	});
 
 	mInnerLevel = 1.0f;
 	mOuterLevel = 1.0f;
+	restoreJournal();
 
 	gl::enableDepthWrite();
 	gl::enableDepthRead();
@@ -145,13 +356,639 @@ BatchassSkyApp::BatchassSkyApp() : mSpoutOut("Sky", app::getWindowSize())
 
 	// warping
 	mUseBeginEnd = false;
-	// render fbo
-	gl::Fbo::Format fboFormat;
-	//format.setSamples( 4 ); // uncomment this to enable 4x antialiasing
-	mRenderFbo = gl::Fbo::create(mVDSettings->mRenderWidth, mVDSettings->mRenderHeight, fboFormat.colorTexture());
+	// render fbo, multisampled and resolved once per frame rather than a multisampled window
+	mAntiAlias = SkyAntiAlias::create(ivec2(mVDSettings->mRenderWidth, mVDSettings->mRenderHeight), SkyAntiAlias::Mode::MSAA, 4);
+	mRenderFbo = mAntiAlias->getSceneFbo();
+	mDynamicResolution = SkyDynamicResolution::create(mRenderFbo->getSize());
+	mPipelineStats = SkyPipelineStats::create();
 
 	// UI
 	mVDUI = VDUI::create(mVDSettings, mVDSessionFacade, mVDUniforms);
+	// with --operator-window the output window never lays out or draws the UI
+	const auto &uiArgs = getCommandLineArgs();
+	if (std::find(uiArgs.begin(), uiArgs.end(), "--operator-window") != uiArgs.end()) {
+		mOperatorWindow = createWindow(Window::Format().size(960, 720).title("Sky operator"));
+	}
+	mUiCache = SkyUiCache::create(mOperatorWindow ? mOperatorWindow : getWindow());
+	// stills
+	mTextureService = SkyTextureService::create();
+	// ISF
+	mShaderCache = SkyShaderCache::create(loadString(loadAsset("shadertoy.vd")), loadString(loadAsset("passthrough.vs")));
+	// dropped images become resident stills, in the same format the service uses
+	mIngest = SkyDropIngest::create(mUploader, mShaderCache, SkyDropIngest::Format().textureFormat(mTextureService->getTextureFormat()));
+
+	// MIDI
+	mMidi = SkyMidiMapper::create();
+	mMidiPath = getDocumentsDirectory() / "BatchassSky" / "midi.json";
+	if (mMidi->load(mMidiPath)) CI_LOG_I("restored " << mMidi->getMappings().size() << " MIDI mappings");
+
+	// tempo, IBPM keeps its default until the tracker locks
+	const auto &args = getCommandLineArgs();
+	for (size_t i = 0; i + 1 < args.size(); i++) {
+		if (args[i] == "--analyze-bpm") {
+			// offline check against a file of known tempo: --analyze-bpm file.wav 128 [tolerance]
+			const float expectedBpm = i + 2 < args.size() ? (float)atof(args[i + 2].c_str()) : 0.0f;
+			const float toleranceBpm = i + 3 < args.size() ? (float)atof(args[i + 3].c_str()) : 0.0f;
+			analyzeBpm(args[i + 1], expectedBpm, toleranceBpm > 0.0f ? toleranceBpm : 1.0f);
+			quit();
+			return;
+		}
+		if (args[i] == "--net-output" && parseNetAddress(args[i + 1])) {
+			toggleNetOutput();
+		}
+		if (args[i] == "--net-receive" && parseNetAddress(args[i + 1])) {
+			// preview station: the stream is drawn behind the scene and its stats logged every second
+			mNetReceiver = SkyNetReceiver::create(mNetPort, mNetProtocol);
+			if (!mNetReceiver) CI_LOG_E("cannot listen on port " << mNetPort);
+		}
+		if (args[i] == "--automation") {
+			auto automation = SkyAutomation::load(args[i + 1]);
+			if (automation) playAutomation(automation);
+			else CI_LOG_E("cannot load automation cue " << args[i + 1]);
+		}
+		if (args[i] == "--midi-in") {
+			auto device = SkyMidiDevice::open(args[i + 1]);
+			if (device) mMidi->addSource(device);
+			else CI_LOG_E("no MIDI input " << args[i + 1]);
+		}
+		if (args[i] == "--osc-port") {
+			mOscPort = (uint16_t)atoi(args[i + 1].c_str());
+		}
+		if (args[i] == "--midi-replay") {
+			// stand-in for a controller, for headless runs
+			auto replay = SkyMidiReplay::create(args[i + 1]);
+			if (replay) mMidi->addSource(replay);
+			else CI_LOG_E("no MIDI messages in " << args[i + 1]);
+		}
+	}
+	if (mMidi->getSources().empty()) {
+		for (const auto &port : SkyMidiDevice::listPorts()) {
+			auto device = SkyMidiDevice::open(port);
+			if (device) mMidi->addSource(device);
+		}
+	}
+	mMidiTime = getElapsedSeconds();
+	for (const auto &arg : args) {
+		if (arg == "--aa-benchmark") {
+			benchmarkAntiAlias();
+			quit();
+			return;
+		}
+		if (arg == "--crowd-benchmark") {
+			benchmarkCrowd();
+			quit();
+			return;
+		}
+		if (arg == "--geometry-benchmark") {
+			benchmarkGeometryStage();
+			quit();
+			return;
+		}
+		if (arg == "--shm-benchmark") {
+			benchmarkShm();
+			quit();
+			return;
+		}
+		if (arg == "--shm-registry-stress") {
+			stressShmRegistry();
+			quit();
+			return;
+		}
+		if (arg == "--net-benchmark") {
+			benchmarkNet();
+			quit();
+			return;
+		}
+		if (arg == "--automation-benchmark") {
+			benchmarkAutomation();
+			quit();
+			return;
+		}
+		if (arg == "--displace-benchmark") {
+			benchmarkDisplacement();
+			quit();
+			return;
+		}
+		if (arg == "--scene-benchmark") {
+			benchmarkScene();
+			quit();
+			return;
+		}
+		if (arg == "--osc-benchmark") {
+			benchmarkOsc();
+			quit();
+			return;
+		}
+	}
+	startOsc();
+	setupBeatTracker();
+}
+
+void BatchassSkyApp::restoreJournal()
+{
+	fs::path folder = getDocumentsDirectory() / "BatchassSky";
+	fs::create_directories(folder);
+	mJournal = SkyJournal::create((folder / "state").string());
+	mJournaledUniforms = { mVDUniforms->ICOLORX, mVDUniforms->ICOLORY, mVDUniforms->IALPHA, mVDUniforms->IMOUSEX, mVDUniforms->IMOUSEY };
+
+	float value;
+	if (mJournal->get(JOURNAL_TESS_INNER, value)) mInnerLevel = value;
+	if (mJournal->get(JOURNAL_TESS_OUTER, value)) mOuterLevel = value;
+	if (mJournal->get(JOURNAL_MESH, value)) setMesh((int)value);
+	for (int index : mJournaledUniforms) {
+		if (mJournal->get(JOURNAL_UNIFORM + index, value)) mVDSessionFacade->setUniformValue(index, value);
+	}
+	CI_LOG_I("restored " << mJournal->getValues().size() << " values from the journal");
+}
+
+void BatchassSkyApp::updateJournal()
+{
+	// record() only queues values that changed, the journal thread does the writing
+	mJournal->record(JOURNAL_TESS_INNER, mInnerLevel);
+	mJournal->record(JOURNAL_TESS_OUTER, mOuterLevel);
+	mJournal->record(JOURNAL_MESH, (float)mMeshIndex);
+	if (getElapsedFrames() % 30 == 0) {
+		for (int index : mJournaledUniforms) {
+			mJournal->record(JOURNAL_UNIFORM + index, mVDSessionFacade->getUniformValue(index));
+		}
+	}
+	// warps and settings are written by the session itself, once edits have settled
+	if (mSessionDirty && getElapsedSeconds() - mLastEditTime > 2.0) {
+		saveSession();
+	}
+}
+
+void BatchassSkyApp::markSessionDirty()
+{
+	mSessionDirty = true;
+	mLastEditTime = getElapsedSeconds();
+}
+
+void BatchassSkyApp::saveSession()
+{
+	mVDSessionFacade->saveWarps();
+	mVDSettings->save();
+	mSessionDirty = false;
+}
+
+void BatchassSkyApp::cycleAntiAlias()
+{
+	// none, MSAA 2x, 4x, 8x, FXAA
+	auto mode = mAntiAlias->getMode();
+	int samples = mAntiAlias->getSamples();
+	if (mode == SkyAntiAlias::Mode::NONE) mAntiAlias->setMode(SkyAntiAlias::Mode::MSAA, 2);
+	else if (mode == SkyAntiAlias::Mode::MSAA && samples < 8) {
+		// setMode clamps to GL_MAX_SAMPLES, past the highest count move on to FXAA
+		mAntiAlias->setMode(SkyAntiAlias::Mode::MSAA, samples * 2);
+		if (mAntiAlias->getSamples() == samples) mAntiAlias->setMode(SkyAntiAlias::Mode::FXAA);
+	}
+	else if (mode == SkyAntiAlias::Mode::MSAA) mAntiAlias->setMode(SkyAntiAlias::Mode::FXAA);
+	else mAntiAlias->setMode(SkyAntiAlias::Mode::NONE);
+	mRenderFbo = mAntiAlias->getSceneFbo();
+}
+
+void BatchassSkyApp::benchmarkAntiAlias()
+{
+	// the tessellated wireframe on its default mesh, frozen so every mode renders the same frame
+	mInnerLevel = 8.0f;
+	mOuterLevel = 8.0f;
+	setMesh(7);
+	mUploader->finish();
+	auto results = SkyAntiAlias::benchmark(ivec2(mVDSettings->mRenderWidth, mVDSettings->mRenderHeight), [this](const gl::FboRef &fbo) {
+		renderSceneToFbo(fbo, fbo->getSize(), 10.0);
+	});
+	std::stringstream csv;
+	csv << "mode,samples,gpu_ms,mean_error,edge_error" << std::endl;
+	for (const auto &result : results) {
+		csv << (result.mode == SkyAntiAlias::Mode::MSAA ? "msaa" : result.mode == SkyAntiAlias::Mode::FXAA ? "fxaa" : "none") << ","
+			<< result.samples << "," << result.gpuMs << "," << result.meanError << "," << result.edgeError << std::endl;
+	}
+	CI_LOG_I("anti-aliasing benchmark at " << mVDSettings->mRenderWidth << "x" << mVDSettings->mRenderHeight << std::endl << csv.str());
+}
+
+gl::GlslProgRef BatchassSkyApp::createSceneShader(bool crowd, bool geometryStage, bool displace)
+{
+	auto format = gl::GlslProg::Format()
+		.vertex(loadAsset("shader.vert"))
+		.fragment(loadAsset("shader.frag"))
+		.tessellationCtrl(loadAsset("shader.cont"))
+		.tessellationEval(loadAsset("shader.eval"));
+	// without it the fragment shader derives the facet normal itself
+	if (geometryStage && !displace) format.geometry(loadAsset("shader.geom"));
+	else format.define("NO_GEOMETRY");
+	if (crowd) format.define("CROWD");
+	if (displace) format.define("DISPLACE");
+	return gl::GlslProg::create(format);
+}
+
+void BatchassSkyApp::setGeometryStage(bool enabled)
+{
+	if (!mSceneShaders[0]) return;
+	mGeometryStage = enabled;
+	mBatch->replaceGlslProg(mSceneShaders[enabled]);
+	if (mCrowdBatch) mCrowdBatch->replaceGlslProg(mCrowdShaders[enabled]);
+	CI_LOG_I("geometry stage " << (enabled ? "on" : "off"));
+}
+
+void BatchassSkyApp::benchmarkGeometryStage()
+{
+	// primitives per second of both pipelines on the default mesh
+	mUploader->finish();
+	if (!mSceneShaders[0]) return;
+	const int frames = 60;
+	GLuint queries[2];
+	glGenQueries(2, queries);
+	std::stringstream csv;
+	csv << "pipeline,level,primitives,gpu_ms,mprims_per_s" << std::endl;
+	for (int level = 1; level <= 64; level *= 2) {
+		for (int geometry = 1; geometry >= 0; geometry--) {
+			setGeometryStage(geometry != 0);
+			mInnerLevel = mOuterLevel = (float)level;
+			renderSceneToFbo(mRenderFbo, mRenderFbo->getSize(), 0.0);
+			glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+			glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+			for (int i = 0; i < frames; i++) {
+				renderSceneToFbo(mRenderFbo, mRenderFbo->getSize(), i / 60.0);
+			}
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 ns = 0, primitives = 0;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &ns);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &primitives);
+			double ms = ns / 1.0e6 / frames;
+			csv << (geometry ? "geometry" : "derivatives") << "," << level << "," << primitives / frames << "," << ms << ","
+				<< (ms > 0.0 ? primitives / frames / (ms * 1000.0) : 0.0) << std::endl;
+		}
+	}
+	glDeleteQueries(2, queries);
+	setGeometryStage(true);
+	CI_LOG_I("geometry stage benchmark at " << mRenderFbo->getWidth() << "x" << mRenderFbo->getHeight() << std::endl << csv.str());
+}
+
+void BatchassSkyApp::benchmarkScene()
+{
+	// GPU time of each frame from its own timer query, primitives from one query over all of them
+	// enough frames that p99 is not simply the slowest one
+	const int frames = 240;
+	const ivec2 sizes[] = { ivec2(1280, 720), ivec2(1920, 1080), ivec2(2560, 1440), ivec2(3840, 2160) };
+	const char *meshes[] = { "", "cube", "icosahedron", "sphere", "icosphere", "cylinder", "torus", "torusknot" };
+	std::vector<GLuint> timers(frames);
+	GLuint primitivesQuery;
+	glGenQueries(frames, timers.data());
+	glGenQueries(1, &primitivesQuery);
+	mCrowdMode = false;
+	std::stringstream csv;
+	csv << "mesh,level,width,height,geometry_stage,primitives,cpu_ms,gpu_p50_ms,gpu_p90_ms,gpu_p99_ms,gpu_max_ms" << std::endl;
+	for (int mesh = 1; mesh <= 7; mesh++) {
+		setMesh(mesh);
+		mUploader->finish();
+		for (const auto &size : sizes) {
+			auto fbo = gl::Fbo::create(size.x, size.y);
+			for (int level = 1; level <= 64; level *= 2) {
+				mInnerLevel = mOuterLevel = (float)level;
+				// warm up, the first draw at a level may compile or allocate in the driver
+				renderSceneToFbo(fbo, size, 0.0);
+				glFinish();
+				auto start = std::chrono::steady_clock::now();
+				glBeginQuery(GL_PRIMITIVES_GENERATED, primitivesQuery);
+				for (int i = 0; i < frames; i++) {
+					glBeginQuery(GL_TIME_ELAPSED, timers[i]);
+					renderSceneToFbo(fbo, size, i / 60.0);
+					glEndQuery(GL_TIME_ELAPSED);
+				}
+				glEndQuery(GL_PRIMITIVES_GENERATED);
+				double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+				std::vector<double> gpuMs(frames);
+				for (int i = 0; i < frames; i++) {
+					GLuint64 ns = 0;
+					glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &ns);
+					gpuMs[i] = ns / 1.0e6;
+				}
+				GLuint64 primitives = 0;
+				glGetQueryObjectui64v(primitivesQuery, GL_QUERY_RESULT, &primitives);
+				std::sort(gpuMs.begin(), gpuMs.end());
+				auto percentile = [&gpuMs](double p) { return gpuMs[std::min(gpuMs.size() - 1, (size_t)(p * gpuMs.size()))]; };
+				csv << meshes[mesh] << "," << level << "," << size.x << "," << size.y << "," << mGeometryStage << "," << primitives / frames << "," << cpuMs << ","
+					<< percentile(0.5) << "," << percentile(0.9) << "," << percentile(0.99) << "," << gpuMs.back() << std::endl;
+			}
+		}
+	}
+	glDeleteQueries(frames, timers.data());
+	glDeleteQueries(1, &primitivesQuery);
+	CI_LOG_I("scene benchmark, " << frames << " frames per row, " << (const char*)glGetString(GL_RENDERER) << std::endl << csv.str());
+
+	// kept as a baseline for driver, build and shader changes
+	char stamp[32];
+	time_t now = time(nullptr);
+	strftime(stamp, sizeof(stamp), "scene-%Y%m%d-%H%M%S.csv", localtime(&now));
+	fs::path folder = getDocumentsDirectory() / "BatchassSky" / "benchmarks";
+	fs::create_directories(folder);
+	std::ofstream file((folder / stamp).string());
+	file << csv.str();
+	CI_LOG_I("saved " << folder / stamp);
+}
+
+gl::Texture2dRef BatchassSkyApp::getHeightMap() const
+{
+	// the first clip, else a received frame, else the still
+	for (const auto &video : mVideoSources) {
+		if (video->getTexture()) return video->getTexture();
+	}
+	if (mReceivedTexture) return mReceivedTexture;
+	return mStillTexture;
+}
+
+void BatchassSkyApp::drawDisplacement(const gl::Texture2dRef &heightMap, const ivec2 &size)
+{
+	// the view of fx.glsl, its ray origin rotated a radian about x and a 33 degree field of view
+	CameraPersp cam(size.x, size.y, 33.4f, 0.1f, 100.0f);
+	cam.lookAt(vec3(0.0f, 1.68f, 1.08f), vec3(0.0f));
+	gl::setMatrices(cam);
+	const auto &shader = mDisplaceBatch->getGlslProg();
+	setSceneUniforms(shader);
+	gl::ScopedTextureBind scpTex(heightMap, 0);
+	shader->uniform("uHeightMap", 0);
+	// the audio level lifts the field, as iFreq0 does in fx.glsl
+	shader->uniform("uHeightScale", mDisplaceHeight * (1.0f + mBeatPulse));
+
+	gl::ScopedVao scopedVao(mDisplaceBatch->getVao().get());
+	gl::ScopedGlslProg scopedShader(shader);
+	gl::context()->setDefaultShaderVars();
+	glDrawElements(GL_PATCHES, mDisplaceBatch->getVboMesh()->getNumIndices(), mDisplaceBatch->getVboMesh()->getIndexDataType(), (GLvoid*)(0));
+}
+
+void BatchassSkyApp::benchmarkDisplacement()
+{
+	// the same height map and height through fx.glsl, 64 steps per pixel, and through the tessellated grid at each level
+	mUploader->finish();
+	auto fx = mShaderCache->get(loadString(loadAsset("fx.glsl")));
+	if (!mDisplaceBatch) {
+		CI_LOG_E("displacement shader unavailable");
+		return;
+	}
+	Surface8u surface(512, 512, false);
+	for (int y = 0; y < surface.getHeight(); y++) {
+		for (int x = 0; x < surface.getWidth(); x++) {
+			uint8_t value = (uint8_t)(127.5f + 127.5f * sinf(x * 0.05f) * cosf(y * 0.07f));
+			surface.setPixel(ivec2(x, y), ColorA8u(value, value, value, 255));
+		}
+	}
+	auto heightMap = gl::Texture2d::create(surface, gl::Texture2d::Format().mipmap(false));
+	mBeatPulse = 0.0f;
+	const int frames = 60;
+	GLuint queries[2];
+	glGenQueries(2, queries);
+	std::stringstream csv;
+	csv << "mode,level,width,height,gpu_ms,primitives" << std::endl;
+	const ivec2 sizes[] = { ivec2(1280, 720), ivec2(1920, 1080), ivec2(3840, 2160) };
+	for (const auto &size : sizes) {
+		auto fbo = gl::Fbo::create(size.x, size.y);
+		auto measure = [&](const char *mode, int level, const std::function<void()> &draw) {
+			gl::ScopedFramebuffer scpFbo(fbo);
+			gl::ScopedViewport scpVp(ivec2(0), size);
+			gl::ScopedMatrices scpMtx;
+			draw();
+			glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+			glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+			for (int i = 0; i < frames; i++) {
+				gl::clear(Color::black(), true);
+				draw();
+			}
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 ns = 0, primitives = 0;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &ns);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &primitives);
+			csv << mode << "," << level << "," << size.x << "," << size.y << "," << ns / 1.0e6 / frames << "," << primitives / frames << std::endl;
+		};
+		if (fx) {
+			measure("fx.glsl", 64, [&] {
+				gl::setMatricesWindow(size);
+				gl::ScopedDepth scpDepth(false);
+				gl::ScopedGlslProg scpShader(fx->getGlslProg());
+				gl::ScopedTextureBind scpTex(heightMap, 0);
+				fx->getGlslProg()->uniform("iChannel0", 0);
+				fx->set(fx->findSlot("iResolution"), vec3(size, 1.0f));
+				// the height scale of the grid, and the mouse that gives the default view
+				fx->set(fx->findSlot("iFreq0"), mDisplaceHeight * 500.0f);
+				fx->set(fx->findSlot("iMouse"), vec4(0.277f, 0.565f, 0.0f, 0.0f));
+				gl::drawSolidRect(Rectf(vec2(0.0f), vec2(size)));
+			});
+		}
+		for (int level = 1; level <= 64; level *= 2) {
+			mInnerLevel = mOuterLevel = (float)level;
+			measure("displacement", level, [&] {
+				gl::ScopedDepth scpDepth(true);
+				drawDisplacement(heightMap, size);
+			});
+		}
+	}
+	glDeleteQueries(2, queries);
+	CI_LOG_I("displacement benchmark, " << (fx ? "" : "fx.glsl did not compile, ") << "512x512 height map" << std::endl << csv.str());
+}
+
+void BatchassSkyApp::toggleRecording(bool pngSequence)
+{
+	if (mRecorder) {
+		mRecorder->stop();
+		mRecorder.reset();
+		return;
+	}
+	if (!mSceneTexture) return;
+	char stamp[32];
+	time_t now = time(nullptr);
+	strftime(stamp, sizeof(stamp), "sky-%Y%m%d-%H%M%S", localtime(&now));
+	fs::path folder = getDocumentsDirectory() / "BatchassSky" / "recordings";
+	fs::create_directories(folder);
+	auto format = SkyRecorder::Format().kind(pngSequence ? SkyRecorder::Kind::PNG : SkyRecorder::Kind::Y4M);
+	mRecorder = SkyRecorder::create(pngSequence ? folder / stamp : folder / (std::string(stamp) + ".y4m"), mSceneTexture->getSize(), format);
+}
+
+void BatchassSkyApp::toggleCrowd()
+{
+	if (!mCrowdBatch) return;
+	if (!mCrowd) mCrowd = SkyCrowd::create(4096);
+	mCrowdMode = !mCrowdMode;
+}
+
+void BatchassSkyApp::benchmarkCrowd()
+{
+	mUploader->finish();
+	if (!mCrowdBatch) return;
+	mCrowd = SkyCrowd::create(1024);
+	mCrowdMode = true;
+	mInnerLevel = 4.0f;
+	mOuterLevel = 4.0f;
+	const int frames = 120;
+	GLuint query;
+	glGenQueries(1, &query);
+	std::stringstream csv;
+	csv << "instances,visible,update_ms,upload_ms,gpu_ms" << std::endl;
+	for (size_t count = 1024; count <= 65536; count *= 2) {
+		mCrowd->setCount(count);
+		// warm up, the buffer is sized on the first upload
+		renderSceneToFbo(mRenderFbo, mRenderFbo->getSize(), 0.0);
+		double update = 0.0, upload = 0.0;
+		size_t visible = 0;
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int i = 0; i < frames; i++) {
+			renderSceneToFbo(mRenderFbo, mRenderFbo->getSize(), i / 60.0);
+			update += mCrowd->getStats().updateMs;
+			upload += mCrowd->getStats().uploadMs;
+			visible += mCrowd->getStats().visible;
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		csv << count << "," << visible / frames << "," << update / frames << "," << upload / frames << "," << ns / 1.0e6 / frames << std::endl;
+	}
+	glDeleteQueries(1, &query);
+	CI_LOG_I("crowd benchmark at " << mRenderFbo->getWidth() << "x" << mRenderFbo->getHeight() << ", tessellation 4" << std::endl << csv.str());
+}
+
+void BatchassSkyApp::benchmarkShm()
+{
+	// one sender and eight readers at 4K, whole frames then dirty tiles, unthrottled then at the show rate
+	std::stringstream csv;
+	csv << "tiled,target_fps,writer_fps,writer_max_ms,reader_fps,reader_min_fps,latency_ms,latency_max_ms,torn,full_bytes,sent_bytes,read_bytes,packet_bytes" << std::endl;
+	for (bool tiled : { false, true }) {
+		for (double targetFps : { 0.0, 60.0 }) {
+			auto result = SkyShmSender::benchmark(3840, 2160, 8, 5.0, targetFps, tiled);
+			csv << tiled << "," << targetFps << "," << result.writerFps << "," << result.writerMaxMs << "," << result.readerFps << "," << result.readerMinFps << ","
+				<< result.latencyMs << "," << result.latencyMaxMs << "," << result.torn << "," << result.fullBytesPerFrame << ","
+				<< result.sentBytesPerFrame << "," << result.readBytesPerFrame << "," << result.packetBytesPerFrame << std::endl;
+		}
+	}
+	CI_LOG_I("shared memory benchmark, 3840x2160, 1 sender, 8 readers, bytes per frame" << std::endl << csv.str());
+}
+
+void BatchassSkyApp::stressShmRegistry()
+{
+	// 256 processes registering, looking up and removing senders at once
+	auto result = SkyShmRegistry::stress(256, 200, 50);
+	if (!result.processes) {
+		CI_LOG_W("shared memory registry stress test not available");
+		return;
+	}
+	std::stringstream csv;
+	csv << "processes,failed,rounds,contended,leaked,tombstones,seconds" << std::endl;
+	csv << result.processes << "," << result.failed << "," << result.rounds << "," << result.contended << "," << result.leaked << "," << result.tombstones << "," << result.seconds << std::endl;
+	if (result.failed || result.contended || result.leaked) CI_LOG_E("shared memory registry stress test failed" << std::endl << csv.str());
+	else CI_LOG_I("shared memory registry stress test passed" << std::endl << csv.str());
+}
+
+bool BatchassSkyApp::parseNetAddress(const std::string &address)
+{
+	// [host:]port[/udp]
+	std::string rest = address;
+	mNetProtocol = SkyNetStream::Protocol::TCP;
+	size_t slash = rest.find('/');
+	if (slash != std::string::npos) {
+		if (rest.substr(slash + 1) == "udp") mNetProtocol = SkyNetStream::Protocol::UDP;
+		rest = rest.substr(0, slash);
+	}
+	size_t colon = rest.rfind(':');
+	if (colon != std::string::npos) {
+		mNetHost = rest.substr(0, colon);
+		rest = rest.substr(colon + 1);
+	}
+	int port = atoi(rest.c_str());
+	if (port <= 0 || port > 65535) {
+		CI_LOG_E("bad network address " << address);
+		return false;
+	}
+	mNetPort = (uint16_t)port;
+	return true;
+}
+
+void BatchassSkyApp::toggleNetOutput()
+{
+	if (mNetOutput) {
+		auto stats = mNetOutput->getSender()->getStats();
+		CI_LOG_I("network output stopped, " << stats.sent << " frames sent, " << stats.dropped << " dropped, " << stats.bytes / 1048576 << "MB");
+		mNetOutput.reset();
+		return;
+	}
+	auto format = SkyNetSender::Format().protocol(mNetProtocol);
+	mNetOutput = SkyNetOutput::create(SkyNetSender::create(mNetHost, mNetPort, format));
+	CI_LOG_I("network output to " << mNetHost << ":" << mNetPort << (mNetProtocol == SkyNetStream::Protocol::UDP ? " over udp" : " over tcp"));
+}
+
+void BatchassSkyApp::updateNetReceiver()
+{
+	int width, height;
+	if (mNetReceiver->receive(mNetPixels, width, height)) {
+		// rows arrive bottom up as the sender read them back
+		if (!mNetTexture || mNetTexture->getSize() != ivec2(width, height)) {
+			mNetTexture = gl::Texture2d::create(width, height, gl::Texture2d::Format().internalFormat(GL_RGBA8));
+		}
+		gl::ScopedTextureBind scopedTex(mNetTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, mNetPixels.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		mReceivedTexture = mNetTexture;
+	}
+	if (getElapsedSeconds() - mNetLogTime >= 1.0) {
+		double elapsed = getElapsedSeconds() - mNetLogTime;
+		mNetLogTime = getElapsedSeconds();
+		auto stats = mNetReceiver->getStats();
+		mNetReceiver->resetStats();
+		if (stats.connected) {
+			CI_LOG_I("net receive " << stats.frames / elapsed << "fps " << stats.bytes * 8e-6 / elapsed << "Mbit/s latency " << stats.latencyMs << "ms (max " << stats.latencyMaxMs
+				<< ") stale " << stats.stale << " incomplete " << stats.incomplete << " keyframe requests " << stats.keyframeRequests);
+		}
+	}
+}
+
+void BatchassSkyApp::benchmarkNet()
+{
+	// the whole path over loopback at 1080p60, latency is from the frame being offered to it being complete at the receiver
+	std::stringstream csv;
+	csv << "protocol,offered_fps,sent_fps,received_fps,mbit_s,uncompressed_mbit_s,latency_ms,latency_max_ms,encode_ms,dropped,incomplete,keyframe_requests" << std::endl;
+	for (auto protocol : { SkyNetStream::Protocol::TCP, SkyNetStream::Protocol::UDP }) {
+		auto result = SkyNetStream::benchmark(protocol, 1920, 1080, 60.0, 10.0, mNetPort);
+		csv << (protocol == SkyNetStream::Protocol::UDP ? "udp" : "tcp") << "," << result.offeredFps << "," << result.sentFps << "," << result.receivedFps << ","
+			<< result.megabitsPerSecond << "," << result.fullMegabitsPerSecond << "," << result.latencyMs << "," << result.latencyMaxMs << ","
+			<< result.encodeMs << "," << result.dropped << "," << result.incomplete << "," << result.keyframeRequests << std::endl;
+	}
+	CI_LOG_I("network benchmark, 1920x1080 at 60fps over loopback" << std::endl << csv.str());
+}
+
+void BatchassSkyApp::setupBeatTracker()
+{
+	auto ctx = audio::master();
+	try {
+		mBeatInput = ctx->createInputDeviceNode();
+		mBeatTrackerNode = ctx->makeNode(new SkyBeatTrackerNode());
+		mBeatInput >> mBeatTrackerNode;
+		mBeatInput->enable();
+		ctx->enable();
+		CI_LOG_I("beat tracker on " << mBeatInput->getDevice()->getName() << ", analysis latency " << mBeatTrackerNode->getTracker()->getAnalysisLatencyMs() << "ms");
+	}
+	catch (const audio::AudioExc &exc) {
+		CI_LOG_EXCEPTION("beat tracker disabled", exc);
+		mBeatTrackerNode.reset();
+	}
+}
+
+void BatchassSkyApp::analyzeBpm(const fs::path &path, float expectedBpm, float toleranceBpm)
+{
+	if (expectedBpm <= 0.0f) {
+		CI_LOG_E("--analyze-bpm needs the tempo of the file, as in --analyze-bpm loop.wav 128");
+		mExitCode = EXIT_FAILURE;
+		return;
+	}
+	auto analysis = SkyBeatTrackerNode::analyzeFile(loadFile(path));
+	auto check = SkyBeatTracker::check(analysis, expectedBpm, toleranceBpm);
+	std::stringstream line;
+	line << path.filename().string() << ": bpm " << analysis.bpm << ", expected " << expectedBpm << " +/- " << toleranceBpm << ", error " << check.errorBpm;
+	if (check.passed) {
+		CI_LOG_I("PASS " << line.str());
+		return;
+	}
+	if (check.octave) line << ", locked on " << (analysis.bpm < expectedBpm ? "half" : "double") << " the tempo";
+	CI_LOG_E("FAIL " << line.str());
+	mExitCode = EXIT_FAILURE;
 }
 
 void BatchassSkyApp::toggleCursorVisibility(bool visible)
@@ -168,7 +1005,81 @@ void BatchassSkyApp::toggleCursorVisibility(bool visible)
 
 void BatchassSkyApp::fileDrop(FileDropEvent event)
 {
-	mVDSessionFacade->fileDrop(event);
+	// raw Y4M clips, ISF shaders and stills are ingested in the background, only the other files go to the session
+	std::vector<fs::path> others;
+	for (const auto &file : event.getFiles()) {
+		if (SkyDropIngest::classify(file) == SkyDropIngest::Kind::OTHER) others.push_back(file);
+		else mIngest->add(file);
+	}
+	if (others.empty()) return;
+	if (others.size() == event.getFiles().size()) mVDSessionFacade->fileDrop(event);
+	else mVDSessionFacade->fileDrop(FileDropEvent(event.getWindow(), event.getX(), event.getY(), others));
+}
+
+void BatchassSkyApp::activateDrop(const SkyDropIngest::ItemRef &item)
+{
+	if (item->stage != SkyDropIngest::Stage::READY) {
+		CI_LOG_W("could not load " << item->path);
+		return;
+	}
+	switch (item->kind) {
+	case SkyDropIngest::Kind::SHADER:
+		setIsfProgram(item->program);
+		break;
+	case SkyDropIngest::Kind::IMAGE:
+		mTextureService->insert(item->path, item->texture);
+		mStills.push_back(item->path);
+		showStill(mStills.size() - 1);
+		break;
+	case SkyDropIngest::Kind::FOLDER:
+		if (item->stills.empty()) break;
+		mStills.insert(mStills.end(), item->stills.begin(), item->stills.end());
+		showStill(mStills.size() - item->stills.size());
+		break;
+	case SkyDropIngest::Kind::AUTOMATION:
+		playAutomation(item->automation);
+		break;
+	case SkyDropIngest::Kind::VIDEO: {
+		auto video = SkyVideoSource::create(item->path);
+		if (video) mVideoSources.push_back(video);
+		break;
+	}
+	default:
+		break;
+	}
+	CI_LOG_I(item->path.filename() << " ready in " << item->totalMs << "ms");
+}
+
+void BatchassSkyApp::drawIngestProgress()
+{
+	ui::Begin("Loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+	for (const auto &item : mIngest->getPending()) {
+		ui::ProgressBar(item->progress, ImVec2(160.0f, 0.0f), SkyDropIngest::getStageName(item->stage));
+		ui::SameLine();
+		ui::Text("%s", item->path.filename().string().c_str());
+	}
+	ui::End();
+}
+
+void BatchassSkyApp::setIsfProgram(const SkyShaderProgramRef &program)
+{
+	if (!program) return;
+	mIsfProgram = program;
+	mIsfRenderSizeSlot = mIsfProgram->findSlot("RENDERSIZE");
+	mIsfTimeSlot = mIsfProgram->findSlot("TIME");
+}
+
+void BatchassSkyApp::showStill(size_t index)
+{
+	if (mStills.empty()) return;
+	mStillIndex = index % mStills.size();
+	mStillTexture = mTextureService->fetch(mStills[mStillIndex]);
+	// warm the neighbours so stepping through a cue list does not wait for a decode
+	mTextureService->prefetch(mStills[(mStillIndex + 1) % mStills.size()]);
+	mTextureService->prefetch(mStills[(mStillIndex + mStills.size() - 1) % mStills.size()]);
+	const auto &stats = mTextureService->getStats();
+	CI_LOG_V("still " << mStills[mStillIndex].filename() << " resident " << (stats.residentBytes >> 20) << "MB in " << stats.residentCount
+		<< ", hits " << stats.hits << " misses " << stats.misses << " evictions " << stats.evictions);
 }
 
 void BatchassSkyApp::mouseMove(MouseEvent event)
@@ -197,8 +1108,9 @@ void BatchassSkyApp::mouseDrag(MouseEvent event)
 void BatchassSkyApp::mouseUp(MouseEvent event)
 {
 
-	if (!mVDSessionFacade->handleMouseUp(event)) {
-
+	// warp edits and UI changes are saved once they settle
+	if (mVDSessionFacade->handleMouseUp(event) || mVDSessionFacade->showUI()) {
+		markSessionDirty();
 	}
 }
 
@@ -219,45 +1131,383 @@ void BatchassSkyApp::keyDown(KeyEvent event)
 
 		case KeyEvent::KEY_l:
 			mVDSessionFacade->createWarp();
+			markSessionDirty();
+			break;
+		case KeyEvent::KEY_a:
+			// cycle the anti-aliasing mode
+			cycleAntiAlias();
+			break;
+		case KeyEvent::KEY_d:
+			// toggle dynamic resolution
+			mDynamicResolution->setEnabled(!mDynamicResolution->isEnabled());
 			break;
+		case KeyEvent::KEY_c:
+			// toggle the crowd of instances
+			toggleCrowd();
+			break;
+		case KeyEvent::KEY_r:
+			// start or stop recording, Y4M or with shift a PNG sequence
+			toggleRecording(event.isShiftDown());
+			break;
+		case KeyEvent::KEY_i:
+			// start or stop receiving from other applications
+			if (mFrameReceiver) mFrameReceiver.reset();
+			else mFrameReceiver = SkyFrameReceiver::create();
+			mReceivedTexture.reset();
+			break;
+		case KeyEvent::KEY_n:
+			// start or stop the network output
+			toggleNetOutput();
+			break;
+		case KeyEvent::KEY_g:
+			// toggle the geometry stage
+			setGeometryStage(!mGeometryStage);
+			break;
+		case KeyEvent::KEY_h:
+			// toggle the video height field, drawn as displaced geometry
+			if (mDisplaceBatch) mDisplaceMode = !mDisplaceMode;
+			break;
+		case KeyEvent::KEY_EQUALS: if (mCrowdMode) mCrowd->setCount(mCrowd->getCount() * 2); break;
+		case KeyEvent::KEY_MINUS: if (mCrowdMode) mCrowd->setCount(mCrowd->getCount() / 2); break;
+		case KeyEvent::KEY_PAGEDOWN: showStill(mStillIndex + 1); break;
+		case KeyEvent::KEY_PAGEUP: showStill(mStillIndex + mStills.size() - 1); break;
 		case KeyEvent::KEY_LEFT: mInnerLevel--; break;
 		case KeyEvent::KEY_RIGHT: mInnerLevel++; break;
 		case KeyEvent::KEY_DOWN: mOuterLevel--; break;
 		case KeyEvent::KEY_UP: mOuterLevel++; break;
-		case KeyEvent::KEY_1: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Cube())); break;
-		case KeyEvent::KEY_2: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Icosahedron())); break;
-		case KeyEvent::KEY_3: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Sphere())); break;
-		case KeyEvent::KEY_4: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Icosphere())); break;
-		case KeyEvent::KEY_5: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Cylinder())); break;
-		case KeyEvent::KEY_6: mBatch->replaceVboMesh(gl::VboMesh::create(geom::Torus())); break;
-		case KeyEvent::KEY_7: mBatch->replaceVboMesh(gl::VboMesh::create(geom::TorusKnot())); break;
+		case KeyEvent::KEY_1: setMesh(1); break;
+		case KeyEvent::KEY_2: setMesh(2); break;
+		case KeyEvent::KEY_3: setMesh(3); break;
+		case KeyEvent::KEY_4: setMesh(4); break;
+		case KeyEvent::KEY_5: setMesh(5); break;
+		case KeyEvent::KEY_6: setMesh(6); break;
+		case KeyEvent::KEY_7: setMesh(7); break;
+		case KeyEvent::KEY_8: setMesh(8); break;
+		case KeyEvent::KEY_9: setMesh(9); break;
+		case KeyEvent::KEY_0: setMesh(10); break;
 		}
 		mInnerLevel = math<float>::max(mInnerLevel, 1.0f);
 		mOuterLevel = math<float>::max(mOuterLevel, 1.0f);
 	//}
 }
 
+static gl::VboMeshRef createFixedMesh(int index)
+{
+	switch (index) {
+	case 1: return gl::VboMesh::create(geom::Cube());
+	case 2: return gl::VboMesh::create(geom::Icosahedron());
+	case 3: return gl::VboMesh::create(geom::Sphere());
+	case 4: return gl::VboMesh::create(geom::Icosphere());
+	case 5: return gl::VboMesh::create(geom::Cylinder());
+	case 6: return gl::VboMesh::create(geom::Torus());
+	default: return gl::VboMesh::create(geom::TorusKnot());
+	}
+}
+
+void BatchassSkyApp::setMesh(int index)
+{
+	if (index >= 1 && index <= 7) {
+		// built on the upload thread, the batches only rebuild their VAO once it is ready
+		mMeshRequest = index;
+		mUploader->submit("mesh " + toString(index), [index] { return createFixedMesh(index); }, [this, index](const gl::VboMeshRef &mesh) {
+			if (index != mMeshRequest) return;
+			// the crowd keeps the last fixed mesh
+			mBatch->replaceVboMesh(mesh);
+			if (mCrowdBatch) mCrowdBatch->replaceVboMesh(mesh);
+			mMeshStreaming = false;
+			mMeshIndex = index;
+		});
+		return;
+	}
+	switch (index) {
+	case 8: mStreamShape = SkyMeshStream::Shape::TORUS_KNOT; break;
+	case 9: mStreamShape = SkyMeshStream::Shape::TORUS; break;
+	case 10: mStreamShape = SkyMeshStream::Shape::SPHERE; break;
+	default: return;
+	}
+	if (!mMeshStream) mMeshStream = SkyMeshStream::create();
+	mMeshRequest = index;
+	mMeshStreaming = true;
+	mMeshIndex = index;
+}
+
+void BatchassSkyApp::playAutomation(const SkyAutomationRef &automation)
+{
+	mAutomation = automation;
+	mAutomationBeat = 0.0;
+	mAutomationTime = getElapsedSeconds();
+	CI_LOG_I("automation cue of " << automation->getNumCurves() << " curves, " << automation->getNumKeys() << " keys, " << automation->getLength() << " beats");
+}
+
+void BatchassSkyApp::updateAutomation()
+{
+	double now = getElapsedSeconds();
+	mAutomationBeat += (now - mAutomationTime) * mVDSessionFacade->getUniformValue(mVDUniforms->IBPM) / 60.0;
+	mAutomationTime = now;
+	if (mBeatLocked) {
+		// pull the fraction of the beat towards the tracker phase, a tenth of the error per frame
+		double error = mBeatPhase - (mAutomationBeat - floor(mAutomationBeat));
+		if (error > 0.5) error -= 1.0;
+		if (error < -0.5) error += 1.0;
+		mAutomationBeat += error * 0.1;
+	}
+	mAutomation->evaluate(mAutomationBeat);
+	const auto &targets = mAutomation->getTargets();
+	const float *values = mAutomation->getValues();
+	for (size_t i = 0; i < targets.size(); i++) {
+		mVDSessionFacade->setUniformValue(targets[i], values[i]);
+	}
+}
+
+void BatchassSkyApp::benchmarkAutomation()
+{
+	// per curve cost of one evaluation, SSE against scalar interpolation
+	std::stringstream csv;
+	csv << "curves,keys,gather_ns,simd_ns,scalar_ns,max_error" << std::endl;
+	for (size_t curves = 64; curves <= 4096; curves *= 4) {
+		auto result = SkyAutomation::benchmark(curves, 16, 2000);
+		csv << result.curves << "," << result.keys << "," << result.gatherNs << "," << result.simdNs << "," << result.scalarNs << "," << result.maxError << std::endl;
+	}
+	CI_LOG_I("automation benchmark" << std::endl << csv.str());
+}
+
+void BatchassSkyApp::updateMidi()
+{
+	double now = getElapsedSeconds();
+	if (mMidi->update(now - mMidiTime)) mMidi->save(mMidiPath);
+	mMidiTime = now;
+	// applied after the automation, a hand on a fader wins
+	for (const auto &change : mMidi->getChanges()) {
+		mVDSessionFacade->setUniformValue(change.first, change.second);
+	}
+	const auto &stats = mMidi->getStats();
+	if (stats.controlChanges && now - mMidiLogTime >= 10.0) {
+		mMidiLogTime = now;
+		CI_LOG_I("MIDI " << stats.controlChanges << " control changes, " << stats.unmapped << " unmapped, " << stats.dropped << " dropped, latency mean "
+			<< stats.meanLatencyMs << "ms max " << stats.maxLatencyMs << "ms");
+		mMidi->resetStats();
+	}
+}
+
+void BatchassSkyApp::drawMidiPanel()
+{
+	ui::Begin("MIDI", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+	ui::InputInt("uniform", &mMidiLearnTarget);
+	ui::DragFloatRange2("range", &mMidiLearnMin, &mMidiLearnMax, 0.01f);
+	if (mMidi->isLearning()) {
+		if (ui::Button("cancel")) mMidi->cancelLearn();
+		ui::SameLine();
+		ui::Text("move a control");
+	}
+	else if (ui::Button("learn")) {
+		mMidi->learn(mMidiLearnTarget, mMidiLearnMin, mMidiLearnMax);
+	}
+	const auto &mappings = mMidi->getMappings();
+	for (size_t i = 0; i < mappings.size(); i++) {
+		const auto &mapping = mappings[i];
+		ui::PushID((int)i);
+		bool remove = ui::SmallButton("x");
+		ui::SameLine();
+		ui::Text("ch %d cc %d > uniform %d [%.2f %.2f]", mapping.channel, mapping.controller, mapping.target, mapping.min, mapping.max);
+		ui::PopID();
+		if (remove) {
+			mMidi->unmap(mapping.channel, mapping.controller);
+			mMidi->save(mMidiPath);
+			break;
+		}
+	}
+	ui::End();
+}
+
+void BatchassSkyApp::startOsc()
+{
+	std::vector<SkyOscReceiver::Route> routes;
+	for (int i = 0; i < OSC_UNIFORMS; i++) {
+		routes.push_back({ "/sky/uniform/" + toString(i), i });
+	}
+	// each route takes only its own arguments, so the consecutive slots below do not bleed into each other
+	routes.push_back({ "/sky/tess", OSC_TESS_INNER, 2 });		// inner and outer
+	routes.push_back({ "/sky/tess/inner", OSC_TESS_INNER });
+	routes.push_back({ "/sky/tess/outer", OSC_TESS_OUTER });
+	routes.push_back({ "/sky/mesh", OSC_MESH });
+	mOsc = SkyOscReceiver::create(mOscPort, routes);
+	if (mOsc) CI_LOG_I("OSC on port " << mOsc->getPort());
+	else CI_LOG_E("cannot listen for OSC on port " << mOscPort);
+}
+
+void BatchassSkyApp::updateOsc()
+{
+	mOsc->update();
+	// applied after MIDI, the last controller to speak wins
+	for (const auto &change : mOsc->getChanges()) {
+		const float value = change.second;
+		switch (change.first) {
+		case OSC_TESS_INNER: mInnerLevel = value; break;
+		case OSC_TESS_OUTER: mOuterLevel = value; break;
+		case OSC_MESH: if ((int)value != mMeshRequest) setMesh((int)value); break;
+		default:
+			if (change.first < OSC_UNIFORMS) mVDSessionFacade->setUniformValue(change.first, value);
+			break;
+		}
+	}
+	double now = getElapsedSeconds();
+	if (now - mOscLogTime >= 10.0) {
+		mOscLogTime = now;
+		auto stats = mOsc->getStats();
+		if (stats.messages) {
+			CI_LOG_I("OSC " << stats.messages << " messages, " << stats.bundles << " bundles, " << stats.unrouted << " unrouted, " << stats.malformed << " malformed, "
+				<< stats.dropped << " dropped, latency mean " << stats.meanLatencyMs << "ms max " << stats.maxLatencyMs << "ms");
+			mOsc->resetStats();
+		}
+	}
+}
+
+void BatchassSkyApp::benchmarkOsc()
+{
+	// loopback, the receiving side polled at 60 fps; up to the 50k messages/s a desk may send nothing may be lost or dropped
+	const int acceptedRate = 50000;
+	std::stringstream csv;
+	csv << "rate,sent,received,lost,dropped,deferred,applied,mean_latency_ms,max_latency_ms,result" << std::endl;
+	bool passed = true;
+	for (int rate : { 10000, 50000, 100000 }) {
+		auto result = SkyOscReceiver::benchmark(0, rate, 5.0);
+		const auto &stats = result.stats;
+		const int64_t lost = (int64_t)(result.sent - stats.messages);
+		const bool checked = rate <= acceptedRate;
+		const bool ok = result.sent > 0 && lost == 0 && stats.dropped == 0;
+		if (checked && !ok) passed = false;
+		csv << result.rate << "," << result.sent << "," << stats.messages << "," << lost << "," << stats.dropped << ","
+			<< stats.deferred << "," << stats.applied << "," << stats.meanLatencyMs << "," << stats.maxLatencyMs << ","
+			<< (checked ? (ok ? "PASS" : "FAIL") : "-") << std::endl;
+	}
+	if (passed) CI_LOG_I("OSC benchmark passed" << std::endl << csv.str());
+	else {
+		CI_LOG_E("OSC benchmark failed, messages lost or dropped at or below " << acceptedRate << "/s" << std::endl << csv.str());
+		mExitCode = EXIT_FAILURE;
+	}
+}
+
+void BatchassSkyApp::logPipelineStats()
+{
+	double now = getElapsedSeconds();
+	if (now - mPipelineLogTime < 10.0) return;
+	mPipelineLogTime = now;
+	const auto &counters = mPipelineStats->getCounters();
+	std::stringstream line;
+	line << "frame " << getAverageFps() << " fps, gpu " << mDynamicResolution->getGpuMilliseconds() << "ms, tessellation " << mInnerLevel << "/" << mOuterLevel;
+	if (mPipelineStats->isSupported()) {
+		line << ", " << counters.patches << " patches, " << counters.evaluations << " evaluations ("
+			<< (counters.patches ? (double)counters.evaluations / counters.patches : 0.0) << " per patch), "
+			<< counters.geometryPrimitives << " geometry primitives, " << counters.fragments << " fragments";
+	}
+	line << ", " << counters.primitivesGenerated << " primitives generated";
+	CI_LOG_I(line.str());
+}
+
+void BatchassSkyApp::drawScenePanel()
+{
+	ui::Begin("Scene", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+	ui::DragFloat("inner", &mInnerLevel, 0.1f, 1.0f, 64.0f);
+	ui::DragFloat("outer", &mOuterLevel, 0.1f, 1.0f, 64.0f);
+	if (mDisplaceBatch) {
+		ui::Checkbox("displacement", &mDisplaceMode);
+		ui::SameLine();
+		ui::DragFloat("height", &mDisplaceHeight, 0.005f, 0.0f, 1.0f);
+	}
+	const auto &counters = mPipelineStats->getCounters();
+	if (mPipelineStats->isSupported()) {
+		// amplification of the tessellator, then what the geometry and fragment stages make of it
+		ui::Text("patches %llu", (unsigned long long)counters.patches);
+		ui::Text("evaluations %llu (%.1f per patch)", (unsigned long long)counters.evaluations, counters.patches ? (double)counters.evaluations / counters.patches : 0.0);
+		ui::Text("geometry primitives %llu", (unsigned long long)counters.geometryPrimitives);
+		ui::Text("fragments %llu", (unsigned long long)counters.fragments);
+	}
+	ui::Text("primitives generated %llu", (unsigned long long)counters.primitivesGenerated);
+	ui::End();
+}
+
+void BatchassSkyApp::updateMeshStream()
+{
+	// subdivisions, tube and turns all move, the arena is rewritten in place every frame
+	float time = (float)getElapsedSeconds();
+	auto params = SkyMeshStream::Params()
+		.shape(mStreamShape)
+		.rings(192 + (int)(96.0f * sinf(time * 0.31f)))
+		.segments(20 + (int)(12.0f * sinf(time * 0.53f)))
+		.radius(1.0f)
+		.tubeRadius(0.16f + 0.1f * mBeatPulse)
+		.turns(2 + (int)(time / 16.0f) % 3, 3 + (int)(time / 8.0f) % 4);
+	mMeshStream->update(params);
+	if (getElapsedSeconds() - mMeshLogTime >= 10.0) {
+		mMeshLogTime = getElapsedSeconds();
+		const auto &stats = mMeshStream->getStats();
+		CI_LOG_I("mesh stream " << stats.vertices << " vertices in " << stats.generateMs << "ms, " << stats.stalls << " stalls " << stats.stallMs << "ms");
+	}
+}
+
 void BatchassSkyApp::keyUp(KeyEvent event)
 {
 
 	// let your application perform its keyUp handling here
-	if (!mVDSessionFacade->handleKeyUp(event)) {
-		
+	if (mVDSessionFacade->handleKeyUp(event)) {
+		markSessionDirty();
 	}
 }
 void BatchassSkyApp::cleanup()
 {
 	CI_LOG_V("cleanup and save");
 	ui::Shutdown();
-	mVDSessionFacade->saveWarps();
-	mVDSettings->save();
+	// the journal is already on disk, only unsettled warp or settings edits still need writing
+	mJournal->close();
+	if (mSessionDirty) saveSession();
+	if (mRecorder) mRecorder->stop();
+	mNetOutput.reset();
+	mNetReceiver.reset();
+	mIngest.reset();
+	mUploader.reset();
+	mMidi.reset();
+	mOsc.reset();
 	CI_LOG_V("quit");
+	// App::quit() always ends with 0, a scripted check has to see its failure
+	if (mExitCode) std::exit(mExitCode);
 }
 
 void BatchassSkyApp::update()
 {
 	mVDSessionFacade->setUniformValue(mVDUniforms->IFPS, getAverageFps());
+	if (mBeatTrackerNode) {
+		auto beat = mBeatTrackerNode->getTracker()->getState();
+		if (beat.locked) {
+			mVDSessionFacade->setUniformValue(mVDUniforms->IBPM, beat.bpm);
+			if ((int)(beat.bpm + 0.5f) != mLoggedBpm) {
+				mLoggedBpm = (int)(beat.bpm + 0.5f);
+				CI_LOG_I("bpm " << beat.bpm << " confidence " << beat.confidence << " latency " << beat.latencyMs << "ms");
+			}
+		}
+		mBeatPhase = beat.phase;
+		mBeatPulse = beat.pulse;
+		mBeatLocked = beat.locked;
+	}
 	mVDSessionFacade->update();
+	for (auto &video : mVideoSources) {
+		video->update(getElapsedSeconds());
+	}
+	mTextureService->update();
+	mUploader->update();
+	// only complete sources are swapped in, between frames
+	for (const auto &item : mIngest->poll()) {
+		activateDrop(item);
+	}
+	if (mAutomation) updateAutomation();
+	updateMidi();
+	if (mOsc) updateOsc();
+	if (mFrameReceiver) mReceivedTexture = mFrameReceiver->receiveTexture();
+	if (mNetReceiver) updateNetReceiver();
+	if (mMeshStreaming) updateMeshStream();
+	if (!mStillTexture && !mStills.empty()) {
+		mStillTexture = mTextureService->fetch(mStills[mStillIndex]);
+	}
+	updateJournal();
 }
 
 
@@ -266,32 +1516,48 @@ void BatchassSkyApp::resize()
 	mVDUI->resize();
 }
 // Render the scene into the FBO
-void BatchassSkyApp::renderSceneToFbo()
+void BatchassSkyApp::renderSceneToFbo(const gl::FboRef &fbo, const ivec2 &size, double time)
 {
 	// this will restore the old framebuffer binding when we leave this function
 	// on non-OpenGL ES platforms, you can just call mFbo->unbindFramebuffer() at the end of the function
 	// but this will restore the "screen" FBO on OpenGL ES, and does the right thing on both platforms
-	gl::ScopedFramebuffer fbScp(mRenderFbo);
+	gl::ScopedFramebuffer fbScp(fbo);
 	gl::clear(Color::gray(0.03f), true);//mBlack
-	// setup the viewport to match the dimensions of the FBO
-	gl::ScopedViewport scpVp(ivec2(0), mRenderFbo->getSize());
+	// setup the viewport to the rendered region, the whole FBO unless the resolution is lowered
+	gl::ScopedViewport scpVp(ivec2(0), size);
 	gl::color(Color::white());
+	drawBackground(size);
+	// the patches only, not the background, and never inside a benchmark's own queries
+	SkyPipelineStats::Scope pipelineScope(mCountPipeline ? mPipelineStats : nullptr);
+	if (mDisplaceMode) {
+		auto heightMap = getHeightMap();
+		if (heightMap) {
+			drawDisplacement(heightMap, size);
+			return;
+		}
+	}
 	// setup basic camera
 	//auto cam = CameraPersp(mVDSettings->mFboWidth + ((int)mVDSettings->maxVolume * 5), mVDSettings->mFboHeight, 60, 1, 1000).calcFraming(Sphere(vec3(0.0f), 1.25f));
 	auto cam = CameraPersp(mVDParams->getFboWidth(), mVDParams->getFboHeight(), 60, 1, 1000).calcFraming(Sphere(vec3(0.0f), 1.25f));
+	if (mCrowdMode) {
+		// the whole field, culled against this camera
+		cam = mCrowd->getCamera((float)mVDParams->getFboWidth() / mVDParams->getFboHeight(), time);
+		gl::setMatrices(cam);
+		setSceneUniforms(mCrowdBatch->getGlslProg());
+		mCrowd->update(time, cam.getProjectionMatrix() * cam.getViewMatrix());
+		mCrowd->draw(mCrowdBatch);
+		return;
+	}
 	gl::setMatrices(cam);
 	//gl::rotate(getElapsedSeconds() * 0.1f, vec3(0.123, 0.456, 0.789));
 	//gl::rotate(getElapsedSeconds() * 0.1f + mVDSettings->maxVolume / 100, vec3(0.123, 0.456, 0.789));
-	gl::rotate(getElapsedSeconds() * 0.1f, vec3(0.123, 0.456, 0.789));
-	gl::viewport(getWindowSize());
+	gl::rotate((float)time * 0.1f, vec3(0.123, 0.456, 0.789));
 
-	// update uniforms
-	//mBatch->getGlslProg()->uniform("uTessLevelInner", mInnerLevel + mVDSettings->maxVolume / 10);
-	mBatch->getGlslProg()->uniform("uTessLevelInner", mInnerLevel);
-	mBatch->getGlslProg()->uniform("uTessLevelOuter", mOuterLevel);
-	mBatch->getGlslProg()->uniform("iFR", mVDSessionFacade->getUniformValue(mVDUniforms->ICOLORX));
-	mBatch->getGlslProg()->uniform("iFG", mVDSessionFacade->getUniformValue(mVDUniforms->ICOLORY));
-	mBatch->getGlslProg()->uniform("iAlpha", mVDSessionFacade->getUniformValue(mVDUniforms->IALPHA));
+	setSceneUniforms(mBatch->getGlslProg());
+	if (mMeshStreaming) {
+		mMeshStream->draw(mBatch->getGlslProg());
+		return;
+	}
 	// bypass gl::Batch::draw method so we can use GL_PATCHES
 	gl::ScopedVao scopedVao(mBatch->getVao().get());
 	gl::ScopedGlslProg scopedShader(mBatch->getGlslProg());
@@ -303,9 +1569,66 @@ void BatchassSkyApp::renderSceneToFbo()
 	else
 		glDrawArrays(GL_PATCHES, 0, mBatch->getVboMesh()->getNumIndices());
 }
+void BatchassSkyApp::setSceneUniforms(const gl::GlslProgRef &shader)
+{
+	// update uniforms
+	//shader->uniform("uTessLevelInner", mInnerLevel + mVDSettings->maxVolume / 10);
+	shader->uniform("uTessLevelInner", mInnerLevel);
+	shader->uniform("uTessLevelOuter", mOuterLevel);
+	shader->uniform("iFR", mVDSessionFacade->getUniformValue(mVDUniforms->ICOLORX));
+	shader->uniform("iFG", mVDSessionFacade->getUniformValue(mVDUniforms->ICOLORY));
+	shader->uniform("iAlpha", mVDSessionFacade->getUniformValue(mVDUniforms->IALPHA));
+	shader->uniform("iBeatPhase", mBeatPhase);
+	shader->uniform("iBeatPulse", mBeatPulse);
+}
+// ISF shader, still, received frame and video clips side by side behind the scene
+void BatchassSkyApp::drawBackground(const ivec2 &size)
+{
+	if (mVideoSources.empty() && !mStillTexture && !mIsfProgram && !mReceivedTexture) return;
+
+	gl::ScopedMatrices scpMtx;
+	gl::setMatricesWindow(size);
+	gl::ScopedDepth scpDepth(false);
+	if (mIsfProgram) {
+		// image inputs read the current still
+		gl::ScopedGlslProg scpShader(mIsfProgram->getGlslProg());
+		for (size_t i = 0; i < mIsfProgram->getInputs().size(); i++) {
+			int unit = mIsfProgram->getInputUnit(i);
+			if (unit >= 0 && mStillTexture) mStillTexture->bind(unit);
+		}
+		mIsfProgram->set(mIsfRenderSizeSlot, vec2(size));
+		mIsfProgram->set(mIsfTimeSlot, (float)getElapsedSeconds());
+		gl::drawSolidRect(Rectf(vec2(0.0f), vec2(size)));
+	}
+	else if (mStillTexture) {
+		gl::draw(mStillTexture, Rectf(vec2(0.0f), vec2(size)));
+	}
+	if (mReceivedTexture) {
+		gl::draw(mReceivedTexture, Rectf(vec2(0.0f), vec2(size)));
+	}
+	float w = (float)size.x / mVideoSources.size();
+	for (size_t i = 0; i < mVideoSources.size(); i++) {
+		if (mVideoSources[i]->getNumShown()) {
+			gl::draw(mVideoSources[i]->getTexture(), Rectf(i * w, 0.0f, (i + 1) * w, (float)size.y));
+		}
+	}
+}
 void BatchassSkyApp::draw()
 {
-	renderSceneToFbo();
+	if (getWindow() == mOperatorWindow) {
+		drawOperator();
+		return;
+	}
+	mDynamicResolution->beginFrame();
+	mCountPipeline = true;
+	renderSceneToFbo(mRenderFbo, mDynamicResolution->getRenderSize(), getElapsedSeconds());
+	mCountPipeline = false;
+	// the only resolve of the frame, everything below samples this texture
+	mSceneTexture = mDynamicResolution->upscale(mAntiAlias->resolve());
+	mDynamicResolution->endFrame();
+	logPipelineStats();
+	if (mRecorder) mRecorder->capture(mSceneTexture);
+	if (mNetOutput) mNetOutput->capture(mSceneTexture);
 
 	// clear the window and set the drawing color to white
 	gl::clear();
@@ -408,18 +1731,18 @@ void BatchassSkyApp::draw()
 	aShader->uniform("iXorY", mVDSettings->iXorY);
 	aShader->uniform("iBadTv", mVDSettings->iBadTv);*/
 
-	mRenderFbo->getColorTexture()->bind(0);
-	mRenderFbo->getColorTexture()->bind(1);
+	mSceneTexture->bind(0);
+	mSceneTexture->bind(1);
 	gl::drawSolidRect(Rectf(0, 0, mVDParams->getFboWidth(), mVDParams->getFboHeight()));
 	// stop drawing into the FBO
 	//mVDFbos[mVDSettings->mMixFboIndex]->getFboRef()->unbindFramebuffer();
-	mRenderFbo->getColorTexture()->unbind();
-	mRenderFbo->getColorTexture()->unbind();
+	mSceneTexture->unbind();
+	mSceneTexture->unbind();
 
 
 	gl::clear(Color::black());
 	gl::setMatricesWindow(toPixels(getWindowSize()));
-	gl::draw(mRenderFbo->getColorTexture());
+	gl::draw(mSceneTexture);
 	/*int i = 0;
 	for (auto &warp : mWarps) {
 		if (mUseBeginEnd) {
@@ -443,15 +1766,71 @@ void BatchassSkyApp::draw()
 
 
 	// imgui
-	if (mVDSessionFacade->showUI()) {
-		mVDUI->Run("UI", (int)getAverageFps());
-		if (mVDUI->isReady()) {
-		}
+	if (!mOperatorWindow) drawUi();
+	const size_t loading = mIngest->getPending().size();
+	getWindow()->setTitle(toString((int)getAverageFps()) + " fps" + (loading ? ", loading " + toString(loading) : ""));
+}
+void BatchassSkyApp::drawUi()
+{
+	// the cached texture is composited by mUiCache after the ImGui block renders
+	if (!mVDSessionFacade->showUI() || !mUiCache->beginFrame(getUiVersion())) return;
+	mVDUI->Run("UI", (int)getAverageFps());
+	if (mVDUI->isReady()) {
+	}
+	if (!mIngest->getPending().empty()) drawIngestProgress();
+	drawMidiPanel();
+	drawScenePanel();
+}
+
+uint64_t BatchassSkyApp::getUiVersion()
+{
+	// what the panels print, at the precision they print it; the frame rate is in the window title and not part of it
+	uint64_t version = 0;
+	auto add = [&version](uint64_t value) { version = version * 31 + value; };
+	auto addFloat = [&add](float value, float scale) { add((uint64_t)(int64_t)std::llround(value * scale)); };
+	for (const auto &item : mIngest->getPending()) {
+		// the bar is 160 pixels wide
+		add((uint64_t)(uintptr_t)item.get());
+		add((uint64_t)item->stage.load());
+		addFloat(item->progress, 160.0f);
+	}
+	add((uint64_t)mMidiLearnTarget);
+	addFloat(mMidiLearnMin, 1000.0f);
+	addFloat(mMidiLearnMax, 1000.0f);
+	add(mMidi->isLearning() ? 1 : 0);
+	for (const auto &mapping : mMidi->getMappings()) {
+		add((uint64_t)mapping.channel);
+		add((uint64_t)mapping.controller);
+		add((uint64_t)mapping.target);
+		addFloat(mapping.min, 100.0f);
+		addFloat(mapping.max, 100.0f);
 	}
-	getWindow()->setTitle(toString((int)getAverageFps()) + " fps");
+	addFloat(mInnerLevel, 1000.0f);
+	addFloat(mOuterLevel, 1000.0f);
+	add(mDisplaceMode ? 1 : 0);
+	addFloat(mDisplaceHeight, 1000.0f);
+	const auto &counters = mPipelineStats->getCounters();
+	add(counters.patches);
+	add(counters.evaluations);
+	add(counters.geometryPrimitives);
+	add(counters.fragments);
+	add(counters.primitivesGenerated);
+	return version;
 }
+
+void BatchassSkyApp::drawOperator()
+{
+	gl::clear(Color::black());
+	// a preview of the last output frame, the window's own draw renders nothing else
+	if (mSceneTexture) {
+		gl::setMatricesWindow(toPixels(getWindowSize()));
+		gl::draw(mSceneTexture, Rectf(mSceneTexture->getBounds()).getCenteredFit(Rectf(vec2(0), toPixels(getWindowSize())), true));
+	}
+	drawUi();
+}
+
 void prepareSettings(App::Settings *settings)
 {
 	settings->setWindowSize(1280, 720);
 }
-CINDER_APP(BatchassSkyApp, RendererGl(RendererGl::Options().msaa(8)),  prepareSettings)
+CINDER_APP(BatchassSkyApp, RendererGl(RendererGl::Options().msaa(0)),  prepareSettings)
@@ -0,0 +1,159 @@
+#include "SkyAntiAlias.h"
+
+#include "cinder/app/App.h"
+#include "cinder/Log.h"
+
+using namespace ci;
+using namespace std;
+
+SkyAntiAlias::SkyAntiAlias(const ivec2 &size, Mode mode, int samples)
+	: mSize(size), mMode(Mode::NONE), mSamples(1)
+{
+	setMode(mode, samples);
+}
+
+void SkyAntiAlias::setMode(Mode mode, int samples)
+{
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = mode == Mode::MSAA ? glm::clamp(samples, 2, std::max(2, (int)maxSamples)) : 1;
+	if (mSceneFbo && mode == mMode && samples == mSamples) return;
+	mMode = mode;
+	mSamples = samples;
+
+	// the multisampled fbo resolves into its color texture on the first getColorTexture() after drawing
+	auto format = gl::Fbo::Format().colorTexture(gl::Texture2d::Format().internalFormat(GL_RGBA8).minFilter(GL_LINEAR).magFilter(GL_LINEAR));
+	if (mMode == Mode::MSAA) format.samples(mSamples);
+	mSceneFbo = gl::Fbo::create(mSize.x, mSize.y, format);
+
+	if (mMode == Mode::FXAA) {
+		if (!mFxaaShader) {
+			try {
+				mFxaaShader = gl::GlslProg::create(app::loadAsset("passthrough.vs"), app::loadAsset("fxaa.fs.glsl"));
+			}
+			catch (const std::exception &exc) {
+				CI_LOG_EXCEPTION("fxaa shader", exc);
+			}
+		}
+		mFxaaFbo = gl::Fbo::create(mSize.x, mSize.y, gl::Fbo::Format().disableDepth().colorTexture());
+	}
+	else {
+		mFxaaFbo.reset();
+	}
+	CI_LOG_I("anti-aliasing " << getModeName() << " at " << mSize.x << "x" << mSize.y);
+}
+
+string SkyAntiAlias::getModeName() const
+{
+	switch (mMode) {
+	case Mode::MSAA: return "MSAA " + to_string(mSamples) + "x";
+	case Mode::FXAA: return "FXAA";
+	default: return "none";
+	}
+}
+
+gl::Texture2dRef SkyAntiAlias::resolve()
+{
+	auto scene = mSceneFbo->getColorTexture();
+	if (mMode != Mode::FXAA || !mFxaaShader) return scene;
+
+	gl::ScopedFramebuffer scpFbo(mFxaaFbo);
+	gl::ScopedViewport scpVp(ivec2(0), mFxaaFbo->getSize());
+	gl::ScopedMatrices scpMtx;
+	gl::setMatricesWindow(mFxaaFbo->getSize());
+	gl::ScopedDepth scpDepth(false);
+	gl::ScopedBlend scpBlend(false);
+	gl::ScopedGlslProg scpShader(mFxaaShader);
+	gl::ScopedTextureBind scpTex(scene, 0);
+	mFxaaShader->uniform("uTex", 0);
+	mFxaaShader->uniform("uInvSize", vec2(1.0f) / vec2(mSize));
+	gl::drawSolidRect(mFxaaFbo->getBounds(), vec2(0.0f, 1.0f), vec2(1.0f, 0.0f));
+	return mFxaaFbo->getColorTexture();
+}
+
+namespace {
+	// luminance of a readback, optionally box filtered down by an integer factor
+	vector<float> luminance(const gl::Texture2dRef &texture, int factor)
+	{
+		Surface8u surface(texture->createSource());
+		const int width = surface.getWidth() / factor;
+		const int height = surface.getHeight() / factor;
+		vector<float> result((size_t)width * height, 0.0f);
+		const float scale = 1.0f / (255.0f * factor * factor);
+		for (int y = 0; y < height * factor; y++) {
+			const uint8_t *row = surface.getData(ivec2(0, y));
+			const uint8_t inc = surface.getPixelInc();
+			const auto &order = surface.getChannelOrder();
+			for (int x = 0; x < width * factor; x++) {
+				const uint8_t *px = row + x * inc;
+				float l = 0.299f * px[order.getRedOffset()] + 0.587f * px[order.getGreenOffset()] + 0.114f * px[order.getBlueOffset()];
+				result[(size_t)(y / factor) * width + x / factor] += l * scale;
+			}
+		}
+		return result;
+	}
+}
+
+vector<SkyAntiAlias::Result> SkyAntiAlias::benchmark(const ivec2 &size, const function<void(const gl::FboRef&)> &renderScene, int frames)
+{
+	// 4x supersampled reference, box filtered to the output size
+	const int factor = 4;
+	auto reference = gl::Fbo::create(size.x * factor, size.y * factor, gl::Fbo::Format().colorTexture());
+	renderScene(reference);
+	auto target = luminance(reference->getColorTexture(), factor);
+	reference.reset();
+
+	// edge pixels are where the reference has a visible luminance step
+	vector<uint8_t> edges(target.size(), 0);
+	size_t numEdges = 0;
+	for (int y = 0; y + 1 < size.y; y++) {
+		for (int x = 0; x + 1 < size.x; x++) {
+			size_t i = (size_t)y * size.x + x;
+			float step = std::max(fabsf(target[i + 1] - target[i]), fabsf(target[i + size.x] - target[i]));
+			if (step > 0.1f) {
+				edges[i] = 1;
+				numEdges++;
+			}
+		}
+	}
+
+	const pair<Mode, int> configs[] = { { Mode::NONE, 1 }, { Mode::MSAA, 2 }, { Mode::MSAA, 4 }, { Mode::MSAA, 8 }, { Mode::FXAA, 1 } };
+	vector<Result> results;
+	GLuint query;
+	glGenQueries(1, &query);
+	for (const auto &config : configs) {
+		auto aa = SkyAntiAlias::create(size, config.first, config.second);
+		if (aa->getMode() == Mode::MSAA && aa->getSamples() != config.second) continue;
+		// warm up, so allocation and shader compilation are not timed
+		renderScene(aa->getSceneFbo());
+		aa->resolve();
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		gl::Texture2dRef resolved;
+		for (int i = 0; i < frames; i++) {
+			renderScene(aa->getSceneFbo());
+			resolved = aa->resolve();
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+
+		auto image = luminance(resolved, 1);
+		double sum = 0.0, edgeSum = 0.0;
+		for (size_t i = 0; i < image.size(); i++) {
+			float error = fabsf(image[i] - target[i]);
+			sum += error;
+			if (edges[i]) edgeSum += error;
+		}
+		Result result;
+		result.mode = aa->getMode();
+		result.samples = aa->getSamples();
+		result.gpuMs = ns / 1.0e6 / frames;
+		result.meanError = sum / image.size();
+		result.edgeError = numEdges ? edgeSum / numEdges : 0.0;
+		results.push_back(result);
+		CI_LOG_I("aa benchmark " << aa->getModeName() << " " << result.gpuMs << "ms error " << result.meanError << " edges " << result.edgeError);
+	}
+	glDeleteQueries(1, &query);
+	return results;
+}
@@ -0,0 +1,245 @@
+#include "SkyAutomation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SKY_AUTOMATION_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+	struct FileHeader {
+		uint32_t	magic;
+		uint32_t	version;
+		uint32_t	numCurves;
+		uint32_t	numKeys;
+	};
+
+	// eased(t) = c1 t + c2 t^2 + c3 t^3, by SkyAutomation::Ease
+	const float kEaseCoefficients[][3] = {
+		{ 0.0f, 0.0f, 0.0f },		// STEP
+		{ 1.0f, 0.0f, 0.0f },		// LINEAR
+		{ 0.0f, 3.0f, -2.0f },		// SMOOTH
+		{ 0.0f, 1.0f, 0.0f },		// IN
+		{ 2.0f, -1.0f, 0.0f },		// OUT
+	};
+	const size_t kNumEases = sizeof(kEaseCoefficients) / sizeof(kEaseCoefficients[0]);
+
+	template<typename T>
+	bool writeArray(FILE *file, const vector<T> &values)
+	{
+		return values.empty() || fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+	}
+
+	template<typename T>
+	bool readArray(FILE *file, vector<T> &values, size_t count)
+	{
+		values.resize(count);
+		return count == 0 || fread(values.data(), sizeof(T), count, file) == count;
+	}
+}
+
+size_t SkyAutomation::addCurve(int target, vector<Key> keys, float loopBeats)
+{
+	if (keys.empty()) keys.push_back(Key());
+	stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) { return a.beat < b.beat; });
+	mTargets.push_back(target);
+	mFirstKey.push_back((uint32_t)mKeyBeats.size());
+	mNumKeys.push_back((uint32_t)keys.size());
+	mLoopBeats.push_back(max(0.0f, loopBeats));
+	mCursors.push_back(0);
+	for (const auto &key : keys) {
+		mKeyBeats.push_back(key.beat);
+		mKeyValues.push_back(key.value);
+		mKeyEases.push_back((uint8_t)key.ease);
+	}
+	return mTargets.size() - 1;
+}
+
+void SkyAutomation::clear()
+{
+	mTargets.clear();
+	mFirstKey.clear();
+	mNumKeys.clear();
+	mLoopBeats.clear();
+	mCursors.clear();
+	mKeyBeats.clear();
+	mKeyValues.clear();
+	mKeyEases.clear();
+}
+
+float SkyAutomation::getLength() const
+{
+	float length = 0.0f;
+	for (size_t c = 0; c < mTargets.size(); c++) {
+		if (mLoopBeats[c] > 0.0f) continue;
+		length = max(length, mKeyBeats[mFirstKey[c] + mNumKeys[c] - 1]);
+	}
+	return length;
+}
+
+void SkyAutomation::evaluate(double beat)
+{
+	gather(beat);
+	if (mSimd) interpolateSimd();
+	else interpolateScalar();
+}
+
+void SkyAutomation::gather(double beat)
+{
+	const size_t numCurves = mTargets.size();
+	const size_t padded = (numCurves + 3) & ~(size_t)3;
+	if (mValues.size() != padded) {
+		for (auto *lanes : { &mFrom, &mTo, &mT, &mC1, &mC2, &mC3, &mValues }) lanes->assign(padded, 0.0f);
+	}
+	for (size_t c = 0; c < numCurves; c++) {
+		const uint32_t n = mNumKeys[c];
+		const float *beats = mKeyBeats.data() + mFirstKey[c];
+		const float *values = mKeyValues.data() + mFirstKey[c];
+		const double loop = mLoopBeats[c];
+		double local = beat;
+		if (loop > 0.0) {
+			local = fmod(beat, loop);
+			if (local < 0.0) local += loop;
+		}
+		const float b = (float)local;
+
+		// playback moves forward, so the cursor rarely advances more than one key
+		uint32_t k = mCursors[c];
+		if (k >= n || beats[k] > b) k = 0;
+		while (k + 1 < n && beats[k + 1] <= b) k++;
+		mCursors[c] = k;
+
+		mFrom[c] = values[k];
+		if (b < beats[0] || k + 1 == n) {
+			// before the first key or after the last, hold
+			mTo[c] = values[k];
+			mT[c] = 0.0f;
+			mC1[c] = mC2[c] = mC3[c] = 0.0f;
+			continue;
+		}
+		const uint8_t ease = mKeyEases[mFirstKey[c] + k];
+		const float *coefficients = kEaseCoefficients[ease < kNumEases ? ease : 1];
+		mTo[c] = values[k + 1];
+		mT[c] = (b - beats[k]) / (beats[k + 1] - beats[k]);
+		mC1[c] = coefficients[0];
+		mC2[c] = coefficients[1];
+		mC3[c] = coefficients[2];
+	}
+}
+
+void SkyAutomation::interpolateSimd()
+{
+#if defined(SKY_AUTOMATION_SSE)
+	const size_t padded = mValues.size();
+	for (size_t i = 0; i < padded; i += 4) {
+		__m128 t = _mm_loadu_ps(&mT[i]);
+		__m128 eased = _mm_mul_ps(t, _mm_add_ps(_mm_loadu_ps(&mC1[i]), _mm_mul_ps(t, _mm_add_ps(_mm_loadu_ps(&mC2[i]), _mm_mul_ps(t, _mm_loadu_ps(&mC3[i]))))));
+		__m128 from = _mm_loadu_ps(&mFrom[i]);
+		__m128 value = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&mTo[i]), from), eased));
+		_mm_storeu_ps(&mValues[i], value);
+	}
+#else
+	interpolateScalar();
+#endif
+}
+
+void SkyAutomation::interpolateScalar()
+{
+	const size_t padded = mValues.size();
+	for (size_t i = 0; i < padded; i++) {
+		const float t = mT[i];
+		const float eased = t * (mC1[i] + t * (mC2[i] + t * mC3[i]));
+		mValues[i] = mFrom[i] + (mTo[i] - mFrom[i]) * eased;
+	}
+}
+
+bool SkyAutomation::save(const string &path) const
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	FileHeader header = { kMagic, kVersion, (uint32_t)mTargets.size(), (uint32_t)mKeyBeats.size() };
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& writeArray(file, mTargets) && writeArray(file, mFirstKey) && writeArray(file, mNumKeys) && writeArray(file, mLoopBeats)
+		&& writeArray(file, mKeyBeats) && writeArray(file, mKeyValues) && writeArray(file, mKeyEases);
+	return fclose(file) == 0 && ok;
+}
+
+SkyAutomationRef SkyAutomation::load(const string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) return nullptr;
+	SkyAutomationRef automation(new SkyAutomation());
+	FileHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == kMagic && header.version == kVersion
+		&& readArray(file, automation->mTargets, header.numCurves) && readArray(file, automation->mFirstKey, header.numCurves)
+		&& readArray(file, automation->mNumKeys, header.numCurves) && readArray(file, automation->mLoopBeats, header.numCurves)
+		&& readArray(file, automation->mKeyBeats, header.numKeys) && readArray(file, automation->mKeyValues, header.numKeys)
+		&& readArray(file, automation->mKeyEases, header.numKeys);
+	fclose(file);
+	if (!ok) return nullptr;
+	// every curve owns the next run of keys
+	uint32_t next = 0;
+	for (uint32_t c = 0; c < header.numCurves; c++) {
+		if (automation->mFirstKey[c] != next || automation->mNumKeys[c] == 0) return nullptr;
+		next += automation->mNumKeys[c];
+	}
+	if (next != header.numKeys) return nullptr;
+	automation->mCursors.assign(header.numCurves, 0);
+	return automation;
+}
+
+SkyAutomation::BenchmarkResults SkyAutomation::benchmark(size_t numCurves, size_t keysPerCurve, int frames)
+{
+	typedef chrono::steady_clock Clock;
+	auto automation = create();
+	mt19937 random(1);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (size_t c = 0; c < numCurves; c++) {
+		vector<Key> keys(keysPerCurve);
+		for (size_t k = 0; k < keysPerCurve; k++) {
+			keys[k].beat = (float)k * 2.0f + unit(random);
+			keys[k].value = unit(random);
+			keys[k].ease = (Ease)(random() % kNumEases);
+		}
+		automation->addCurve((int)c, keys, c % 2 ? keysPerCurve * 2.0f : 0.0f);
+	}
+
+	BenchmarkResults results;
+	results.curves = numCurves;
+	results.keys = automation->getNumKeys();
+	// 120 bpm at 60 fps
+	const double beatsPerFrame = 2.0 / 60.0;
+	double gather = 0.0, simd = 0.0, scalar = 0.0;
+	vector<float> simdValues(numCurves);
+	for (int frame = 0; frame < frames; frame++) {
+		const double beat = frame * beatsPerFrame;
+		auto start = Clock::now();
+		automation->gather(beat);
+		auto gathered = Clock::now();
+		automation->interpolateSimd();
+		auto interpolated = Clock::now();
+		copy(automation->mValues.begin(), automation->mValues.begin() + numCurves, simdValues.begin());
+		auto scalarStart = Clock::now();
+		automation->interpolateScalar();
+		auto scalarEnd = Clock::now();
+
+		gather += chrono::duration<double, nano>(gathered - start).count();
+		simd += chrono::duration<double, nano>(interpolated - gathered).count();
+		scalar += chrono::duration<double, nano>(scalarEnd - scalarStart).count();
+		for (size_t c = 0; c < numCurves; c++) {
+			results.maxError = max(results.maxError, fabs(simdValues[c] - automation->mValues[c]));
+		}
+	}
+	const double samples = (double)frames * max<size_t>(1, numCurves);
+	results.gatherNs = gather / samples;
+	results.simdNs = simd / samples;
+	results.scalarNs = scalar / samples;
+	return results;
+}
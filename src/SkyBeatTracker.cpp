@@ -0,0 +1,286 @@
+#include "SkyBeatTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+	// crossover frequencies for the low / mid / high onset bands
+	const float kLowCutoff = 150.0f;
+	const float kMidCutoff = 2000.0f;
+	// kick drums carry most of the tempo information in dance music
+	const float kBandWeight[3] = { 1.0f, 0.6f, 0.4f };
+	// tempo prior, log-gaussian centred on 120 bpm
+	const float kPriorCentre = 120.0f;
+	const float kPriorOctaves = 0.9f;
+	// seconds a different tempo must win before the tracker switches to it
+	const float kSwitchSeconds = 2.0f;
+	const float kLockSeconds = 1.0f;
+	const float kMinConfidence = 0.08f;
+	// phase locked loop gain and capture window, in fractions of a beat
+	const float kPhaseGain = 0.3f;
+	const float kCaptureWindow = 0.25f;
+	// beat pulse decay, 1/seconds
+	const float kPulseDecay = 10.0f;
+
+	int64_t nowNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+SkyBeatTracker::SkyBeatTracker(float sampleRate, const Format &format)
+	: mSampleRate(sampleRate), mHopSize(std::max<size_t>(format.mHopSize, 64))
+{
+	mHopRate = mSampleRate / (float)mHopSize;
+	mLowCoef = 1.0f - std::exp(-2.0f * kPi * kLowCutoff / mSampleRate);
+	mMidCoef = 1.0f - std::exp(-2.0f * kPi * kMidCutoff / mSampleRate);
+
+	mMinLag = std::max<size_t>(2, (size_t)std::floor(60.0f * mHopRate / format.mMaxBpm));
+	mMaxLag = std::max<size_t>(mMinLag + 2, (size_t)std::ceil(60.0f * mHopRate / format.mMinBpm));
+	// the autocorrelation also covers twice the slowest period to reinforce the beat against its half tempo
+	size_t historyHops = std::max<size_t>((size_t)(format.mHistorySeconds * mHopRate), 2 * mMaxLag + 4);
+	mOnsets.assign(historyHops, 0.0f);
+	mAcf.assign(2 * mMaxLag + 2, 0.0f);
+	mPrior.assign(mMaxLag + 2, 0.0f);
+	for (size_t lag = mMinLag; lag <= mMaxLag + 1; lag++) {
+		float octaves = std::log2(lagToBpm((float)lag) / kPriorCentre) / kPriorOctaves;
+		mPrior[lag] = std::exp(-0.5f * octaves * octaves);
+	}
+}
+
+void SkyBeatTracker::reset()
+{
+	mLowState = mMidState = 0.0f;
+	std::fill(std::begin(mBandEnergy), std::end(mBandEnergy), 0.0f);
+	std::fill(std::begin(mPrevBandLog), std::end(mPrevBandLog), 0.0f);
+	mHopFill = 0;
+	std::fill(mOnsets.begin(), mOnsets.end(), 0.0f);
+	std::fill(mAcf.begin(), mAcf.end(), 0.0f);
+	mHop = 0;
+	mOnsetMean = mOnsetVar = 0.0f;
+	mPeriod = mCandidatePeriod = 0.0f;
+	mCandidateHops = 0;
+	mConfidence = 0.0f;
+	mNextBeat = 0.0;
+	mLastBeat = -1.0;
+	mPublishedBpm = 0.0f;
+	mPublishedConfidence = 0.0f;
+	mPublishedBeatAge = 0.0;
+}
+
+float SkyBeatTracker::lagToBpm(float lag) const
+{
+	return lag > 0.0f ? 60.0f * mHopRate / lag : 0.0f;
+}
+
+float SkyBeatTracker::getAnalysisLatencyMs() const
+{
+	// half a hop of averaging in the band energies, plus one hop of look-ahead for peak picking
+	return 1.5f * 1000.0f / mHopRate;
+}
+
+void SkyBeatTracker::process(const float *samples, size_t numFrames)
+{
+	for (size_t i = 0; i < numFrames; i++) {
+		float x = samples[i];
+		mLowState += mLowCoef * (x - mLowState);
+		mMidState += mMidCoef * (x - mMidState);
+		float low = mLowState;
+		float mid = mMidState - mLowState;
+		float high = x - mMidState;
+		mBandEnergy[0] += low * low;
+		mBandEnergy[1] += mid * mid;
+		mBandEnergy[2] += high * high;
+		if (++mHopFill == mHopSize) {
+			processHop();
+			mHopFill = 0;
+		}
+	}
+}
+
+void SkyBeatTracker::processHop()
+{
+	// half-wave rectified log energy flux, summed over the bands
+	float flux = 0.0f;
+	for (int b = 0; b < 3; b++) {
+		float level = std::log1p(1000.0f * mBandEnergy[b] / (float)mHopSize);
+		flux += kBandWeight[b] * std::max(0.0f, level - mPrevBandLog[b]);
+		mPrevBandLog[b] = level;
+		mBandEnergy[b] = 0.0f;
+	}
+	// remove the slowly varying mean so the autocorrelation is not dominated by loudness
+	float alpha = 1.0f / (2.0f * mHopRate);
+	mOnsetMean += alpha * (flux - mOnsetMean);
+	float centred = flux - mOnsetMean;
+	mOnsetVar += alpha * (centred * centred - mOnsetVar);
+
+	const size_t size = mOnsets.size();
+	mOnsets[mHop % size] = centred;
+
+	float decay = 1.0f - 1.0f / (float)size;
+	mAcf[0] = mAcf[0] * decay + centred * centred;
+	size_t maxLag = std::min<size_t>(mAcf.size() - 1, (size_t)mHop);
+	for (size_t lag = mMinLag; lag <= maxLag; lag++) {
+		mAcf[lag] = mAcf[lag] * decay + centred * mOnsets[(mHop - lag) % size];
+	}
+	mHop++;
+
+	updateTempo();
+	updatePhase();
+	publish();
+}
+
+void SkyBeatTracker::updateTempo()
+{
+	if (mHop < 2 * mMaxLag) return;
+
+	size_t best = 0;
+	float bestScore = 0.0f;
+	for (size_t lag = mMinLag; lag <= mMaxLag; lag++) {
+		float score = mPrior[lag] * (mAcf[lag] + 0.5f * mAcf[2 * lag]);
+		if (score > bestScore) {
+			bestScore = score;
+			best = lag;
+		}
+	}
+	if (best == 0 || mAcf[0] <= 0.0f) return;
+
+	// parabolic interpolation around the peak for a fractional period
+	float period = (float)best;
+	float a = mAcf[best - 1], b = mAcf[best], c = mAcf[best + 1];
+	float denom = a - 2.0f * b + c;
+	if (denom < 0.0f) period += std::max(-0.5f, std::min(0.5f, 0.5f * (a - c) / denom));
+	mConfidence = std::max(0.0f, std::min(1.0f, b / mAcf[0]));
+	if (mConfidence < kMinConfidence) return;
+
+	if (mPeriod > 0.0f && std::abs(period - mPeriod) < 0.04f * mPeriod) {
+		// same tempo, follow small drifts smoothly
+		mPeriod += 0.05f * (period - mPeriod);
+		mCandidateHops = 0;
+		return;
+	}
+	// a different tempo has to win for a while before we switch, so one fill does not move the phase
+	if (mCandidatePeriod > 0.0f && std::abs(period - mCandidatePeriod) < 0.04f * mCandidatePeriod) {
+		mCandidatePeriod += 0.2f * (period - mCandidatePeriod);
+		mCandidateHops++;
+	}
+	else {
+		mCandidatePeriod = period;
+		mCandidateHops = 0;
+	}
+	float needed = (mPeriod > 0.0f ? kSwitchSeconds : kLockSeconds) * mHopRate;
+	if ((float)mCandidateHops >= needed) {
+		mPeriod = mCandidatePeriod;
+		mCandidateHops = 0;
+		alignPhase();
+	}
+}
+
+void SkyBeatTracker::alignPhase()
+{
+	// comb over the last few periods of the onset history, the strongest offset is the beat grid
+	const size_t size = mOnsets.size();
+	const int combs = std::min<int>(4, (int)(size / (size_t)std::ceil(mPeriod)) - 1);
+	int span = (int)std::ceil(mPeriod);
+	int bestOffset = 0;
+	float bestSum = -1e30f;
+	for (int offset = 0; offset < span; offset++) {
+		float sum = 0.0f;
+		for (int k = 0; k < combs; k++) {
+			uint64_t back = (uint64_t)offset + (uint64_t)std::lround(k * mPeriod) + 1;
+			if (back > mHop) break;
+			sum += mOnsets[(mHop - back) % size];
+		}
+		if (sum > bestSum) {
+			bestSum = sum;
+			bestOffset = offset;
+		}
+	}
+	mLastBeat = (double)mHop - 1.0 - (double)bestOffset;
+	mNextBeat = mLastBeat + mPeriod;
+}
+
+void SkyBeatTracker::updatePhase()
+{
+	if (mPeriod <= 0.0f || mHop < 3) return;
+
+	const size_t size = mOnsets.size();
+	uint64_t t = mHop - 1;
+	float current = mOnsets[t % size];
+	float peak = mOnsets[(t - 1) % size];
+	float before = mOnsets[(t - 2) % size];
+	// an onset one hop back pulls the nearest predicted beat towards it
+	if (peak > before && peak >= current && peak > 1.5f * std::sqrt(std::max(mOnsetVar, 0.0f))) {
+		double onset = (double)(t - 1);
+		double nearest = (mLastBeat >= 0.0 && onset - mLastBeat < mNextBeat - onset) ? mLastBeat : mNextBeat;
+		double error = onset - nearest;
+		if (std::abs(error) < kCaptureWindow * mPeriod) {
+			mNextBeat += kPhaseGain * error;
+			if (mLastBeat >= 0.0) mLastBeat += kPhaseGain * error;
+		}
+	}
+	while ((double)t >= mNextBeat) {
+		mLastBeat = mNextBeat;
+		mNextBeat += mPeriod;
+		if (mBeatLog) mBeatLog->push_back(mLastBeat / mHopRate);
+	}
+}
+
+void SkyBeatTracker::publish()
+{
+	if (mPeriod <= 0.0f || mLastBeat < 0.0) return;
+	mPublishedBeatAge.store(((double)mHop - mLastBeat) / mHopRate, std::memory_order_relaxed);
+	mPublishedConfidence.store(mConfidence, std::memory_order_relaxed);
+	mPublishedAt.store(nowNanoseconds(), std::memory_order_relaxed);
+	mPublishedBpm.store(lagToBpm(mPeriod), std::memory_order_release);
+}
+
+SkyBeatTracker::State SkyBeatTracker::getState()
+{
+	State state;
+	state.bpm = mPublishedBpm.load(std::memory_order_acquire);
+	if (state.bpm <= 0.0f) {
+		state.latencyMs = getAnalysisLatencyMs();
+		return state;
+	}
+	double handOff = (double)(nowNanoseconds() - mPublishedAt.load(std::memory_order_relaxed)) * 1e-9;
+	double age = mPublishedBeatAge.load(std::memory_order_relaxed) + handOff;
+	double beatLength = 60.0 / state.bpm;
+	double inBeat = std::fmod(age, beatLength);
+
+	state.phase = (float)(inBeat / beatLength);
+	state.pulse = std::exp(-kPulseDecay * (float)inBeat);
+	state.confidence = mPublishedConfidence.load(std::memory_order_relaxed);
+	state.locked = true;
+	// the hand-off is measured against the audio callback, so it includes the time spent waiting for the next frame
+	mHandOffMs += 0.05f * ((float)(handOff * 1000.0) - mHandOffMs);
+	state.latencyMs = getAnalysisLatencyMs() + mHandOffMs;
+	return state;
+}
+
+SkyBeatTracker::Analysis SkyBeatTracker::analyze(const float *samples, size_t numFrames, float sampleRate, const Format &format)
+{
+	Analysis analysis;
+	SkyBeatTracker tracker(sampleRate, format);
+	tracker.mBeatLog = &analysis.beatTimes;
+	const size_t blockSize = 512;
+	for (size_t i = 0; i < numFrames; i += blockSize) {
+		tracker.process(samples + i, std::min(blockSize, numFrames - i));
+	}
+	analysis.bpm = tracker.lagToBpm(tracker.mPeriod);
+	analysis.confidence = tracker.mConfidence;
+	return analysis;
+}
+
+SkyBeatTracker::Check SkyBeatTracker::check(const Analysis &analysis, float expectedBpm, float toleranceBpm)
+{
+	Check check;
+	check.errorBpm = analysis.bpm - expectedBpm;
+	check.passed = analysis.bpm > 0.0f && std::fabs(check.errorBpm) <= toleranceBpm;
+	// the usual way to get the tempo wrong, within 3% of half or double, reported as such rather than as a large error
+	const float ratio = expectedBpm > 0.0f ? analysis.bpm / expectedBpm : 0.0f;
+	check.octave = std::fabs(ratio - 0.5f) < 0.015f || std::fabs(ratio - 2.0f) < 0.06f;
+	return check;
+}
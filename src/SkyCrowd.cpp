@@ -0,0 +1,199 @@
+#include "SkyCrowd.h"
+
+#include "cinder/Log.h"
+
+#include <chrono>
+#include <random>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SKY_CROWD_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	const float kBobFrequency = 1.3f;
+	const float kSpacing = 3.0f;
+
+#if SKY_CROWD_SSE
+	// parabolic sine, about 0.001 absolute error, four lanes at a time
+	inline __m128 sin4(__m128 x)
+	{
+		const __m128 twoPi = _mm_set1_ps(6.28318531f);
+		const __m128 invTwoPi = _mm_set1_ps(0.159154943f);
+		x = _mm_sub_ps(x, _mm_mul_ps(twoPi, _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, invTwoPi)))));
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.27323954f), x), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-0.405284735f), x), _mm_and_ps(x, absMask)));
+		return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, _mm_and_ps(y, absMask)), y)), y);
+	}
+#endif
+}
+
+SkyCrowd::SkyCrowd(size_t count)
+{
+	setCount(count);
+}
+
+void SkyCrowd::setCount(size_t count)
+{
+	mCount = std::max<size_t>(1, count);
+	size_t padded = (mCount + 3) & ~(size_t)3;
+	for (auto *array : { &mX, &mY, &mZ, &mAxisX, &mAxisY, &mAxisZ, &mPhase, &mSpin, &mBob, &mScale }) {
+		array->assign(padded, 0.0f);
+	}
+	mColors.assign(padded, vec4(1.0f));
+
+	// sunflower spiral, evenly spread over a disc whatever the count
+	mt19937 rng(1);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const vec3 palette[] = { vec3(0.5f, 0.2f, 1.0f), vec3(1.0f, 0.3f, 0.6f), vec3(0.2f, 0.6f, 1.0f) };
+	for (size_t i = 0; i < mCount; i++) {
+		float r = kSpacing * sqrtf((float)i + 0.5f);
+		float theta = i * 2.39996323f;
+		mX[i] = r * cosf(theta);
+		mZ[i] = r * sinf(theta);
+		mY[i] = (unit(rng) - 0.5f) * kSpacing;
+		vec3 axis = normalize(vec3(unit(rng), unit(rng), unit(rng)) - vec3(0.5f) + vec3(0.0f, 0.01f, 0.0f));
+		mAxisX[i] = axis.x;
+		mAxisY[i] = axis.y;
+		mAxisZ[i] = axis.z;
+		mPhase[i] = unit(rng) * 6.2831853f;
+		mSpin[i] = 0.2f + unit(rng) * 0.8f;
+		mBob[i] = 0.2f + unit(rng) * 0.6f;
+		mScale[i] = 0.6f + unit(rng) * 0.4f;
+		mColors[i] = vec4(mix(palette[i % 3], palette[(i + 1) % 3], unit(rng)), 1.0f);
+	}
+	mRadius = kSpacing * sqrtf((float)mCount);
+	mVisible.reserve(mCount);
+
+	size_t bytes = mCount * sizeof(Instance);
+	if (!mSsbo || mSsbo->getSize() < bytes) mSsbo = gl::Ssbo::create(bytes, nullptr, GL_DYNAMIC_DRAW);
+	mStats.count = mCount;
+	CI_LOG_I("crowd of " << mCount << " instances, radius " << mRadius);
+}
+
+CameraPersp SkyCrowd::getCamera(float aspect, double time) const
+{
+	// slow orbit, high enough to see the far side of the field
+	float angle = (float)time * 0.05f;
+	float distance = mRadius * 1.2f + 6.0f;
+	CameraPersp cam(640, (int)(640 / aspect), 60.0f, 0.5f, mRadius * 4.0f + 20.0f);
+	cam.lookAt(vec3(sinf(angle) * distance, mRadius * 0.5f + 4.0f, cosf(angle) * distance), vec3(0.0f));
+	return cam;
+}
+
+void SkyCrowd::update(double time, const mat4 &viewProjection)
+{
+	auto start = chrono::steady_clock::now();
+
+	// frustum planes from the rows of the view projection, normalized so distances are in world units
+	vec4 planes[6];
+	const vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	const vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	const vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	const vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+	for (auto &plane : planes) plane /= length(vec3(plane));
+
+	mVisible.clear();
+	// wrapped so the single precision phase keeps its resolution during long shows
+	const float t = (float)fmod(time, 3600.0);
+	for (size_t first = 0; first < mCount; first += 4) {
+		animate(first, t, planes);
+	}
+	auto packed = chrono::steady_clock::now();
+
+	// orphan the buffer so the driver does not wait for the previous frame's draw
+	if (!mVisible.empty()) {
+		mSsbo->bufferData(mSsbo->getSize(), nullptr, GL_DYNAMIC_DRAW);
+		mSsbo->bufferSubData(0, mVisible.size() * sizeof(Instance), mVisible.data());
+	}
+	auto uploaded = chrono::steady_clock::now();
+
+	mStats.visible = mVisible.size();
+	mStats.updateMs = chrono::duration<double, milli>(packed - start).count();
+	mStats.uploadMs = chrono::duration<double, milli>(uploaded - packed).count();
+}
+
+void SkyCrowd::animate(size_t first, float time, const vec4 planes[6])
+{
+#if SKY_CROWD_SSE
+	const __m128 t = _mm_set1_ps(time);
+	const __m128 phase = _mm_loadu_ps(&mPhase[first]);
+	const __m128 angle = _mm_add_ps(_mm_mul_ps(t, _mm_loadu_ps(&mSpin[first])), phase);
+	const __m128 sinAngle = sin4(angle);
+	const __m128 cosAngle = sin4(_mm_add_ps(angle, _mm_set1_ps(1.57079633f)));
+	const __m128 bob = _mm_mul_ps(_mm_loadu_ps(&mBob[first]), sin4(_mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(kBobFrequency)), phase)));
+	const __m128 x = _mm_loadu_ps(&mX[first]);
+	const __m128 y = _mm_add_ps(_mm_loadu_ps(&mY[first]), bob);
+	const __m128 z = _mm_loadu_ps(&mZ[first]);
+	// the shaders project every vertex onto the unit sphere, so the bound is the scale
+	const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&mScale[first]));
+
+	__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int i = 0; i < 6; i++) {
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[i].x)), _mm_mul_ps(y, _mm_set1_ps(planes[i].y))),
+			_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[i].z)), _mm_set1_ps(planes[i].w)));
+		inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+	}
+	int mask = _mm_movemask_ps(inside);
+	if (!mask) return;
+
+	alignas(16) float s[4], c[4], py[4];
+	_mm_store_ps(s, sinAngle);
+	_mm_store_ps(c, cosAngle);
+	_mm_store_ps(py, y);
+	for (int lane = 0; lane < 4 && first + lane < mCount; lane++) {
+		if (mask & (1 << lane)) pack(first + lane, s[lane], c[lane], py[lane]);
+	}
+#else
+	for (size_t i = first; i < first + 4 && i < mCount; i++) {
+		float angle = time * mSpin[i] + mPhase[i];
+		float y = mY[i] + mBob[i] * sinf(time * kBobFrequency + mPhase[i]);
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			inside = planes[p].x * mX[i] + planes[p].y * y + planes[p].z * mZ[i] + planes[p].w > -mScale[i];
+		}
+		if (inside) pack(i, sinf(angle), cosf(angle), y);
+	}
+#endif
+}
+
+void SkyCrowd::pack(size_t i, float s, float c, float y)
+{
+	// axis angle rotation, uniform scale and translation, column major
+	const float kx = mAxisX[i], ky = mAxisY[i], kz = mAxisZ[i];
+	const float k = 1.0f - c;
+	const float scale = mScale[i];
+	mVisible.emplace_back();
+	Instance &instance = mVisible.back();
+	mat4 &m = instance.model;
+	m[0] = vec4(scale * (c + kx * kx * k), scale * (ky * kx * k + kz * s), scale * (kz * kx * k - ky * s), 0.0f);
+	m[1] = vec4(scale * (kx * ky * k - kz * s), scale * (c + ky * ky * k), scale * (kz * ky * k + kx * s), 0.0f);
+	m[2] = vec4(scale * (kx * kz * k + ky * s), scale * (ky * kz * k - kx * s), scale * (c + kz * kz * k), 0.0f);
+	m[3] = vec4(mX[i], y, mZ[i], 1.0f);
+	instance.color = mColors[i];
+}
+
+void SkyCrowd::draw(const gl::BatchRef &batch)
+{
+	if (mVisible.empty()) return;
+
+	gl::ScopedVao scopedVao(batch->getVao().get());
+	gl::ScopedGlslProg scopedShader(batch->getGlslProg());
+	mSsbo->bindBase(0);
+	gl::context()->setDefaultShaderVars();
+
+	const auto &mesh = batch->getVboMesh();
+	if (mesh->getNumIndices())
+		glDrawElementsInstanced(GL_PATCHES, mesh->getNumIndices(), mesh->getIndexDataType(), (GLvoid*)(0), (GLsizei)mVisible.size());
+	else
+		glDrawArraysInstanced(GL_PATCHES, 0, mesh->getNumVertices(), (GLsizei)mVisible.size());
+}
@@ -0,0 +1,308 @@
+#include "SkyDropIngest.h"
+
+#include "cinder/ImageIo.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	const size_t kPageSize = 4096;
+	const size_t kProgressStep = 1 << 20;
+
+	inline double nowSeconds()
+	{
+		return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// read only view of a whole file, unmapped when it goes out of scope
+	class MappedFile {
+	public:
+		explicit MappedFile(const fs::path &path)
+		{
+#if defined( _WIN32 )
+			mFile = ::CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (mFile == INVALID_HANDLE_VALUE) return;
+			LARGE_INTEGER size;
+			if (!::GetFileSizeEx(mFile, &size) || size.QuadPart == 0) return;
+			mMapping = ::CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mMapping) return;
+			mData = (const uint8_t*)::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+			if (mData) mSize = (size_t)size.QuadPart;
+#else
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			struct stat info;
+			if (fstat(fd, &info) == 0 && info.st_size > 0) {
+				void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED) {
+					madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+					mData = (const uint8_t*)data;
+					mSize = (size_t)info.st_size;
+				}
+			}
+			close(fd);
+#endif
+		}
+		~MappedFile()
+		{
+#if defined( _WIN32 )
+			if (mData) ::UnmapViewOfFile(mData);
+			if (mMapping) ::CloseHandle(mMapping);
+			if (mFile != INVALID_HANDLE_VALUE) ::CloseHandle(mFile);
+#else
+			if (mData) munmap((void*)mData, mSize);
+#endif
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t*	getData() const { return mData; }
+		size_t			getSize() const { return mSize; }
+	private:
+#if defined( _WIN32 )
+		HANDLE			mFile = INVALID_HANDLE_VALUE;
+		HANDLE			mMapping = nullptr;
+#endif
+		const uint8_t	*mData = nullptr;
+		size_t			mSize = 0;
+	};
+}
+
+SkyDropIngest::SkyDropIngest(const SkyGpuUploaderRef &uploader, const SkyShaderCacheRef &shaderCache, const Format &format)
+	: mUploader(uploader), mShaderCache(shaderCache), mFormat(format)
+{
+	for (size_t i = 0; i < mFormat.mNumThreads || i == 0; i++) {
+		mThreads.emplace_back(&SkyDropIngest::workerFn, this);
+	}
+}
+
+SkyDropIngest::~SkyDropIngest()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for (auto &worker : mThreads) worker.join();
+}
+
+SkyDropIngest::Kind SkyDropIngest::classify(const fs::path &path)
+{
+	if (fs::is_directory(path)) return Kind::FOLDER;
+	string ext = path.extension().string();
+	for (auto &c : ext) c = (char)tolower(c);
+	if (ext == ".fs" || ext == ".frag" || ext == ".glsl") return Kind::SHADER;
+	if (ext == ".jpg" || ext == ".jpeg" || ext == ".png") return Kind::IMAGE;
+	if (ext == ".y4m") return Kind::VIDEO;
+	if (ext == ".skya") return Kind::AUTOMATION;
+	return Kind::OTHER;
+}
+
+const char* SkyDropIngest::getStageName(Stage stage)
+{
+	switch (stage) {
+	case Stage::QUEUED: return "queued";
+	case Stage::READING: return "reading";
+	case Stage::PARSING: return "parsing";
+	case Stage::DECODING: return "decoding";
+	case Stage::COMPILING: return "compiling";
+	case Stage::UPLOADING: return "uploading";
+	case Stage::READY: return "ready";
+	default: return "failed";
+	}
+}
+
+void SkyDropIngest::add(const fs::path &path)
+{
+	auto item = make_shared<Item>();
+	item->path = path;
+	item->kind = classify(path);
+	item->startTime = nowSeconds();
+	mPending.push_back(item);
+	mStats.queued++;
+	if (item->kind == Kind::OTHER) {
+		complete(item, Stage::READY);
+		return;
+	}
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQueue.push_back(item);
+	}
+	mCondition.notify_one();
+}
+
+vector<SkyDropIngest::ItemRef> SkyDropIngest::poll()
+{
+	deque<ItemRef> completed;
+	{
+		lock_guard<mutex> lock(mMutex);
+		completed.swap(mCompleted);
+	}
+	vector<ItemRef> items(completed.begin(), completed.end());
+	for (const auto &item : items) {
+		mPending.erase(remove(mPending.begin(), mPending.end(), item), mPending.end());
+		if (item->stage == Stage::READY) mStats.ready++;
+		else mStats.failed++;
+		mStats.bytesRead += item->bytes;
+		item->totalMs = (nowSeconds() - item->startTime) * 1000.0;
+		mStats.lastMs = item->totalMs;
+	}
+	return items;
+}
+
+void SkyDropIngest::complete(const ItemRef &item, Stage stage)
+{
+	item->progress = 1.0f;
+	item->stage = stage;
+	lock_guard<mutex> lock(mMutex);
+	mCompleted.push_back(item);
+}
+
+void SkyDropIngest::workerFn()
+{
+	while (true) {
+		ItemRef item;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return !mRunning || !mQueue.empty(); });
+			if (!mRunning) return;
+			item = mQueue.front();
+			mQueue.pop_front();
+		}
+		try {
+			ingest(item);
+		}
+		catch (const std::exception &exc) {
+			CI_LOG_EXCEPTION("ingesting " << item->path, exc);
+			complete(item, Stage::FAILED);
+		}
+	}
+}
+
+void SkyDropIngest::ingest(const ItemRef &item)
+{
+	item->stage = Stage::READING;
+	if (item->kind == Kind::FOLDER) {
+		ingestFolder(item);
+		return;
+	}
+	if (item->kind == Kind::AUTOMATION) {
+		// a few flat arrays, read in one go
+		item->stage = Stage::PARSING;
+		item->automation = SkyAutomation::load(item->path.string());
+		if (!item->automation) CI_LOG_E(item->path << " is not an automation cue");
+		complete(item, item->automation ? Stage::READY : Stage::FAILED);
+		return;
+	}
+	MappedFile file(item->path);
+	if (!file.getData()) {
+		CI_LOG_E("cannot map " << item->path);
+		complete(item, Stage::FAILED);
+		return;
+	}
+	item->bytes = file.getSize();
+	switch (item->kind) {
+	case Kind::SHADER:
+		prefault(item, file.getData(), file.getSize(), 0.0f, 0.2f);
+		ingestShader(item, file.getData(), file.getSize());
+		break;
+	case Kind::IMAGE:
+		prefault(item, file.getData(), file.getSize(), 0.0f, 0.4f);
+		ingestImage(item, file.getData(), file.getSize());
+		break;
+	default:
+		// the source reads its own frames, only the stream header is checked here
+		item->stage = Stage::PARSING;
+		if (file.getSize() > 10 && memcmp(file.getData(), "YUV4MPEG2 ", 10) == 0) {
+			complete(item, Stage::READY);
+		}
+		else {
+			CI_LOG_E(item->path << " is not a Y4M stream");
+			complete(item, Stage::FAILED);
+		}
+		break;
+	}
+}
+
+void SkyDropIngest::prefault(const ItemRef &item, const uint8_t *data, size_t size, float from, float to)
+{
+	volatile uint8_t sink = 0;
+	for (size_t offset = 0; offset < size; offset += kProgressStep) {
+		size_t end = size - offset > kProgressStep ? offset + kProgressStep : size;
+		for (size_t page = offset; page < end; page += kPageSize) sink ^= data[page];
+		item->progress = from + (to - from) * (float)end / (float)size;
+	}
+}
+
+void SkyDropIngest::ingestShader(const ItemRef &item, const uint8_t *data, size_t size)
+{
+	item->stage = Stage::PARSING;
+	auto generated = mShaderCache->preprocess(string((const char*)data, size));
+	item->progress = 0.4f;
+
+	SkyShaderProgramRef program;
+	if (mShaderCache->find(generated->hash, program)) {
+		item->program = program;
+		complete(item, program ? Stage::READY : Stage::FAILED);
+		return;
+	}
+	item->stage = Stage::COMPILING;
+	auto format = mShaderCache->getFormat(generated);
+	// a failed compile still completes the item, and is remembered by the cache
+	mUploader->submit(item->path.filename().string(), [format, generated] { return SkyShaderCache::compile(format, generated); },
+		[this, item, generated](const SkyShaderProgramRef &program) {
+		mShaderCache->insert(generated->hash, program);
+		item->program = program;
+		complete(item, program ? Stage::READY : Stage::FAILED);
+	});
+}
+
+void SkyDropIngest::ingestImage(const ItemRef &item, const uint8_t *data, size_t size)
+{
+	item->stage = Stage::DECODING;
+	// decoded straight from the mapping, always RGBA like the texture service
+	auto source = DataSourceBuffer::create(Buffer::create((void*)data, size));
+	auto surface = Surface8u::create(loadImage(source, ImageSource::Options(), item->path.extension().string().substr(1)), SurfaceConstraintsDefault(), true);
+	item->progress = 0.8f;
+
+	item->stage = Stage::UPLOADING;
+	auto format = mFormat.mTextureFormat;
+	mUploader->submit(item->path.filename().string(), [surface, format] {
+		gl::Texture2dRef texture;
+		try {
+			texture = gl::Texture2d::create(*surface, format);
+		}
+		catch (const std::exception &exc) {
+			CI_LOG_EXCEPTION("uploading", exc);
+		}
+		return texture;
+	}, [this, item](const gl::Texture2dRef &texture) {
+		item->texture = texture;
+		complete(item, texture ? Stage::READY : Stage::FAILED);
+	});
+}
+
+void SkyDropIngest::ingestFolder(const ItemRef &item)
+{
+	// only the listing, the texture service streams the images when they are shown
+	for (fs::directory_iterator it(item->path), end; it != end; ++it) {
+		if (classify(it->path()) == Kind::IMAGE) item->stills.push_back(it->path());
+	}
+	sort(item->stills.begin(), item->stills.end());
+	complete(item, Stage::READY);
+}
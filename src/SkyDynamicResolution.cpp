@@ -0,0 +1,122 @@
+#include "SkyDynamicResolution.h"
+
+#include "cinder/app/App.h"
+#include "cinder/Log.h"
+
+using namespace ci;
+using namespace std;
+
+SkyDynamicResolution::SkyDynamicResolution(const ivec2 &outputSize, const Format &format)
+	: mOutputSize(outputSize), mFormat(format)
+{
+	// evenly spaced scales, sizes rounded to 8 pixels
+	int levels = std::max(1, mFormat.mNumLevels);
+	for (int i = 0; i < levels; i++) {
+		float scale = levels > 1 ? 1.0f - (1.0f - mFormat.mMinScale) * i / (levels - 1) : 1.0f;
+		ivec2 size = glm::max(ivec2(8), (ivec2(vec2(mOutputSize) * scale) + 4) / 8 * 8);
+		mLevels.push_back(glm::min(size, mOutputSize));
+	}
+	glGenQueries(kNumQueries, mQueries);
+
+	mOutputFbo = gl::Fbo::create(mOutputSize.x, mOutputSize.y, gl::Fbo::Format().disableDepth().colorTexture());
+	try {
+		mUpscaleShader = gl::GlslProg::create(app::loadAsset("passthrough.vs"), app::loadAsset("upscale.fs.glsl"));
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("upscale shader", exc);
+	}
+}
+
+SkyDynamicResolution::~SkyDynamicResolution()
+{
+	glDeleteQueries(kNumQueries, mQueries);
+}
+
+void SkyDynamicResolution::setEnabled(bool enabled)
+{
+	mEnabled = enabled;
+	mLevel = 0;
+	mOverFrames = mUnderFrames = 0;
+	mCooldown = 0;
+	CI_LOG_I("dynamic resolution " << (mEnabled ? "on" : "off") << ", target " << mFormat.mTargetMilliseconds << "ms");
+}
+
+void SkyDynamicResolution::beginFrame()
+{
+	// every query in flight, skip timing this frame rather than stall
+	if (mQueryWrite - mQueryRead >= kNumQueries) return;
+	glBeginQuery(GL_TIME_ELAPSED, mQueries[mQueryWrite % kNumQueries]);
+}
+
+void SkyDynamicResolution::endFrame()
+{
+	if (mQueryWrite - mQueryRead < kNumQueries) {
+		glEndQuery(GL_TIME_ELAPSED);
+		mQueryWrite++;
+	}
+	// collect the finished queries without waiting
+	bool measured = false;
+	while (mQueryRead < mQueryWrite) {
+		GLuint query = mQueries[mQueryRead % kNumQueries];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		float ms = ns / 1.0e6f;
+		mGpuMs = mGpuMs > 0.0f ? mGpuMs * 0.8f + ms * 0.2f : ms;
+		mQueryRead++;
+		measured = true;
+	}
+	if (!mEnabled || !measured) return;
+
+	// a few frames over the target drops a level, a second well under it raises one
+	if (mCooldown > 0) {
+		mCooldown--;
+	}
+	else if (mGpuMs > mFormat.mTargetMilliseconds) {
+		mUnderFrames = 0;
+		if (++mOverFrames >= 4 && mLevel + 1 < (int)mLevels.size()) {
+			mLevel++;
+			mOverFrames = 0;
+			mCooldown = 15;
+		}
+	}
+	else if (mGpuMs < mFormat.mTargetMilliseconds * 0.75f) {
+		mOverFrames = 0;
+		if (++mUnderFrames >= 60 && mLevel > 0) {
+			mLevel--;
+			mUnderFrames = 0;
+			mCooldown = 15;
+		}
+	}
+	else {
+		mOverFrames = mUnderFrames = 0;
+	}
+
+	double now = app::getElapsedSeconds();
+	if (now - mLastLog >= 1.0) {
+		mLastLog = now;
+		CI_LOG_I("render " << getRenderSize().x << "x" << getRenderSize().y << " (" << (int)(getScale() * 100.0f + 0.5f) << "%) gpu " << mGpuMs << "ms");
+	}
+}
+
+gl::Texture2dRef SkyDynamicResolution::upscale(const gl::Texture2dRef &scene)
+{
+	if (!mUpscaleShader || getRenderSize() == scene->getSize()) return scene;
+
+	gl::ScopedFramebuffer scpFbo(mOutputFbo);
+	gl::ScopedViewport scpVp(ivec2(0), mOutputFbo->getSize());
+	gl::ScopedMatrices scpMtx;
+	gl::setMatricesWindow(mOutputFbo->getSize());
+	gl::ScopedDepth scpDepth(false);
+	gl::ScopedBlend scpBlend(false);
+	gl::ScopedGlslProg scpShader(mUpscaleShader);
+	gl::ScopedTextureBind scpTex(scene, 0);
+	mUpscaleShader->uniform("uTex", 0);
+	mUpscaleShader->uniform("uScale", vec2(getRenderSize()) / vec2(scene->getSize()));
+	mUpscaleShader->uniform("uInvSize", vec2(1.0f) / vec2(scene->getSize()));
+	mUpscaleShader->uniform("uSharpness", mFormat.mSharpness);
+	gl::drawSolidRect(mOutputFbo->getBounds(), vec2(0.0f, 1.0f), vec2(1.0f, 0.0f));
+	return mOutputFbo->getColorTexture();
+}
@@ -0,0 +1,217 @@
+#include "SkyFrameReceiver.h"
+
+#include "cinder/Log.h"
+
+#if defined( CINDER_MSW )
+#include "spout.h"
+#else
+#include "SkyShmFrame.h"
+#endif
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	const auto kTextureFormat = gl::Texture2d::Format().internalFormat(GL_RGBA8).loadTopDown();
+	const size_t kTexturesPerSize = 3;
+
+#if defined( CINDER_MSW )
+	class SpoutBackend : public SkyFrameReceiver::Backend {
+	public:
+		~SpoutBackend()
+		{
+			if (!mConnected.empty()) mReceiver.ReleaseReceiver();
+		}
+		vector<SkyFrameReceiver::SenderInfo> listSenders() override
+		{
+			// the active sender first, so an empty name follows it
+			vector<SkyFrameReceiver::SenderInfo> senders;
+			char active[SpoutMaxSenderNameLen] = { 0 };
+			mNames.GetActiveSender(active);
+			int count = mNames.GetSenderCount();
+			for (int i = 0; i < count; i++) {
+				char name[SpoutMaxSenderNameLen];
+				unsigned int width, height;
+				HANDLE handle;
+				if (!mNames.GetSenderNameInfo(i, name, SpoutMaxSenderNameLen, width, height, handle)) continue;
+				SkyFrameReceiver::SenderInfo info = { name, ivec2(width, height) };
+				if (strcmp(name, active) == 0) senders.insert(senders.begin(), info);
+				else senders.push_back(info);
+			}
+			return senders;
+		}
+		bool receive(const SkyFrameReceiver::SenderInfo &sender, SkyFrameReceiver::TexturePool &pool, gl::Texture2dRef &texture) override
+		{
+			unsigned int width = sender.size.x, height = sender.size.y;
+			if (sender.name != mConnected) {
+				// once per sender, discovery has already seen it
+				if (!mConnected.empty()) mReceiver.ReleaseReceiver();
+				mConnected.clear();
+				strncpy(mName, sender.name.c_str(), SpoutMaxSenderNameLen - 1);
+				if (!mReceiver.CreateReceiver(mName, width, height)) return false;
+				mConnected = sender.name;
+				mSize = ivec2(width, height);
+				CI_LOG_I("receiving " << mConnected << " " << mSize << (mReceiver.GetMemoryShareMode() ? " through memory share" : ""));
+			}
+			width = mSize.x;
+			height = mSize.y;
+			auto target = pool.acquire(mSize);
+			if (!mReceiver.ReceiveTexture(mName, width, height, target->getId(), target->getTarget())) {
+				mReceiver.ReleaseReceiver();
+				mConnected.clear();
+				return false;
+			}
+			if (ivec2(width, height) != mSize) {
+				// the sender was resized, the call above only reported the new size
+				mSize = ivec2(width, height);
+				target = pool.acquire(mSize);
+				if (!mReceiver.ReceiveTexture(mName, width, height, target->getId(), target->getTarget())) return false;
+			}
+			texture = target;
+			return true;
+		}
+	private:
+		spoutSenderNames	mNames;			// discovery thread
+		SpoutReceiver		mReceiver;		// render thread
+		char				mName[SpoutMaxSenderNameLen] = { 0 };
+		string				mConnected;
+		ivec2				mSize;
+	};
+	typedef SpoutBackend PlatformBackend;
+#else
+	class ShmBackend : public SkyFrameReceiver::Backend {
+	public:
+		vector<SkyFrameReceiver::SenderInfo> listSenders() override
+		{
+			vector<SkyFrameReceiver::SenderInfo> senders;
+			for (const auto &info : SkyShmSegment::list()) {
+				senders.push_back({ info.name, ivec2(info.width, info.height) });
+			}
+			return senders;
+		}
+		bool receive(const SkyFrameReceiver::SenderInfo &sender, SkyFrameReceiver::TexturePool &pool, gl::Texture2dRef &texture) override
+		{
+			if (!mReader || mReader->getName() != sender.name || mReader->isClosed()) {
+				mReader = SkyShmReader::open(sender.name);
+				if (!mReader) return false;
+			}
+			int width, height;
+			if (!mReader->read(mPixels, width, height) || width <= 0 || height <= 0) return false;
+			auto target = pool.acquire(ivec2(width, height));
+			gl::ScopedTextureBind scopedTex(target);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, mPixels.data());
+			texture = target;
+			return true;
+		}
+	private:
+		SkyShmReaderRef		mReader;
+		vector<uint8_t>		mPixels;
+	};
+	typedef ShmBackend PlatformBackend;
+#endif
+}
+
+gl::Texture2dRef SkyFrameReceiver::TexturePool::acquire(const ivec2 &size)
+{
+	auto &textures = mTextures[make_pair(size.x, size.y)];
+	// free when only the pool holds it, the last received one is still held by the receiver
+	for (auto &texture : textures) {
+		if (texture.use_count() == 1) return texture;
+	}
+	if (textures.size() < kTexturesPerSize) {
+		textures.push_back(gl::Texture2d::create(size.x, size.y, kTextureFormat));
+		mCreated++;
+		return textures.back();
+	}
+	// every texture is held downstream, overwrite the oldest
+	rotate(textures.begin(), textures.begin() + 1, textures.end());
+	return textures.back();
+}
+
+void SkyFrameReceiver::TexturePool::reserve(const ivec2 &size)
+{
+	auto &textures = mTextures[make_pair(size.x, size.y)];
+	while (textures.size() < 2) {
+		textures.push_back(gl::Texture2d::create(size.x, size.y, kTextureFormat));
+		mCreated++;
+	}
+}
+
+SkyFrameReceiver::SkyFrameReceiver(const string &senderName)
+	: mBackend(new PlatformBackend()), mWanted(senderName)
+{
+	mThread = thread(&SkyFrameReceiver::discoveryFn, this);
+}
+
+SkyFrameReceiver::~SkyFrameReceiver()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	mThread.join();
+}
+
+string SkyFrameReceiver::getSenderName() const
+{
+	lock_guard<mutex> lock(mMutex);
+	return mSender.name;
+}
+
+void SkyFrameReceiver::setSenderName(const string &name)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mWanted = name;
+	}
+	mCondition.notify_all();
+}
+
+void SkyFrameReceiver::discoveryFn()
+{
+	unique_lock<mutex> lock(mMutex);
+	while (mRunning) {
+		string wanted = mWanted;
+		lock.unlock();
+		auto senders = mBackend->listSenders();
+		SenderInfo chosen;
+		for (const auto &sender : senders) {
+			if (wanted.empty() || sender.name == wanted) {
+				chosen = sender;
+				break;
+			}
+		}
+		lock.lock();
+		if (chosen.name != mSender.name) CI_LOG_I("sender " << (chosen.name.empty() ? "lost" : chosen.name));
+		mSender = chosen;
+		for (const auto &sender : senders) {
+			if (find(mSizes.begin(), mSizes.end(), sender.size) == mSizes.end()) mSizes.push_back(sender.size);
+		}
+		mCondition.wait_for(lock, chrono::milliseconds(500), [this, &wanted] { return !mRunning || mWanted != wanted; });
+	}
+}
+
+gl::Texture2dRef SkyFrameReceiver::receiveTexture()
+{
+	SenderInfo sender;
+	vector<ivec2> sizes;
+	{
+		lock_guard<mutex> lock(mMutex);
+		sender = mSender;
+		sizes.swap(mSizes);
+	}
+	// textures for every size seen, before a sender switches to it
+	for (const auto &size : sizes) {
+		if (size.x > 0 && size.y > 0) mPool.reserve(size);
+	}
+	mConnected = !sender.name.empty();
+	if (!mConnected) return nullptr;
+
+	gl::Texture2dRef texture;
+	if (mBackend->receive(sender, mPool, texture)) {
+		mTexture = texture;
+		mReceived++;
+	}
+	return mTexture;
+}
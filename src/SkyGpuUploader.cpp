@@ -0,0 +1,142 @@
+#include "SkyGpuUploader.h"
+
+#include "cinder/Log.h"
+#include "cinder/Thread.h"
+
+#include <chrono>
+
+using namespace ci;
+using namespace std;
+
+SkyGpuUploader::SkyGpuUploader(const Format &format)
+	: mFormat(format)
+{
+	auto renderContext = gl::context();
+	for (size_t i = 0; i < max<size_t>(1, mFormat.mNumContexts); i++) {
+		auto context = gl::Context::create(renderContext);
+		mThreads.emplace_back(&SkyGpuUploader::workerFn, this, context);
+	}
+	// creating a shared context may leave it current on some platforms
+	renderContext->makeCurrent();
+}
+
+SkyGpuUploader::~SkyGpuUploader()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for (auto &worker : mThreads) worker.join();
+}
+
+void SkyGpuUploader::uploadTexture(const string &name, const Surface8uRef &surface, const gl::Texture2d::Format &format, const function<void(const gl::Texture2dRef&)> &ready)
+{
+	submit(name, [surface, format] { return gl::Texture2d::create(*surface, format); }, ready);
+}
+
+void SkyGpuUploader::compileProgram(const string &name, const gl::GlslProg::Format &format, const function<void(const gl::GlslProgRef&)> &ready)
+{
+	submit(name, [format] { return gl::GlslProg::create(format); }, ready);
+}
+
+void SkyGpuUploader::enqueue(const JobRef &job)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStats.submitted++;
+		mStats.pendingCount++;
+		mJobs.push_back(job);
+	}
+	mCondition.notify_one();
+}
+
+void SkyGpuUploader::workerFn(gl::ContextRef context)
+{
+	ThreadSetup threadSetup;
+	context->makeCurrent();
+	while (true) {
+		JobRef job;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return !mRunning || !mJobs.empty(); });
+			if (!mRunning) return;
+			job = mJobs.front();
+			mJobs.pop_front();
+		}
+		auto start = chrono::steady_clock::now();
+		try {
+			job->build();
+			// flushed so the render context sees the fence without having to flush this one
+			job->fence = gl::Sync::create();
+			glFlush();
+		}
+		catch (const std::exception &exc) {
+			CI_LOG_EXCEPTION("building " << job->name, exc);
+			job->failed = true;
+		}
+		job->buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		{
+			lock_guard<mutex> lock(mMutex);
+			mBuilt.push_back(job);
+		}
+		mBuiltCondition.notify_all();
+	}
+}
+
+void SkyGpuUploader::update()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mFenced.insert(mFenced.end(), mBuilt.begin(), mBuilt.end());
+		mBuilt.clear();
+	}
+	size_t swaps = 0;
+	for (auto it = mFenced.begin(); it != mFenced.end() && swaps < mFormat.mReadyPerFrame;) {
+		JobRef job = *it;
+		if (job->fence && job->fence->clientWaitSync(0, 0) == GL_TIMEOUT_EXPIRED) {
+			++it;
+			continue;
+		}
+		it = mFenced.erase(it);
+		complete(job);
+		if (!job->failed) swaps++;
+	}
+}
+
+SkyGpuUploader::Stats SkyGpuUploader::getStats()
+{
+	lock_guard<mutex> lock(mMutex);
+	return mStats;
+}
+
+void SkyGpuUploader::finish()
+{
+	while (getStats().pendingCount > 0) {
+		if (mFenced.empty()) {
+			unique_lock<mutex> lock(mMutex);
+			mBuiltCondition.wait(lock, [this] { return !mBuilt.empty(); });
+			mFenced.insert(mFenced.end(), mBuilt.begin(), mBuilt.end());
+			mBuilt.clear();
+		}
+		JobRef job = mFenced.front();
+		mFenced.pop_front();
+		if (job->fence) job->fence->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		complete(job);
+	}
+}
+
+void SkyGpuUploader::complete(const JobRef &job)
+{
+	if (!job->failed) {
+		job->ready();
+		job->fence.reset();
+		CI_LOG_V(job->name << " built in " << job->buildMs << "ms");
+	}
+	lock_guard<mutex> lock(mMutex);
+	mStats.pendingCount--;
+	mStats.lastBuildMs = job->buildMs;
+	mStats.maxBuildMs = max(mStats.maxBuildMs, job->buildMs);
+	if (job->failed) mStats.failed++;
+	else mStats.completed++;
+}
@@ -0,0 +1,183 @@
+#include "SkyJournal.h"
+
+#include <chrono>
+#include <cstring>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const char kSnapshotMagic[4] = { 'S', 'K', 'Y', 'J' };
+	const uint32_t kSnapshotVersion = 1;
+
+	bool replaceFile(const string &from, const string &to)
+	{
+#if defined( _WIN32 )
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	// the rename must not reach the disk before the data it points to
+	bool syncFile(FILE *file)
+	{
+		if (fflush(file) != 0) return false;
+#if defined( _WIN32 )
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+}
+
+SkyJournal::SkyJournal(const string &basePath, const Format &format)
+	: mJournalPath(basePath + ".journal"), mSnapshotPath(basePath + ".snapshot"), mFormat(format)
+{
+	readRecords(mSnapshotPath, sizeof(kSnapshotMagic) + sizeof(kSnapshotVersion), mValues);
+	readRecords(mJournalPath, 0, mValues);
+	mCompacted = mValues;
+	mJournal = fopen(mJournalPath.c_str(), "ab");
+	mThread = thread(&SkyJournal::writerFn, this);
+}
+
+SkyJournal::~SkyJournal()
+{
+	close();
+}
+
+SkyJournal::Record SkyJournal::makeRecord(uint32_t key, float value)
+{
+	Record record;
+	record.key = key;
+	record.value = value;
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	record.check = (key * 2654435761u) ^ bits ^ 0x534B594Au;
+	return record;
+}
+
+bool SkyJournal::isValid(const Record &record)
+{
+	return makeRecord(record.key, record.value).check == record.check;
+}
+
+size_t SkyJournal::readRecords(const string &path, size_t offset, Values &values)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) return 0;
+	if (offset) {
+		char magic[sizeof(kSnapshotMagic)];
+		uint32_t version = 0;
+		if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0
+			|| fread(&version, sizeof(version), 1, file) != 1 || version != kSnapshotVersion) {
+			fclose(file);
+			return 0;
+		}
+	}
+	// a torn record at the end of the journal is where the last write was interrupted
+	size_t count = 0;
+	Record record;
+	while (fread(&record, sizeof(record), 1, file) == 1 && isValid(record)) {
+		values[record.key] = record.value;
+		count++;
+	}
+	fclose(file);
+	return count;
+}
+
+bool SkyJournal::get(uint32_t key, float &value) const
+{
+	auto it = mValues.find(key);
+	if (it == mValues.end()) return false;
+	value = it->second;
+	return true;
+}
+
+void SkyJournal::record(uint32_t key, float value)
+{
+	auto it = mValues.find(key);
+	if (it != mValues.end() && it->second == value) return;
+	mValues[key] = value;
+	lock_guard<mutex> lock(mMutex);
+	mPending.push_back(makeRecord(key, value));
+}
+
+void SkyJournal::close()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	if (mThread.joinable()) mThread.join();
+}
+
+void SkyJournal::writerFn()
+{
+	// fold whatever was replayed at startup, this also drops a torn tail
+	compact();
+	auto lastCompact = chrono::steady_clock::now();
+	while (true) {
+		vector<Record> batch;
+		bool running;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait_for(lock, chrono::milliseconds(mFormat.mFlushMilliseconds), [this] { return !mRunning; });
+			batch.swap(mPending);
+			running = mRunning;
+		}
+		if (!batch.empty()) flush(batch);
+		if (!running) break;
+
+		auto now = chrono::steady_clock::now();
+		if (mJournalBytes >= mFormat.mCompactBytes || (mJournalBytes > 0 && now - lastCompact >= chrono::seconds(mFormat.mCompactSeconds))) {
+			compact();
+			lastCompact = now;
+		}
+	}
+	if (mJournal) {
+		fclose(mJournal);
+		mJournal = nullptr;
+	}
+}
+
+void SkyJournal::flush(vector<Record> &records)
+{
+	for (const auto &record : records) mCompacted[record.key] = record.value;
+	if (!mJournal) return;
+	fwrite(records.data(), sizeof(Record), records.size(), mJournal);
+	fflush(mJournal);
+	mJournalBytes += records.size() * sizeof(Record);
+	mFlushed += records.size();
+}
+
+void SkyJournal::compact()
+{
+	const string temporary = mSnapshotPath + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file) return;
+	bool ok = fwrite(kSnapshotMagic, sizeof(kSnapshotMagic), 1, file) == 1
+		&& fwrite(&kSnapshotVersion, sizeof(kSnapshotVersion), 1, file) == 1;
+	for (const auto &value : mCompacted) {
+		Record record = makeRecord(value.first, value.second);
+		ok = ok && fwrite(&record, sizeof(record), 1, file) == 1;
+	}
+	ok = syncFile(file) && ok;
+	fclose(file);
+	// the journal is only truncated once the snapshot has replaced the previous one, replaying it twice is harmless
+	if (!ok || !replaceFile(temporary, mSnapshotPath)) {
+		remove(temporary.c_str());
+		return;
+	}
+	if (mJournal) fclose(mJournal);
+	mJournal = fopen(mJournalPath.c_str(), "wb");
+	mJournalBytes = 0;
+	mCompactions++;
+}
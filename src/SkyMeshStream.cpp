@@ -0,0 +1,267 @@
+#include "SkyMeshStream.h"
+
+#include "cinder/Log.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	typedef SkyMeshStream::Vertex Vertex;
+
+	inline Vertex add(const Vertex &a, const Vertex &b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Vertex sub(const Vertex &a, const Vertex &b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Vertex scale(const Vertex &a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	inline Vertex cross(const Vertex &a, const Vertex &b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	inline Vertex normalize(const Vertex &a)
+	{
+		float length = sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+		return length > 0.0f ? scale(a, 1.0f / length) : a;
+	}
+
+	Vertex knot(const SkyMeshStream::Params &params, float t)
+	{
+		// fits a sphere of the given radius
+		float r = 2.0f + cosf(params.mQ * t);
+		return scale(Vertex{ r * cosf(params.mP * t), r * sinf(params.mP * t), -sinf(params.mQ * t) }, params.mRadius / 3.0f);
+	}
+}
+
+SkyMeshStream::SkyMeshStream(size_t maxVertices, size_t numThreads)
+	: mMaxVertices(maxVertices), mMaxIndices(maxVertices * kIndicesPerVertex)
+{
+	const size_t vertexBytes = kNumRegions * mMaxVertices * sizeof(Vertex);
+	const size_t indexBytes = kNumRegions * mMaxIndices * sizeof(uint32_t);
+	mStats.persistent = gl::isExtensionAvailable("GL_ARB_buffer_storage");
+	if (mStats.persistent) {
+		// mapped once for the life of the arena, writes are seen by the draws issued after them
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		mVertexBuffer = gl::Vbo::create(GL_ARRAY_BUFFER);
+		{
+			gl::ScopedBuffer scopedBuffer(mVertexBuffer);
+			glBufferStorage(GL_ARRAY_BUFFER, vertexBytes, nullptr, flags);
+			mVertices = (Vertex *)glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes, flags);
+		}
+		mIndexBuffer = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER);
+		{
+			gl::ScopedBuffer scopedBuffer(mIndexBuffer);
+			glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, flags);
+			mIndices = (uint32_t *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, flags);
+		}
+		if (!mVertices || !mIndices) CI_LOG_E("mapping the mesh arena failed");
+	}
+	else {
+		mVertexBuffer = gl::Vbo::create(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STREAM_DRAW);
+		mIndexBuffer = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STREAM_DRAW);
+		mStagingVertices.resize(kNumRegions * mMaxVertices);
+		mStagingIndices.resize(kNumRegions * mMaxIndices);
+		mVertices = mStagingVertices.data();
+		mIndices = mStagingIndices.data();
+	}
+	mVao = gl::Vao::create();
+
+	// the render thread takes the first chunk itself
+	if (!numThreads) numThreads = max<size_t>(1, thread::hardware_concurrency());
+	for (size_t worker = 1; worker < numThreads; worker++) {
+		mThreads.emplace_back(&SkyMeshStream::workerFn, this, worker);
+	}
+	CI_LOG_I("mesh arena of " << kNumRegions << " x " << mMaxVertices << " vertices, " << (mStats.persistent ? "persistent" : "staged") << ", " << numThreads << " threads");
+}
+
+SkyMeshStream::~SkyMeshStream()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for (auto &worker : mThreads) worker.join();
+	if (mStats.persistent && mVertices) {
+		gl::ScopedBuffer scopedVertices(mVertexBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	if (mStats.persistent && mIndices) {
+		gl::ScopedBuffer scopedIndices(mIndexBuffer);
+		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+	}
+}
+
+void SkyMeshStream::getRows(const Params &params, int &vertexRows, int &quadRows)
+{
+	// the sphere has both poles as rows, the torus and the knot close on themselves
+	quadRows = params.mRings;
+	vertexRows = params.mShape == Shape::SPHERE ? params.mRings + 1 : params.mRings;
+}
+
+SkyMeshStream::Params SkyMeshStream::fit(const Params &params) const
+{
+	Params fitted = params;
+	fitted.mRings = max(3, fitted.mRings);
+	fitted.mSegments = max(3, fitted.mSegments);
+	int vertexRows, quadRows;
+	getRows(fitted, vertexRows, quadRows);
+	const size_t vertices = (size_t)vertexRows * fitted.mSegments;
+	if (vertices > mMaxVertices) {
+		// keep the proportions
+		float shrink = sqrtf((float)mMaxVertices / vertices);
+		fitted.mRings = max(3, (int)(fitted.mRings * shrink));
+		fitted.mSegments = max(3, (int)(fitted.mSegments * shrink));
+		for (getRows(fitted, vertexRows, quadRows); (size_t)vertexRows * fitted.mSegments > mMaxVertices; getRows(fitted, vertexRows, quadRows)) {
+			fitted.mRings--;
+		}
+	}
+	return fitted;
+}
+
+void SkyMeshStream::generateRows(const Params &params, int rowBegin, int rowEnd, Vertex *vertices, uint32_t *indices)
+{
+	const int segments = params.mSegments;
+	int vertexRows, quadRows;
+	getRows(params, vertexRows, quadRows);
+	const float twoPi = 6.28318531f;
+
+	for (int row = rowBegin; row < rowEnd && row < vertexRows; row++) {
+		Vertex *out = vertices + (size_t)row * segments;
+		if (params.mShape == Shape::SPHERE) {
+			float theta = 3.14159265f * row / params.mRings;
+			float ringRadius = params.mRadius * sinf(theta), y = params.mRadius * cosf(theta);
+			for (int segment = 0; segment < segments; segment++) {
+				float phi = twoPi * segment / segments;
+				out[segment] = { ringRadius * cosf(phi), y, ringRadius * sinf(phi) };
+			}
+			continue;
+		}
+		// a frame along the centre line, the tube is swept around it
+		float t = twoPi * row / params.mRings;
+		Vertex center, normal, binormal;
+		if (params.mShape == Shape::TORUS) {
+			normal = { cosf(t), sinf(t), 0.0f };
+			binormal = { 0.0f, 0.0f, 1.0f };
+			center = scale(normal, params.mRadius);
+		}
+		else {
+			const float epsilon = 0.001f;
+			center = knot(params, t);
+			Vertex ahead = knot(params, t + epsilon), behind = knot(params, t - epsilon);
+			Vertex tangent = normalize(sub(ahead, behind));
+			binormal = normalize(cross(tangent, add(ahead, behind)));
+			normal = cross(binormal, tangent);
+		}
+		for (int segment = 0; segment < segments; segment++) {
+			float phi = twoPi * segment / segments;
+			out[segment] = add(center, add(scale(normal, params.mTubeRadius * cosf(phi)), scale(binormal, params.mTubeRadius * sinf(phi))));
+		}
+	}
+
+	// two triangles per quad, a quad row joins a vertex row to the next one
+	for (int row = rowBegin; row < rowEnd && row < quadRows; row++) {
+		uint32_t *out = indices + (size_t)row * segments * 6;
+		const uint32_t current = (uint32_t)(row * segments);
+		const uint32_t next = (uint32_t)(((row + 1) % vertexRows) * segments);
+		for (int segment = 0; segment < segments; segment++) {
+			const uint32_t right = (uint32_t)((segment + 1) % segments);
+			out[0] = current + segment;
+			out[1] = next + segment;
+			out[2] = current + right;
+			out[3] = current + right;
+			out[4] = next + segment;
+			out[5] = next + right;
+			out += 6;
+		}
+	}
+}
+
+void SkyMeshStream::generate(size_t chunk, size_t numChunks)
+{
+	int vertexRows, quadRows;
+	getRows(mParams, vertexRows, quadRows);
+	const int rowsPerChunk = (vertexRows + (int)numChunks - 1) / (int)numChunks;
+	const int rowBegin = (int)chunk * rowsPerChunk;
+	generateRows(mParams, rowBegin, min(vertexRows, rowBegin + rowsPerChunk), mRegionVertices, mRegionIndices);
+}
+
+void SkyMeshStream::workerFn(size_t worker)
+{
+	uint64_t generation = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [&] { return !mRunning || mGeneration != generation; });
+			if (!mRunning) return;
+			generation = mGeneration;
+		}
+		generate(worker, mThreads.size() + 1);
+		lock_guard<mutex> lock(mMutex);
+		if (--mPending == 0) mDoneCondition.notify_one();
+	}
+}
+
+void SkyMeshStream::update(const Params &params)
+{
+	if (!mVertices || !mIndices) return;
+	const int region = (mRegion + 1) % kNumRegions;
+	if (mFences[region]) {
+		// three frames back, normally long done
+		if (mFences[region]->clientWaitSync(0, 0) == GL_TIMEOUT_EXPIRED) {
+			auto start = chrono::steady_clock::now();
+			mFences[region]->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			mStats.stalls++;
+			mStats.stallMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+		mFences[region].reset();
+	}
+
+	auto start = chrono::steady_clock::now();
+	mParams = fit(params);
+	mRegionVertices = mVertices + region * mMaxVertices;
+	mRegionIndices = mIndices + region * mMaxIndices;
+	{
+		lock_guard<mutex> lock(mMutex);
+		mPending = mThreads.size();
+		mGeneration++;
+	}
+	mCondition.notify_all();
+	generate(0, mThreads.size() + 1);
+	{
+		unique_lock<mutex> lock(mMutex);
+		mDoneCondition.wait(lock, [this] { return mPending == 0; });
+	}
+
+	int vertexRows, quadRows;
+	getRows(mParams, vertexRows, quadRows);
+	mStats.vertices = (size_t)vertexRows * mParams.mSegments;
+	mNumIndices = (size_t)quadRows * mParams.mSegments * 6;
+	mStats.indices = mNumIndices;
+	if (!mStats.persistent) {
+		gl::ScopedBuffer scopedVertices(mVertexBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, region * mMaxVertices * sizeof(Vertex), mStats.vertices * sizeof(Vertex), mRegionVertices);
+		gl::ScopedBuffer scopedIndices(mIndexBuffer);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, region * mMaxIndices * sizeof(uint32_t), mNumIndices * sizeof(uint32_t), mRegionIndices);
+	}
+	mRegion = region;
+	mStats.frames++;
+	mStats.generateMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void SkyMeshStream::draw(const gl::GlslProgRef &shader)
+{
+	if (mRegion < 0 || !mNumIndices) return;
+	const int location = shader->getAttribSemanticLocation(geom::Attrib::POSITION);
+	if (location < 0) return;
+	gl::ScopedVao scopedVao(mVao);
+	if (location != mVaoLocation) {
+		// every region shares the layout, the base vertex picks one
+		gl::ScopedBuffer scopedVertices(mVertexBuffer);
+		gl::enableVertexAttribArray(location);
+		gl::vertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+		mIndexBuffer->bind();
+		mVaoLocation = location;
+	}
+	gl::ScopedGlslProg scopedShader(shader);
+	gl::context()->setDefaultShaderVars();
+	glDrawElementsBaseVertex(GL_PATCHES, (GLsizei)mNumIndices, GL_UNSIGNED_INT, (GLvoid *)(mRegion * mMaxIndices * sizeof(uint32_t)), (GLint)(mRegion * mMaxVertices));
+	// the region is not rewritten until the GPU is past this draw
+	mFences[mRegion] = gl::Sync::create();
+}
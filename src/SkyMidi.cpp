@@ -0,0 +1,321 @@
+#include "SkyMidi.h"
+
+#include "cinder/Json.h"
+#include "cinder/Log.h"
+#include "RtMidi.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace ci;
+using namespace std;
+
+bool SkyMidiQueue::push(const SkyMidiEvent &event)
+{
+	const size_t head = mHead.load(memory_order_relaxed);
+	if (head - mTail.load(memory_order_acquire) >= kCapacity) {
+		mDropped.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+	mEvents[head % kCapacity] = event;
+	mHead.store(head + 1, memory_order_release);
+	return true;
+}
+
+bool SkyMidiQueue::pop(SkyMidiEvent &event)
+{
+	const size_t tail = mTail.load(memory_order_relaxed);
+	if (tail == mHead.load(memory_order_acquire)) return false;
+	event = mEvents[tail % kCapacity];
+	mTail.store(tail + 1, memory_order_release);
+	return true;
+}
+
+int64_t SkyMidiSource::now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+vector<string> SkyMidiDevice::listPorts()
+{
+	vector<string> ports;
+	try {
+		RtMidiIn in;
+		for (unsigned int i = 0; i < in.getPortCount(); i++) ports.push_back(in.getPortName(i));
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("listing MIDI ports", exc);
+	}
+	return ports;
+}
+
+SkyMidiSourceRef SkyMidiDevice::open(const string &port)
+{
+	auto ports = listPorts();
+	size_t index = ports.size();
+	if (!port.empty() && port.find_first_not_of("0123456789") == string::npos) {
+		index = (size_t)stoul(port);
+	}
+	else {
+		for (size_t i = 0; i < ports.size() && index == ports.size(); i++) {
+			if (ports[i].find(port) != string::npos) index = i;
+		}
+	}
+	if (index >= ports.size()) return nullptr;
+
+	shared_ptr<SkyMidiDevice> device(new SkyMidiDevice());
+	try {
+		device->mIn.reset(new RtMidiIn());
+		// the callback runs on the RtMidi thread and only queues the message
+		device->mIn->setCallback(&SkyMidiDevice::callback, device.get());
+		device->mIn->ignoreTypes(true, true, true);
+		device->mIn->openPort((unsigned int)index);
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("opening MIDI port " << ports[index], exc);
+		return nullptr;
+	}
+	device->mName = ports[index];
+	return device;
+}
+
+SkyMidiDevice::SkyMidiDevice()
+{
+}
+
+SkyMidiDevice::~SkyMidiDevice()
+{
+	if (mIn) {
+		mIn->closePort();
+		mIn->cancelCallback();
+	}
+}
+
+void SkyMidiDevice::callback(double delta, vector<unsigned char> *message, void *user)
+{
+	if (!message || message->size() < 2) return;
+	SkyMidiEvent event;
+	event.status = (*message)[0];
+	event.data1 = (*message)[1];
+	event.data2 = message->size() > 2 ? (*message)[2] : 0;
+	event.time = now();
+	static_cast<SkyMidiDevice*>(user)->mQueue.push(event);
+}
+
+SkyMidiSourceRef SkyMidiReplay::create(const fs::path &path, bool loop)
+{
+	ifstream file(path.string());
+	if (!file) return nullptr;
+	shared_ptr<SkyMidiReplay> replay(new SkyMidiReplay());
+	string line;
+	while (getline(file, line)) {
+		line = line.substr(0, line.find('#'));
+		istringstream fields(line);
+		double ms;
+		int channel, controller, value;
+		if (!(fields >> ms >> channel >> controller >> value)) continue;
+		SkyMidiEvent event;
+		event.status = (uint8_t)(0xB0 | (channel & 15));
+		event.data1 = (uint8_t)(controller & 127);
+		event.data2 = (uint8_t)(value & 127);
+		replay->mMessages.emplace_back(ms, event);
+	}
+	if (replay->mMessages.empty()) return nullptr;
+	stable_sort(replay->mMessages.begin(), replay->mMessages.end(), [](const pair<double, SkyMidiEvent> &a, const pair<double, SkyMidiEvent> &b) { return a.first < b.first; });
+	replay->mName = path.filename().string();
+	replay->mLoop = loop;
+	replay->mThread = thread(&SkyMidiReplay::playFn, replay.get());
+	return replay;
+}
+
+SkyMidiReplay::~SkyMidiReplay()
+{
+	mRunning = false;
+	if (mThread.joinable()) mThread.join();
+}
+
+void SkyMidiReplay::playFn()
+{
+	typedef chrono::steady_clock Clock;
+	do {
+		auto start = Clock::now();
+		for (const auto &message : mMessages) {
+			auto due = start + chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(message.first));
+			// short sleeps so the destructor does not wait for a long gap
+			while (mRunning && Clock::now() < due) {
+				this_thread::sleep_until(min(due, Clock::now() + chrono::milliseconds(20)));
+			}
+			if (!mRunning) return;
+			SkyMidiEvent event = message.second;
+			event.time = now();
+			mQueue.push(event);
+		}
+	} while (mLoop && mRunning);
+	mFinished = true;
+}
+
+SkyMidiMapper::SkyMidiMapper()
+{
+	mTable.fill(-1);
+}
+
+void SkyMidiMapper::map(const Mapping &mapping)
+{
+	const int control = getControl(mapping.channel, mapping.controller);
+	for (size_t i = 0; i < mMappings.size(); i++) {
+		if (getControl(mMappings[i].channel, mMappings[i].controller) == control) {
+			mMappings[i] = mapping;
+			mStates[i] = State();
+			return;
+		}
+	}
+	mMappings.push_back(mapping);
+	mStates.push_back(State());
+	rebuildTable();
+}
+
+void SkyMidiMapper::unmap(int channel, int controller)
+{
+	const int control = getControl(channel, controller);
+	for (size_t i = 0; i < mMappings.size(); i++) {
+		if (getControl(mMappings[i].channel, mMappings[i].controller) == control) {
+			mMappings.erase(mMappings.begin() + i);
+			mStates.erase(mStates.begin() + i);
+			rebuildTable();
+			return;
+		}
+	}
+}
+
+void SkyMidiMapper::rebuildTable()
+{
+	mTable.fill(-1);
+	for (size_t i = 0; i < mMappings.size(); i++) {
+		mTable[getControl(mMappings[i].channel, mMappings[i].controller)] = (int16_t)i;
+	}
+}
+
+void SkyMidiMapper::learn(int target, float min, float max, float smoothingMs)
+{
+	mLearn = Mapping();
+	mLearn.target = target;
+	mLearn.min = min;
+	mLearn.max = max;
+	mLearn.smoothingMs = smoothingMs;
+	mLearning = true;
+}
+
+bool SkyMidiMapper::update(double elapsedSeconds)
+{
+	bool learned = false;
+	mChanges.clear();
+	const int64_t time = SkyMidiSource::now();
+	uint64_t dropped = 0;
+	for (const auto &source : mSources) {
+		SkyMidiEvent event;
+		while (source->pop(event)) {
+			mStats.events++;
+			if ((event.status & 0xF0) != 0xB0) continue;
+			mStats.controlChanges++;
+			const double latency = (time - event.time) / 1000000.0;
+			mLatencySum += latency;
+			mStats.meanLatencyMs = mLatencySum / mStats.controlChanges;
+			mStats.maxLatencyMs = std::max(mStats.maxLatencyMs, latency);
+
+			const int channel = event.status & 15;
+			if (mLearning) {
+				mLearn.channel = channel;
+				mLearn.controller = event.data1;
+				map(mLearn);
+				mLearning = false;
+				learned = true;
+				CI_LOG_I("MIDI channel " << channel << " CC " << (int)event.data1 << " mapped to uniform " << mLearn.target);
+			}
+			const int index = mTable[getControl(channel, event.data1)];
+			if (index < 0) {
+				mStats.unmapped++;
+				continue;
+			}
+			// only the latest value of a control counts, the easing below absorbs the steps between them
+			const Mapping &mapping = mMappings[index];
+			State &state = mStates[index];
+			state.goal = mapping.min + (mapping.max - mapping.min) * event.data2 / 127.0f;
+			if (!state.initialized || mapping.smoothingMs <= 0.0f) state.current = state.goal;
+			state.initialized = true;
+			state.moving = true;
+		}
+		dropped += source->getNumDropped();
+	}
+	mStats.dropped = dropped;
+
+	for (size_t i = 0; i < mMappings.size(); i++) {
+		State &state = mStates[i];
+		if (!state.moving) continue;
+		const Mapping &mapping = mMappings[i];
+		const float alpha = mapping.smoothingMs > 0.0f ? 1.0f - (float)exp(-elapsedSeconds * 1000.0 / mapping.smoothingMs) : 1.0f;
+		state.current += (state.goal - state.current) * alpha;
+		if (fabs(state.goal - state.current) <= 1e-4f * fabs(mapping.max - mapping.min)) {
+			state.current = state.goal;
+			state.moving = false;
+		}
+		mChanges.emplace_back(mapping.target, state.current);
+	}
+	return learned;
+}
+
+bool SkyMidiMapper::save(const fs::path &path) const
+{
+	try {
+		JsonTree mappings = JsonTree::makeArray("mappings");
+		for (const auto &mapping : mMappings) {
+			JsonTree item;
+			item.addChild(JsonTree("channel", mapping.channel));
+			item.addChild(JsonTree("controller", mapping.controller));
+			item.addChild(JsonTree("target", mapping.target));
+			item.addChild(JsonTree("min", mapping.min));
+			item.addChild(JsonTree("max", mapping.max));
+			item.addChild(JsonTree("smoothingMs", mapping.smoothingMs));
+			mappings.pushBack(item);
+		}
+		JsonTree root;
+		root.addChild(mappings);
+		root.write(writeFile(path));
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("saving " << path, exc);
+		return false;
+	}
+	return true;
+}
+
+bool SkyMidiMapper::load(const fs::path &path)
+{
+	if (!fs::exists(path)) return false;
+	vector<Mapping> mappings;
+	try {
+		JsonTree root(loadFile(path));
+		for (const auto &item : root["mappings"].getChildren()) {
+			Mapping mapping;
+			mapping.channel = item["channel"].getValue<int>();
+			mapping.controller = item["controller"].getValue<int>();
+			mapping.target = item["target"].getValue<int>();
+			mapping.min = item["min"].getValue<float>();
+			mapping.max = item["max"].getValue<float>();
+			if (item.hasChild("smoothingMs")) mapping.smoothingMs = item["smoothingMs"].getValue<float>();
+			mappings.push_back(mapping);
+		}
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("loading " << path, exc);
+		return false;
+	}
+	mMappings.clear();
+	mStates.clear();
+	// a file without mappings must not leave the table pointing past the cleared ones
+	rebuildTable();
+	for (const auto &mapping : mappings) map(mapping);
+	return true;
+}
@@ -0,0 +1,54 @@
+#include "SkyNetOutput.h"
+
+using namespace ci;
+using namespace std;
+
+void SkyNetOutput::capture(const gl::Texture2dRef &texture)
+{
+	const size_t frameBytes = (size_t)mSize.x * mSize.y * 4;
+	// readbacks complete in order, stop at the first one still in flight
+	while (!mReadbackSlots.empty()) {
+		Slot &slot = mSlots[mReadbackSlots.front()];
+		if (slot.fence->clientWaitSync(0, 0) == GL_TIMEOUT_EXPIRED) break;
+		slot.fence.reset();
+		{
+			gl::ScopedBuffer scopedPbo(slot.pbo);
+			const uint8_t *data = (const uint8_t *)slot.pbo->mapBufferRange(0, frameBytes, GL_MAP_READ_BIT);
+			if (data) mSender->send(data, mSize.x, mSize.y, slot.timestamp);
+			slot.pbo->unmap();
+		}
+		mFreeSlots.push_back(mReadbackSlots.front());
+		mReadbackSlots.pop_front();
+	}
+
+	if (texture->getSize() != mSize) {
+		// frames still in flight are of the old size and are let go
+		mSize = texture->getSize();
+		mSlots.clear();
+		mFreeSlots.clear();
+		mReadbackSlots.clear();
+		for (size_t i = 0; i < kNumSlots; i++) {
+			Slot slot;
+			slot.pbo = gl::Pbo::create(GL_PIXEL_PACK_BUFFER, (size_t)mSize.x * mSize.y * 4, nullptr, GL_STREAM_READ);
+			mSlots.push_back(slot);
+			mFreeSlots.push_back(i);
+		}
+	}
+	if (mFreeSlots.empty()) return;
+
+	size_t index = mFreeSlots.front();
+	mFreeSlots.pop_front();
+	Slot &slot = mSlots[index];
+	slot.timestamp = SkyNetStream::now();
+	{
+		gl::ScopedBuffer scopedPbo(slot.pbo);
+		gl::ScopedTextureBind scopedTex(texture);
+		GLint alignment;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	}
+	slot.fence = gl::Sync::create();
+	mReadbackSlots.push_back(index);
+}
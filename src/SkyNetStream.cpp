@@ -0,0 +1,651 @@
+#include "SkyNetStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+int64_t SkyNetStream::now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int SkyNetStream::getBandRows(int height, int numBands)
+{
+	const int tileRows = SkyTileCodec::getNumRows(height);
+	return max(1, (tileRows + numBands - 1) / max(1, numBands));
+}
+
+size_t SkyNetStream::getMaxBandBytes(const MessageHeader &header)
+{
+	const int bandHeight = getBandRows((int)header.height, header.numBands) * SkyTileCodec::kTileSize;
+	const int rows = min(bandHeight, (int)(header.height - header.bandY));
+	const size_t numTiles = (size_t)SkyTileCodec::getNumColumns((int)header.width) * SkyTileCodec::getNumRows(rows);
+	const size_t rawBytes = (size_t)header.width * rows * 4;
+	// every tile changed and did not compress, the coder adds a length byte per 255 literals
+	return sizeof(SkyTileCodec::PacketHeader) + (numTiles + 7) / 8 + rawBytes + rawBytes / 255 + 16;
+}
+
+bool SkyNetStream::isValid(const MessageHeader &header)
+{
+	if (header.magic != kMagic || header.width == 0 || header.height == 0) return false;
+	if (header.width > (uint32_t)SkyTileCodec::kMaxDimension || header.height > (uint32_t)SkyTileCodec::kMaxDimension) return false;
+	if (header.numBands == 0 || header.band >= header.numBands || header.numBands > SkyTileCodec::getNumRows((int)header.height)) return false;
+	// the band must start where the sender cuts it
+	const uint32_t bandHeight = (uint32_t)(getBandRows((int)header.height, header.numBands) * SkyTileCodec::kTileSize);
+	if ((uint64_t)header.band * bandHeight >= header.height || header.bandY != header.band * bandHeight) return false;
+	return header.bandBytes <= getMaxBandBytes(header);
+}
+
+SkyNetStream::BenchmarkResults SkyNetStream::benchmark(Protocol protocol, int width, int height, double fps, double seconds, uint16_t port)
+{
+	BenchmarkResults results;
+	results.protocol = protocol;
+	auto receiver = SkyNetReceiver::create(port, protocol);
+	if (!receiver) return results;
+	auto sender = SkyNetSender::create("127.0.0.1", port, SkyNetSender::Format().protocol(protocol));
+
+	vector<uint8_t> frame((size_t)width * height * 4);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint8_t *pixel = frame.data() + ((size_t)y * width + x) * 4;
+			pixel[0] = (uint8_t)(x * 255 / width);
+			pixel[1] = (uint8_t)(y * 255 / height);
+			pixel[2] = 64;
+			pixel[3] = 255;
+		}
+	}
+	const vector<uint8_t> background = frame;
+	const int blockSize = min(256, min(width, height));
+	auto drawBlock = [&](uint64_t index, bool erase) {
+		int x = (int)(index * 8 % (uint64_t)(width - blockSize + 1));
+		int y = (height - blockSize) / 2;
+		for (int row = 0; row < blockSize; row++) {
+			size_t offset = ((size_t)(y + row) * width + x) * 4;
+			if (erase) memcpy(frame.data() + offset, background.data() + offset, (size_t)blockSize * 4);
+			else memset(frame.data() + offset, 0xe0, (size_t)blockSize * 4);
+		}
+	};
+
+	// let the connection settle, then measure from a clean slate
+	vector<uint8_t> received;
+	int receivedWidth, receivedHeight;
+	for (int i = 0; i < 30 && !receiver->getStats().frames; i++) {
+		sender->send(frame.data(), width, height);
+		this_thread::sleep_for(chrono::milliseconds(50));
+	}
+	this_thread::sleep_for(chrono::milliseconds(100));
+	receiver->receive(received, receivedWidth, receivedHeight);
+	receiver->resetStats();
+	const auto before = sender->getStats();
+
+	const int64_t interval = (int64_t)(1e9 / fps);
+	const int64_t start = now();
+	uint64_t index = 0;
+	double encodeMs = 0.0;
+	while (now() - start < (int64_t)(seconds * 1e9)) {
+		drawBlock(index, true);
+		drawBlock(index + 1, false);
+		sender->send(frame.data(), width, height);
+		index++;
+		// the receiving end takes frames at the same rate as a preview would
+		receiver->receive(received, receivedWidth, receivedHeight);
+		encodeMs += sender->getStats().encodeMs;
+		this_thread::sleep_for(chrono::nanoseconds(max<int64_t>(0, start + (int64_t)index * interval - now())));
+	}
+	const double elapsed = (now() - start) * 1e-9;
+	this_thread::sleep_for(chrono::milliseconds(100));
+
+	const auto sent = sender->getStats();
+	const auto got = receiver->getStats();
+	results.offeredFps = (sent.offered - before.offered) / elapsed;
+	results.sentFps = (sent.sent - before.sent) / elapsed;
+	results.receivedFps = got.frames / elapsed;
+	results.megabitsPerSecond = (sent.bytes - before.bytes) * 8e-6 / elapsed;
+	results.fullMegabitsPerSecond = frame.size() * results.sentFps * 8e-6;
+	results.latencyMs = got.latencyMs;
+	results.latencyMaxMs = got.latencyMaxMs;
+	results.encodeMs = index ? encodeMs / index : 0.0;
+	results.dropped = sent.dropped - before.dropped;
+	results.incomplete = got.incomplete;
+	results.keyframeRequests = got.keyframeRequests;
+	return results;
+}
+
+SkyNetSender::SkyNetSender(const string &host, uint16_t port, const Format &format)
+	: mHost(host), mPort(port), mFormat(format)
+{
+	mNumBands = mFormat.mNumBands > 0 ? mFormat.mNumBands : max(1, (int)thread::hardware_concurrency());
+	mMessages.resize(mNumBands);
+	mEncodeMs.resize(mNumBands);
+	for (int band = 0; band < mNumBands; band++) {
+		mEncoders.emplace_back(&SkyNetSender::encoderFn, this, band);
+	}
+	mNetworkThread = thread(&SkyNetSender::networkFn, this);
+}
+
+SkyNetSender::~SkyNetSender()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mEncodeCondition.notify_all();
+	mNetworkCondition.notify_all();
+	// a receiver that stopped reading leaves asio::write blocked, shutting the socket down makes it fail
+	mStopping = true;
+	{
+		lock_guard<mutex> lock(mSocketMutex);
+		asio::error_code ec;
+		if (mTcp) mTcp->shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+		mIo.stop();
+	}
+	for (auto &encoder : mEncoders) encoder.join();
+	mNetworkThread.join();
+}
+
+bool SkyNetSender::send(const uint8_t *rgba, int width, int height, int64_t timestamp)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStats.offered++;
+		if (mBusy || !mRunning) {
+			mStats.dropped++;
+			return false;
+		}
+	}
+	// idle, neither the encoders nor the network thread look at the frame
+	mFrame.assign(rgba, rgba + (size_t)width * height * 4);
+	mWidth = width;
+	mHeight = height;
+	mTimestamp = timestamp;
+	mFrameId++;
+	mFrameKeyframe = mKeyframe.exchange(false) || (mFormat.mKeyframeInterval > 0 && mFrameId % mFormat.mKeyframeInterval == 0);
+	{
+		lock_guard<mutex> lock(mMutex);
+		mBusy = true;
+		mPendingBands = mNumBands;
+		mGeneration++;
+	}
+	mEncodeCondition.notify_all();
+	return true;
+}
+
+SkyNetSender::Stats SkyNetSender::getStats() const
+{
+	lock_guard<mutex> lock(mMutex);
+	return mStats;
+}
+
+void SkyNetSender::encoderFn(int band)
+{
+	SkyTileEncoder encoder;
+	vector<uint8_t> packet;
+	uint64_t generation = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(mMutex);
+			mEncodeCondition.wait(lock, [&] { return !mRunning || mGeneration != generation; });
+			if (!mRunning) return;
+			generation = mGeneration;
+		}
+		const int64_t start = SkyNetStream::now();
+		auto &message = mMessages[band];
+		message.clear();
+		const int bandHeight = SkyNetStream::getBandRows(mHeight, mNumBands) * SkyTileCodec::kTileSize;
+		const int y = band * bandHeight;
+		if (y < mHeight) {
+			const int height = min(bandHeight, mHeight - y);
+			if (mFrameKeyframe) encoder.requestKeyframe();
+			encoder.encode(mFrame.data() + (size_t)y * mWidth * 4, mWidth, height, packet, mFormat.mCompress);
+
+			SkyNetStream::MessageHeader header;
+			// the padding goes over the wire too
+			memset(&header, 0, sizeof(header));
+			header.magic = SkyNetStream::kMagic;
+			header.frame = mFrameId;
+			header.timestamp = mTimestamp;
+			header.width = (uint32_t)mWidth;
+			header.height = (uint32_t)mHeight;
+			header.band = (uint16_t)band;
+			header.numBands = (uint16_t)((mHeight + bandHeight - 1) / bandHeight);
+			header.bandY = (uint32_t)y;
+			header.bandBytes = (uint32_t)packet.size();
+			header.offset = 0;
+			header.chunkBytes = (uint32_t)packet.size();
+			message.resize(sizeof(header) + packet.size());
+			memcpy(message.data(), &header, sizeof(header));
+			memcpy(message.data() + sizeof(header), packet.data(), packet.size());
+		}
+		mEncodeMs[band] = (SkyNetStream::now() - start) * 1e-6;
+
+		lock_guard<mutex> lock(mMutex);
+		if (--mPendingBands == 0) {
+			mEncoded = true;
+			mNetworkCondition.notify_one();
+		}
+	}
+}
+
+void SkyNetSender::networkFn()
+{
+	while (true) {
+		{
+			unique_lock<mutex> lock(mMutex);
+			mNetworkCondition.wait(lock, [this] { return !mRunning || mEncoded; });
+			if (!mRunning) break;
+			mEncoded = false;
+		}
+		// the encoders are idle until mBusy is cleared, the messages are ours
+		bool sent = false;
+		try {
+			if (mFormat.mProtocol == SkyNetStream::Protocol::TCP) {
+				if (connect()) {
+					sendTcp(mMessages);
+					sent = true;
+				}
+			}
+			else {
+				if (connect()) {
+					sendUdp(mMessages);
+					sent = true;
+				}
+			}
+		}
+		catch (const std::exception &) {
+			lock_guard<mutex> lock(mSocketMutex);
+			mTcp.reset();
+		}
+		// a frame that never left breaks the delta chain of every band
+		if (!sent) mKeyframe = true;
+
+		lock_guard<mutex> lock(mMutex);
+		if (sent) {
+			mStats.sent++;
+			if (mFrameKeyframe) mStats.keyframes++;
+			for (const auto &message : mMessages) mStats.bytes += message.size();
+		}
+		else mStats.dropped++;
+		mStats.encodeMs = *max_element(mEncodeMs.begin(), mEncodeMs.end());
+		mStats.connected = mTcp || mUdp;
+		mBusy = false;
+	}
+	lock_guard<mutex> lock(mSocketMutex);
+	asio::error_code ec;
+	if (mTcp) mTcp->close(ec);
+	if (mUdp) mUdp->close(ec);
+}
+
+bool SkyNetSender::connect()
+{
+	asio::error_code ec;
+	if (mFormat.mProtocol == SkyNetStream::Protocol::TCP) {
+		if (mTcp) return true;
+		// one attempt a second while the receiver is away
+		if (mLastAttempt && SkyNetStream::now() - mLastAttempt < 1000000000) return false;
+		mLastAttempt = SkyNetStream::now();
+
+		asio::ip::tcp::resolver resolver(mIo);
+		auto endpoints = resolver.resolve(asio::ip::tcp::resolver::query(mHost, to_string(mPort)), ec);
+		if (ec) return false;
+		unique_ptr<asio::ip::tcp::socket> socket(new asio::ip::tcp::socket(mIo));
+		asio::connect(*socket, endpoints, ec);
+		if (ec) return false;
+		socket->set_option(asio::ip::tcp::no_delay(true), ec);
+		lock_guard<mutex> lock(mSocketMutex);
+		// the destructor may have run its shutdown while this one was connecting
+		if (mStopping) return false;
+		mTcp = move(socket);
+		return true;
+	}
+	if (mUdp) return true;
+	asio::ip::udp::resolver resolver(mIo);
+	auto endpoints = resolver.resolve(asio::ip::udp::resolver::query(mHost, to_string(mPort)), ec);
+	if (ec || endpoints == asio::ip::udp::resolver::iterator()) return false;
+	mUdpEndpoint = *endpoints;
+	unique_ptr<asio::ip::udp::socket> socket(new asio::ip::udp::socket(mIo));
+	socket->open(mUdpEndpoint.protocol(), ec);
+	if (ec) return false;
+	// room for a whole frame of datagrams when pacing is off
+	socket->set_option(asio::socket_base::send_buffer_size(8 << 20), ec);
+	lock_guard<mutex> lock(mSocketMutex);
+	mUdp = move(socket);
+	return true;
+}
+
+void SkyNetSender::sendTcp(const vector<vector<uint8_t>> &messages)
+{
+	// length prefixed band packets, one gathered write per band
+	for (const auto &message : messages) {
+		if (message.empty()) continue;
+		uint32_t length = (uint32_t)message.size();
+		array<asio::const_buffer, 2> buffers = { { asio::buffer(&length, sizeof(length)), asio::buffer(message) } };
+		asio::write(*mTcp, buffers);
+	}
+}
+
+void SkyNetSender::sendUdp(const vector<vector<uint8_t>> &messages)
+{
+	asio::error_code ec;
+	// keyframe requests from the receiver
+	while (mUdp->available(ec) >= sizeof(uint32_t)) {
+		uint32_t request = 0;
+		asio::ip::udp::endpoint from;
+		mUdp->receive_from(asio::buffer(&request, sizeof(request)), from, 0, ec);
+		if (ec) break;
+		if (request == SkyNetStream::kKeyframeRequest) mKeyframe = true;
+	}
+
+	const size_t headerBytes = sizeof(SkyNetStream::MessageHeader);
+	const size_t chunkBytes = max<size_t>(64, mFormat.mDatagramBytes - headerBytes);
+	const double nsPerByte = mFormat.mMegabitsPerSecond > 0.0 ? 8e3 / mFormat.mMegabitsPerSecond : 0.0;
+	int64_t due = SkyNetStream::now();
+	for (const auto &message : messages) {
+		if (message.empty() || mStopping) continue;
+		SkyNetStream::MessageHeader header;
+		memcpy(&header, message.data(), headerBytes);
+		header.chunkBytes = (uint32_t)chunkBytes;
+		const uint8_t *packet = message.data() + headerBytes;
+		for (size_t offset = 0; offset < header.bandBytes; offset += chunkBytes) {
+			const size_t bytes = min(chunkBytes, header.bandBytes - offset);
+			header.offset = (uint32_t)offset;
+			array<asio::const_buffer, 2> buffers = { { asio::buffer(&header, headerBytes), asio::buffer(packet + offset, bytes) } };
+			// a slow pace can spread one frame over seconds
+			if (mStopping) return;
+			if (nsPerByte > 0.0) {
+				int64_t wait = due - SkyNetStream::now();
+				if (wait > 0) this_thread::sleep_for(chrono::nanoseconds(wait));
+				due = max(due, SkyNetStream::now()) + (int64_t)((headerBytes + bytes) * nsPerByte);
+			}
+			// a receiver that is not there yet is not an error, the datagrams are simply lost
+			mUdp->send_to(buffers, mUdpEndpoint, 0, ec);
+		}
+	}
+}
+
+SkyNetReceiverRef SkyNetReceiver::create(uint16_t port, SkyNetStream::Protocol protocol)
+{
+	SkyNetReceiverRef receiver(new SkyNetReceiver(protocol));
+	if (!receiver->listen(port)) return nullptr;
+	receiver->mThread = thread([](SkyNetReceiver *self) { self->mIo.run(); }, receiver.get());
+	return receiver;
+}
+
+SkyNetReceiver::SkyNetReceiver(SkyNetStream::Protocol protocol)
+	: mProtocol(protocol)
+{
+}
+
+SkyNetReceiver::~SkyNetReceiver()
+{
+	mIo.stop();
+	if (mThread.joinable()) mThread.join();
+}
+
+bool SkyNetReceiver::listen(uint16_t port)
+{
+	asio::error_code ec;
+	if (mProtocol == SkyNetStream::Protocol::TCP) {
+		mAcceptor.reset(new asio::ip::tcp::acceptor(mIo));
+		asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+		mAcceptor->open(endpoint.protocol(), ec);
+		if (!ec) mAcceptor->set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+		if (!ec) mAcceptor->bind(endpoint, ec);
+		if (!ec) mAcceptor->listen(asio::socket_base::max_connections, ec);
+		if (ec) return false;
+		acceptTcp();
+		return true;
+	}
+	mUdp.reset(new asio::ip::udp::socket(mIo));
+	asio::ip::udp::endpoint endpoint(asio::ip::udp::v4(), port);
+	mUdp->open(endpoint.protocol(), ec);
+	if (!ec) mUdp->set_option(asio::socket_base::receive_buffer_size(8 << 20), ec);
+	// a smaller buffer than asked for is not fatal
+	ec.clear();
+	mUdp->bind(endpoint, ec);
+	if (ec) return false;
+	mBuffer.resize(65536);
+	readUdp();
+	return true;
+}
+
+void SkyNetReceiver::acceptTcp()
+{
+	// one sender at a time, the next one waits in the backlog
+	mTcp.reset(new asio::ip::tcp::socket(mIo));
+	mAcceptor->async_accept(*mTcp, [this](const asio::error_code &ec) {
+		if (ec == asio::error::operation_aborted) return;
+		if (ec) {
+			acceptTcp();
+			return;
+		}
+		asio::error_code ignored;
+		mTcp->set_option(asio::ip::tcp::no_delay(true), ignored);
+		mBands.clear();
+		{
+			lock_guard<mutex> lock(mMutex);
+			mStats.connected = true;
+		}
+		readTcpHeader();
+	});
+}
+
+void SkyNetReceiver::readTcpHeader()
+{
+	// the length prefix and the message header, so the band is checked before its buffer is allocated
+	mBuffer.resize(sizeof(uint32_t) + sizeof(SkyNetStream::MessageHeader));
+	asio::async_read(*mTcp, asio::buffer(mBuffer), [this](const asio::error_code &ec, size_t) {
+		if (ec == asio::error::operation_aborted) return;
+		uint32_t length = 0;
+		SkyNetStream::MessageHeader header;
+		if (!ec) {
+			memcpy(&length, mBuffer.data(), sizeof(length));
+			memcpy(&header, mBuffer.data() + sizeof(length), sizeof(header));
+		}
+		if (ec || !SkyNetStream::isValid(header) || length != sizeof(header) + header.bandBytes) {
+			{
+				lock_guard<mutex> lock(mMutex);
+				mStats.connected = false;
+			}
+			acceptTcp();
+			return;
+		}
+		readTcpBody(header);
+	});
+}
+
+void SkyNetReceiver::readTcpBody(const SkyNetStream::MessageHeader &header)
+{
+	try {
+		mBuffer.resize(header.bandBytes);
+	}
+	catch (const std::bad_alloc &) {
+		lock_guard<mutex> lock(mMutex);
+		mStats.connected = false;
+		acceptTcp();
+		return;
+	}
+	asio::async_read(*mTcp, asio::buffer(mBuffer), [this, header](const asio::error_code &ec, size_t bytes) {
+		if (ec == asio::error::operation_aborted) return;
+		if (ec) {
+			{
+				lock_guard<mutex> lock(mMutex);
+				mStats.connected = false;
+			}
+			acceptTcp();
+			return;
+		}
+		{
+			lock_guard<mutex> lock(mMutex);
+			mStats.bytes += sizeof(uint32_t) + sizeof(header) + bytes;
+		}
+		handleBand(header, mBuffer.data(), mBuffer.size());
+		readTcpHeader();
+	});
+}
+
+void SkyNetReceiver::readUdp()
+{
+	mUdp->async_receive_from(asio::buffer(mBuffer), mSenderEndpoint, [this](const asio::error_code &ec, size_t bytes) {
+		if (ec == asio::error::operation_aborted) return;
+		if (!ec) handleDatagram(bytes);
+		readUdp();
+	});
+}
+
+void SkyNetReceiver::handleDatagram(size_t bytes)
+{
+	SkyNetStream::MessageHeader header;
+	if (bytes < sizeof(header)) return;
+	memcpy(&header, mBuffer.data(), sizeof(header));
+	const size_t chunk = bytes - sizeof(header);
+	if (!SkyNetStream::isValid(header) || !header.bandBytes) return;
+	// the band is cut in chunkBytes pieces, only the last one is shorter
+	if (header.chunkBytes < 64 || header.chunkBytes > mBuffer.size() - sizeof(header) || header.offset % header.chunkBytes) return;
+	if (header.offset >= header.bandBytes || chunk != min<size_t>(header.chunkBytes, header.bandBytes - header.offset)) return;
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStats.bytes += bytes;
+		mStats.connected = true;
+	}
+	matchBands(header);
+	if (header.band >= mBands.size()) return;
+
+	Band &band = mBands[header.band];
+	if (header.frame != band.assemblingFrame) {
+		// datagrams of an older frame arriving late are useless
+		if (band.assemblingFrame && (int32_t)(header.frame - band.assemblingFrame) < 0) return;
+		// the previous packet of this band never completed, the band needs a keyframe
+		if (!band.assembled) requestKeyframe();
+		band.assemblingFrame = header.frame;
+		band.chunkBytes = header.chunkBytes;
+		band.received = 0;
+		band.assembled = false;
+		try {
+			band.packet.assign(header.bandBytes, 0);
+			band.chunks.assign((header.bandBytes + header.chunkBytes - 1) / header.chunkBytes, false);
+		}
+		catch (const std::bad_alloc &) {
+			band.packet.clear();
+			band.chunks.clear();
+			band.assembled = true;
+			requestKeyframe();
+			return;
+		}
+	}
+	// every datagram of the frame must agree with the first one on how the band is cut
+	if (band.assembled || header.bandBytes != band.packet.size() || header.chunkBytes != band.chunkBytes) return;
+	const size_t index = header.offset / band.chunkBytes;
+	if (index >= band.chunks.size() || header.offset + chunk > band.packet.size() || band.chunks[index]) return;
+	memcpy(band.packet.data() + header.offset, mBuffer.data() + sizeof(header), chunk);
+	band.chunks[index] = true;
+	if (++band.received == band.chunks.size()) {
+		// done, later duplicates of this frame are dropped above
+		band.assembled = true;
+		handleBand(header, band.packet.data(), band.packet.size());
+	}
+}
+
+void SkyNetReceiver::matchBands(const SkyNetStream::MessageHeader &header)
+{
+	if (header.numBands == mBands.size() && header.width == mWidth && header.height == mHeight) return;
+	mBands = vector<Band>(header.numBands);
+	mWidth = header.width;
+	mHeight = header.height;
+	mFrame = 0;
+	mComplete = true;
+}
+
+void SkyNetReceiver::handleBand(const SkyNetStream::MessageHeader &header, const uint8_t *packet, size_t size)
+{
+	matchBands(header);
+	if (header.band >= mBands.size()) return;
+	if (header.frame != mFrame && (int32_t)(header.frame - mFrame) > 0) {
+		if (!mComplete) {
+			lock_guard<mutex> lock(mMutex);
+			mStats.incomplete++;
+		}
+		mFrame = header.frame;
+		mComplete = false;
+	}
+	// every packet is decoded, even for a frame already given up on, to keep the band's delta chain
+	Band &band = mBands[header.band];
+	band.y = header.bandY;
+	// a bad packet only costs its frame, the io thread keeps running
+	bool decoded = false;
+	try {
+		decoded = band.decoder.decode(packet, size);
+	}
+	catch (const std::exception &) {
+		band.decoder = SkyTileDecoder();
+	}
+	if (!decoded) {
+		requestKeyframe();
+		return;
+	}
+	band.frame = header.frame;
+	if (mComplete || header.frame != mFrame) return;
+	for (const auto &other : mBands) {
+		if (other.frame != mFrame) return;
+	}
+	mComplete = true;
+
+	const double latencyMs = (SkyNetStream::now() - header.timestamp) * 1e-6;
+	const size_t rowBytes = (size_t)mWidth * 4;
+	lock_guard<mutex> lock(mMutex);
+	mLatest.resize(rowBytes * mHeight);
+	for (const auto &other : mBands) {
+		const auto &pixels = other.decoder.getPixels();
+		if (other.y * rowBytes + pixels.size() <= mLatest.size()) memcpy(mLatest.data() + other.y * rowBytes, pixels.data(), pixels.size());
+	}
+	if (mLatestFrame && mLatestFrame != mTakenFrame) mStats.stale++;
+	mLatestFrame = mFrame;
+	mLatestWidth = (int)mWidth;
+	mLatestHeight = (int)mHeight;
+	mStats.frames++;
+	mLatencyFrames++;
+	mStats.latencyMs += (latencyMs - mStats.latencyMs) / mLatencyFrames;
+	mStats.latencyMaxMs = max(mStats.latencyMaxMs, latencyMs);
+}
+
+void SkyNetReceiver::requestKeyframe()
+{
+	if (mProtocol != SkyNetStream::Protocol::UDP) return;
+	// at most ten requests a second, the keyframe takes a frame or two to arrive
+	const int64_t now = SkyNetStream::now();
+	if (now - mLastRequest < 100000000) return;
+	mLastRequest = now;
+	asio::error_code ec;
+	uint32_t request = SkyNetStream::kKeyframeRequest;
+	mUdp->send_to(asio::buffer(&request, sizeof(request)), mSenderEndpoint, 0, ec);
+	lock_guard<mutex> lock(mMutex);
+	mStats.keyframeRequests++;
+}
+
+bool SkyNetReceiver::receive(vector<uint8_t> &rgba, int &width, int &height)
+{
+	lock_guard<mutex> lock(mMutex);
+	if (!mLatestFrame || mLatestFrame == mTakenFrame) return false;
+	rgba = mLatest;
+	width = mLatestWidth;
+	height = mLatestHeight;
+	mTakenFrame = mLatestFrame;
+	mStats.taken++;
+	return true;
+}
+
+SkyNetReceiver::Stats SkyNetReceiver::getStats() const
+{
+	lock_guard<mutex> lock(mMutex);
+	return mStats;
+}
+
+void SkyNetReceiver::resetStats()
+{
+	lock_guard<mutex> lock(mMutex);
+	bool connected = mStats.connected;
+	mStats = Stats();
+	mStats.connected = connected;
+	mLatencyFrames = 0;
+}
@@ -0,0 +1,477 @@
+#include "SkyOscReceiver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+	// seconds from 1900, the OSC and NTP epoch, to 1970
+	const uint64_t kNtpUnixOffset = 2208988800ull;
+
+	size_t pad4(size_t bytes)
+	{
+		return (bytes + 3) & ~(size_t)3;
+	}
+
+	uint32_t readU32(const char *data)
+	{
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+		return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+	}
+
+	uint64_t readU64(const char *data)
+	{
+		return ((uint64_t)readU32(data) << 32) | readU32(data + 4);
+	}
+
+	void writeU32(char *data, uint32_t value)
+	{
+		data[0] = (char)(value >> 24);
+		data[1] = (char)(value >> 16);
+		data[2] = (char)(value >> 8);
+		data[3] = (char)value;
+	}
+
+	// address, ",f" and one float, as sent by the benchmark
+	size_t writeMessage(char *data, const string &address, float value)
+	{
+		size_t size = pad4(address.size() + 1);
+		memset(data, 0, size + 8);
+		memcpy(data, address.data(), address.size());
+		memcpy(data + size, ",f", 2);
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		writeU32(data + size + 4, bits);
+		return size + 8;
+	}
+}
+
+int64_t SkyOscReceiver::now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t SkyOscReceiver::ntpNow()
+{
+	const int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	const uint64_t seconds = (uint64_t)(ns / 1000000000) + kNtpUnixOffset;
+	const uint64_t fraction = ((uint64_t)(ns % 1000000000) << 32) / 1000000000;
+	return (seconds << 32) | fraction;
+}
+
+uint64_t SkyOscReceiver::hash(const char *text, size_t length)
+{
+	// FNV-1a
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++) {
+		h ^= (uint8_t)text[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+SkyOscReceiverRef SkyOscReceiver::create(uint16_t port, const vector<Route> &routes)
+{
+	SkyOscReceiverRef receiver(new SkyOscReceiver(routes));
+	asio::error_code ec;
+	asio::ip::udp::endpoint endpoint(asio::ip::udp::v4(), port);
+	receiver->mSocket.open(endpoint.protocol(), ec);
+	if (!ec) receiver->mSocket.bind(endpoint, ec);
+	if (ec) return nullptr;
+	// bursts wait in the kernel while a frame is long, a smaller buffer is not fatal
+	receiver->mSocket.set_option(asio::socket_base::receive_buffer_size(8 << 20), ec);
+	receiver->mPort = receiver->mSocket.local_endpoint(ec).port();
+	receiver->mThread = thread(&SkyOscReceiver::receiveFn, receiver.get());
+	return receiver;
+}
+
+SkyOscReceiver::SkyOscReceiver(const vector<Route> &routes)
+	: mSocket(mIo)
+{
+	size_t capacity = 16;
+	while (capacity < routes.size() * 2) capacity *= 2;
+	mTable.resize(capacity);
+	for (const auto &route : routes) {
+		if (route.address.empty() || route.slot < 0 || route.numArguments < 1) continue;
+		const uint64_t h = hash(route.address.data(), route.address.size());
+		size_t index = h & (capacity - 1);
+		while (mTable[index].slot >= 0) {
+			const Entry &entry = mTable[index];
+			if (entry.hash == h && mNames.compare(entry.offset, entry.length, route.address) == 0) break;
+			index = (index + 1) & (capacity - 1);
+		}
+		Entry &entry = mTable[index];
+		if (entry.slot < 0) {
+			entry.hash = h;
+			entry.offset = (uint32_t)mNames.size();
+			entry.length = (uint32_t)route.address.size();
+			mNames += route.address;
+		}
+		entry.slot = route.slot;
+		entry.numArguments = route.numArguments < kMaxArguments ? route.numArguments : kMaxArguments;
+		mNumSlots = max(mNumSlots, route.slot + entry.numArguments);
+	}
+
+	mQueue.resize(kQueueCapacity);
+	mDeferred.reserve(kQueueCapacity);
+	mChangeIndex.assign(mNumSlots, -1);
+	mChanges.reserve(mNumSlots);
+	mSteadyAtEpoch = now();
+	mNtpAtEpoch = ntpNow();
+}
+
+SkyOscReceiver::~SkyOscReceiver()
+{
+	mRunning = false;
+	if (mThread.joinable()) {
+		// the thread blocks in receive_from, an empty datagram wakes it; repeated in case the buffer is full
+		asio::error_code ec;
+		asio::ip::udp::socket wake(mIo);
+		wake.open(asio::ip::udp::v4(), ec);
+		const asio::ip::udp::endpoint endpoint(asio::ip::address_v4::loopback(), mPort);
+		while (!ec && !mStopped) {
+			wake.send_to(asio::buffer(mBuffer.data(), 0), endpoint, 0, ec);
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+		if (ec) mSocket.close(ec);
+		mThread.join();
+	}
+}
+
+const SkyOscReceiver::Entry* SkyOscReceiver::findEntry(const char *address, size_t length) const
+{
+	const uint64_t h = hash(address, length);
+	const size_t mask = mTable.size() - 1;
+	for (size_t index = h & mask;; index = (index + 1) & mask) {
+		const Entry &entry = mTable[index];
+		if (entry.slot < 0) return nullptr;
+		if (entry.hash == h && entry.length == length && memcmp(mNames.data() + entry.offset, address, length) == 0) return &entry;
+	}
+}
+
+int64_t SkyOscReceiver::getDue(uint64_t timetag) const
+{
+	// 1 means immediately, 0 is not a valid time
+	if (timetag <= 1) return 0;
+	const double seconds = (double)(int64_t)(timetag - mNtpAtEpoch) / 4294967296.0;
+	return mSteadyAtEpoch + (int64_t)(seconds * 1e9);
+}
+
+void SkyOscReceiver::receiveFn()
+{
+	asio::error_code ec;
+	while (mRunning) {
+		const size_t bytes = mSocket.receive_from(asio::buffer(mBuffer), mSender, 0, ec);
+		if (!mRunning) break;
+		if (ec) {
+			if (ec == asio::error::operation_aborted || ec == asio::error::bad_descriptor) break;
+			// a datagram larger than the buffer, or an ICMP error on some platforms
+			mMalformed.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+		mPackets.fetch_add(1, memory_order_relaxed);
+		parsePacket(mBuffer.data(), bytes, 1, now(), 0);
+	}
+	mStopped = true;
+}
+
+void SkyOscReceiver::parsePacket(const char *data, size_t size, uint64_t timetag, int64_t arrival, int depth)
+{
+	if (size >= 16 && memcmp(data, "#bundle", 8) == 0) {
+		if (depth >= kMaxDepth) {
+			mMalformed.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		mBundles.fetch_add(1, memory_order_relaxed);
+		timetag = readU64(data + 8);
+		const char *p = data + 16;
+		const char *end = data + size;
+		while (end - p >= 4) {
+			const uint32_t bytes = readU32(p);
+			p += 4;
+			if (bytes % 4 || bytes > (size_t)(end - p)) {
+				mMalformed.fetch_add(1, memory_order_relaxed);
+				return;
+			}
+			parsePacket(p, bytes, timetag, arrival, depth + 1);
+			p += bytes;
+		}
+		if (p != end) mMalformed.fetch_add(1, memory_order_relaxed);
+	}
+	else if (size > 0 && data[0] == '/') {
+		parseMessage(data, size, getDue(timetag), arrival);
+	}
+	else {
+		mMalformed.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+void SkyOscReceiver::parseMessage(const char *data, size_t size, int64_t due, int64_t arrival)
+{
+	mMessages.fetch_add(1, memory_order_relaxed);
+	const char *end = data + size;
+	const char *nul = static_cast<const char*>(memchr(data, 0, size));
+	if (!nul) {
+		mMalformed.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	const Entry *route = findEntry(data, nul - data);
+	if (!route) {
+		mUnrouted.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	const int slot = route->slot;
+
+	// type tags, a message without them is from an old sender and has no arguments
+	const char *p = data + pad4(nul - data + 1);
+	const char *tags = p;
+	size_t numTags = 0;
+	if (p < end && *p == ',') {
+		nul = static_cast<const char*>(memchr(p, 0, end - p));
+		if (!nul) {
+			mMalformed.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		tags = p + 1;
+		numTags = nul - tags;
+		p += pad4(numTags + 2);
+	}
+	if (p > end) {
+		mMalformed.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	int n = 0;
+	for (size_t i = 0; i < numTags; i++) {
+		const size_t left = end - p;
+		size_t bytes = 0;
+		bool numeric = true;
+		float value = 0.0f;
+		switch (tags[i]) {
+		case 'i':
+			bytes = 4;
+			if (left >= bytes) value = (float)(int32_t)readU32(p);
+			break;
+		case 'f':
+			bytes = 4;
+			if (left >= bytes) {
+				const uint32_t bits = readU32(p);
+				memcpy(&value, &bits, sizeof(value));
+			}
+			break;
+		case 'h':
+			bytes = 8;
+			if (left >= bytes) value = (float)(int64_t)readU64(p);
+			break;
+		case 'd':
+			bytes = 8;
+			if (left >= bytes) {
+				const uint64_t bits = readU64(p);
+				double d;
+				memcpy(&d, &bits, sizeof(d));
+				value = (float)d;
+			}
+			break;
+		case 'T':
+		case 'I':
+			value = 1.0f;
+			break;
+		case 'F':
+			value = 0.0f;
+			break;
+		case 's':
+		case 'S':
+			numeric = false;
+			nul = static_cast<const char*>(memchr(p, 0, left));
+			bytes = nul ? pad4(nul - p + 1) : left + 1;
+			break;
+		case 'b':
+			numeric = false;
+			bytes = left >= 4 ? 4 + pad4(readU32(p)) : 4;
+			break;
+		case 't':
+			numeric = false;
+			bytes = 8;
+			break;
+		case 'c':
+		case 'r':
+		case 'm':
+			numeric = false;
+			bytes = 4;
+			break;
+		default:
+			// N, array brackets and unknown tags carry no data
+			numeric = false;
+			break;
+		}
+		if (bytes > left) {
+			mMalformed.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		p += bytes;
+		// arguments past the route's own would land in the slots of other routes
+		if (numeric && n < route->numArguments) {
+			push({ slot + n, value, due, arrival });
+			n++;
+		}
+	}
+	// a message without numeric arguments is a trigger
+	if (n == 0) push({ slot, 1.0f, due, arrival });
+}
+
+bool SkyOscReceiver::push(const Event &event)
+{
+	const size_t head = mHead.load(memory_order_relaxed);
+	if (head - mTail.load(memory_order_acquire) >= kQueueCapacity) {
+		mDropped.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+	mQueue[head % kQueueCapacity] = event;
+	mHead.store(head + 1, memory_order_release);
+	return true;
+}
+
+bool SkyOscReceiver::pop(Event &event)
+{
+	const size_t tail = mTail.load(memory_order_relaxed);
+	if (tail == mHead.load(memory_order_acquire)) return false;
+	event = mQueue[tail % kQueueCapacity];
+	mTail.store(tail + 1, memory_order_release);
+	return true;
+}
+
+void SkyOscReceiver::update()
+{
+	for (const auto &change : mChanges) mChangeIndex[change.first] = -1;
+	mChanges.clear();
+	const int64_t time = now();
+
+	// bundles that came due, in the order they arrived
+	size_t kept = 0;
+	for (size_t i = 0; i < mDeferred.size(); i++) {
+		if (mDeferred[i].due <= time) apply(mDeferred[i], time);
+		else mDeferred[kept++] = mDeferred[i];
+	}
+	mDeferred.resize(kept);
+
+	Event event;
+	while (pop(event)) {
+		if (event.due > time && mDeferred.size() < mDeferred.capacity()) {
+			mDeferred.push_back(event);
+			mDeferredCount++;
+			continue;
+		}
+		apply(event, time);
+	}
+}
+
+void SkyOscReceiver::apply(const Event &event, int64_t now)
+{
+	// only the newest value of a slot reaches the uniforms
+	int32_t &index = mChangeIndex[event.slot];
+	if (index < 0) {
+		index = (int32_t)mChanges.size();
+		mChanges.emplace_back(event.slot, event.value);
+	}
+	else {
+		mChanges[index].second = event.value;
+	}
+	mApplied++;
+	const double latency = (now - max(event.arrival, event.due)) / 1000000.0;
+	mLatencySum += latency;
+	mMaxLatency = max(mMaxLatency, latency);
+}
+
+SkyOscReceiver::Stats SkyOscReceiver::getStats() const
+{
+	Stats stats;
+	stats.packets = mPackets.load();
+	stats.messages = mMessages.load();
+	stats.bundles = mBundles.load();
+	stats.unrouted = mUnrouted.load();
+	stats.malformed = mMalformed.load();
+	stats.dropped = mDropped.load();
+	stats.deferred = mDeferredCount;
+	stats.applied = mApplied;
+	stats.meanLatencyMs = mApplied ? mLatencySum / mApplied : 0.0;
+	stats.maxLatencyMs = mMaxLatency;
+	return stats;
+}
+
+void SkyOscReceiver::resetStats()
+{
+	for (auto *counter : { &mPackets, &mMessages, &mBundles, &mUnrouted, &mMalformed, &mDropped }) counter->store(0);
+	mDeferredCount = mApplied = 0;
+	mLatencySum = mMaxLatency = 0.0;
+}
+
+SkyOscReceiver::BenchmarkResults SkyOscReceiver::benchmark(uint16_t port, int rate, double seconds)
+{
+	BenchmarkResults results;
+	results.rate = rate;
+	vector<Route> routes;
+	for (int i = 0; i < 128; i++) routes.push_back({ "/sky/uniform/" + to_string(i), i });
+	vector<string> addresses;
+	for (const auto &route : routes) addresses.push_back(route.address);
+	auto receiver = create(port, routes);
+	if (!receiver) return results;
+
+	atomic<bool> sending{ true };
+	atomic<uint64_t> sent{ 0 };
+	thread sender([&] {
+		asio::io_service io;
+		asio::ip::udp::socket socket(io);
+		asio::error_code ec;
+		socket.open(asio::ip::udp::v4(), ec);
+		socket.set_option(asio::socket_base::send_buffer_size(8 << 20), ec);
+		const asio::ip::udp::endpoint endpoint(asio::ip::address_v4::loopback(), receiver->getPort());
+		array<char, 256> packet;
+		uint64_t index = 0;
+		const int64_t start = now();
+		while (sending) {
+			// catch up in bursts, sleeps are too coarse for one message every 20 microseconds
+			const uint64_t due = (uint64_t)((now() - start) * 1e-9 * rate);
+			for (; index < due; index++) {
+				const string &address = addresses[index % addresses.size()];
+				size_t size;
+				if (index % 10 == 9) {
+					// a bundle for 5 ms from now
+					memcpy(packet.data(), "#bundle", 8);
+					const uint64_t timetag = ntpNow() + (5ull << 32) / 1000;
+					writeU32(packet.data() + 8, (uint32_t)(timetag >> 32));
+					writeU32(packet.data() + 12, (uint32_t)timetag);
+					const size_t bytes = writeMessage(packet.data() + 20, address, (float)index);
+					writeU32(packet.data() + 16, (uint32_t)bytes);
+					size = 20 + bytes;
+				}
+				else {
+					size = writeMessage(packet.data(), address, (float)index);
+				}
+				socket.send_to(asio::buffer(packet.data(), size), endpoint, 0, ec);
+				sent++;
+			}
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	});
+
+	const int64_t start = now();
+	const int64_t frame = 1000000000 / 60;
+	int64_t next = start;
+	while (now() - start < (int64_t)(seconds * 1e9)) {
+		receiver->update();
+		next += frame;
+		this_thread::sleep_for(chrono::nanoseconds(max<int64_t>(0, next - now())));
+	}
+	sending = false;
+	sender.join();
+	// let the last bundles come due
+	this_thread::sleep_for(chrono::milliseconds(50));
+	receiver->update();
+
+	results.seconds = (now() - start) * 1e-9;
+	results.sent = sent;
+	results.stats = receiver->getStats();
+	return results;
+}
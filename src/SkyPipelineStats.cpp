@@ -0,0 +1,73 @@
+#include "SkyPipelineStats.h"
+
+#include "cinder/Log.h"
+
+// ARB_pipeline_statistics_query, core in 4.6
+#if ! defined( GL_PRIMITIVES_SUBMITTED_ARB )
+#define GL_PRIMITIVES_SUBMITTED_ARB						0x82EF
+#define GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB		0x82F2
+#define GL_GEOMETRY_SHADER_PRIMITIVES_EMITTED_ARB		0x82F3
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB				0x82F4
+#endif
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	// in the order of SkyPipelineStats::Counters, the core query first
+	const GLenum kTargets[] = {
+		GL_PRIMITIVES_GENERATED,
+		GL_PRIMITIVES_SUBMITTED_ARB,
+		GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB,
+		GL_GEOMETRY_SHADER_PRIMITIVES_EMITTED_ARB,
+		GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+	};
+}
+
+SkyPipelineStats::SkyPipelineStats()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	mSupported = gl::isExtensionAvailable("GL_ARB_pipeline_statistics_query") || major * 10 + minor >= 46;
+	mNumTargets = mSupported ? kNumTargets : 1;
+	for (auto &queries : mQueries) glGenQueries(kNumTargets, queries);
+	CI_LOG_I("pipeline statistics " << (mSupported ? "available" : "not available, primitives generated only"));
+}
+
+SkyPipelineStats::~SkyPipelineStats()
+{
+	for (auto &queries : mQueries) glDeleteQueries(kNumTargets, queries);
+}
+
+void SkyPipelineStats::begin()
+{
+	// every frame in flight, skip counting this one rather than stall
+	if (mWrite - mRead >= kNumFrames) return;
+	for (int i = 0; i < mNumTargets; i++) glBeginQuery(kTargets[i], mQueries[mWrite % kNumFrames][i]);
+	mActive = true;
+}
+
+void SkyPipelineStats::end()
+{
+	if (mActive) {
+		for (int i = 0; i < mNumTargets; i++) glEndQuery(kTargets[i]);
+		mWrite++;
+		mActive = false;
+	}
+	// collect the finished frames without waiting, the last target ends last
+	while (mRead < mWrite) {
+		GLuint *queries = mQueries[mRead % kNumFrames];
+		GLint available = 0;
+		glGetQueryObjectiv(queries[mNumTargets - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		GLuint64 values[kNumTargets] = {};
+		for (int i = 0; i < mNumTargets; i++) glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &values[i]);
+		mCounters.primitivesGenerated = values[0];
+		mCounters.patches = values[1];
+		mCounters.evaluations = values[2];
+		mCounters.geometryPrimitives = values[3];
+		mCounters.fragments = values[4];
+		mRead++;
+	}
+}
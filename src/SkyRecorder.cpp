@@ -0,0 +1,332 @@
+#include "SkyRecorder.h"
+
+#include "cinder/Log.h"
+
+#include <cstdio>
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+	{
+		static uint32_t table[256] = { 0 };
+		if (!table[1]) {
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[i] = c;
+			}
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void putBigEndian(vector<uint8_t> &out, uint32_t value)
+	{
+		out.push_back((uint8_t)(value >> 24));
+		out.push_back((uint8_t)(value >> 16));
+		out.push_back((uint8_t)(value >> 8));
+		out.push_back((uint8_t)value);
+	}
+
+	// length, type, data and the crc of type and data
+	void putChunk(vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size)
+	{
+		putBigEndian(out, (uint32_t)size);
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		if (size) out.insert(out.end(), data, data + size);
+		putBigEndian(out, crc32(&out[start], size + 4));
+	}
+}
+
+SkyRecorderRef SkyRecorder::create(const fs::path &path, const ivec2 &size, const Format &format)
+{
+	SkyRecorderRef recorder(new SkyRecorder(path, size, format));
+	if (!recorder->open()) return nullptr;
+	return recorder;
+}
+
+SkyRecorder::SkyRecorder(const fs::path &path, const ivec2 &size, const Format &format)
+	: mPath(path), mSize(size), mFormat(format), mFrameBytes((size_t)size.x * size.y * 4)
+{
+}
+
+bool SkyRecorder::open()
+{
+	if (mFormat.mKind == Kind::PNG) {
+		fs::create_directories(mPath);
+		if (!fs::is_directory(mPath)) {
+			CI_LOG_E("cannot create " << mPath);
+			return false;
+		}
+	}
+	else {
+		mStream.open(mPath.string(), ios::binary);
+		if (!mStream) {
+			CI_LOG_E("cannot open " << mPath);
+			return false;
+		}
+		mStream << "YUV4MPEG2 W" << mSize.x << " H" << mSize.y << " F" << mFormat.mFps << ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+	}
+
+	mSlots.resize(std::max<size_t>(2, mFormat.mNumSlots));
+	for (size_t i = 0; i < mSlots.size(); i++) {
+		mSlots[i].pbo = gl::Pbo::create(GL_PIXEL_PACK_BUFFER, mFrameBytes, nullptr, GL_STREAM_READ);
+		mFreeSlots.push_back(i);
+	}
+	for (size_t i = 0; i < std::max<size_t>(1, mFormat.mNumThreads); i++) {
+		mThreads.emplace_back(&SkyRecorder::encoderFn, this);
+	}
+	CI_LOG_I("recording " << mSize.x << "x" << mSize.y << " to " << mPath << " with " << mSlots.size() << " buffers");
+	return true;
+}
+
+SkyRecorder::~SkyRecorder()
+{
+	stop();
+}
+
+void SkyRecorder::capture(const gl::Texture2dRef &texture)
+{
+	if (mStopped) return;
+	reclaim();
+	collect(false);
+
+	mStats.captured++;
+	if (texture->getSize() != mSize || mFreeSlots.empty()) {
+		mStats.dropped++;
+		return;
+	}
+	size_t index = mFreeSlots.front();
+	mFreeSlots.pop_front();
+	Slot &slot = mSlots[index];
+	slot.sequence = mSequence++;
+	{
+		gl::ScopedBuffer scopedPbo(slot.pbo);
+		gl::ScopedTextureBind scopedTex(texture);
+		GLint alignment;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	}
+	slot.fence = gl::Sync::create();
+	mReadbackSlots.push_back(index);
+	mStats.maxBusy = std::max(mStats.maxBusy, mSlots.size() - mFreeSlots.size());
+}
+
+void SkyRecorder::collect(bool wait)
+{
+	// readbacks complete in order, stop at the first one still in flight
+	size_t queued = 0;
+	while (!mReadbackSlots.empty()) {
+		Slot &slot = mSlots[mReadbackSlots.front()];
+		GLenum result = wait ? slot.fence->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) : slot.fence->clientWaitSync(0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) break;
+		slot.fence.reset();
+		{
+			gl::ScopedBuffer scopedPbo(slot.pbo);
+			slot.data = (const uint8_t *)slot.pbo->mapBufferRange(0, mFrameBytes, GL_MAP_READ_BIT);
+		}
+		{
+			lock_guard<mutex> lock(mMutex);
+			mEncodeSlots.push_back(mReadbackSlots.front());
+		}
+		mReadbackSlots.pop_front();
+		queued++;
+	}
+	if (queued) mCondition.notify_all();
+}
+
+void SkyRecorder::reclaim()
+{
+	deque<size_t> done;
+	{
+		lock_guard<mutex> lock(mMutex);
+		done.swap(mDoneSlots);
+	}
+	for (size_t index : done) {
+		Slot &slot = mSlots[index];
+		if (slot.data) {
+			gl::ScopedBuffer scopedPbo(slot.pbo);
+			slot.pbo->unmap();
+			slot.data = nullptr;
+		}
+		mFreeSlots.push_back(index);
+	}
+}
+
+void SkyRecorder::encoderFn()
+{
+	vector<uint8_t> encoded;
+	while (true) {
+		size_t index;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return !mRunning || !mEncodeSlots.empty(); });
+			if (mEncodeSlots.empty()) return;
+			index = mEncodeSlots.front();
+			mEncodeSlots.pop_front();
+		}
+		const Slot &slot = mSlots[index];
+		bool written = false;
+		if (slot.data && mFormat.mKind == Kind::PNG) {
+			encodePng(slot.data, mSize.x, mSize.y, encoded);
+			char name[32];
+			snprintf(name, sizeof(name), "frame_%06llu.png", (unsigned long long)slot.sequence);
+			ofstream file((mPath / name).string(), ios::binary);
+			written = (bool)file.write((const char *)encoded.data(), encoded.size());
+		}
+		else if (mFormat.mKind == Kind::Y4M) {
+			if (slot.data) convertToI420(slot.data, mSize.x, mSize.y, encoded);
+			// a frame that could not be mapped still takes its turn so the writers do not wait forever
+			unique_lock<mutex> lock(mWriteMutex);
+			mWriteCondition.wait(lock, [this, &slot] { return mNextWrite == slot.sequence; });
+			if (slot.data) {
+				mStream << "FRAME\n";
+				written = (bool)mStream.write((const char *)encoded.data(), encoded.size());
+			}
+			mNextWrite++;
+			mWriteCondition.notify_all();
+		}
+		if (written) mWritten++;
+		else CI_LOG_W("frame " << slot.sequence << " not written");
+
+		lock_guard<mutex> lock(mMutex);
+		mDoneSlots.push_back(index);
+	}
+}
+
+void SkyRecorder::stop()
+{
+	if (mStopped) return;
+	mStopped = true;
+	collect(true);
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for (auto &thread : mThreads) thread.join();
+	mThreads.clear();
+	reclaim();
+	if (mStream.is_open()) mStream.close();
+
+	auto stats = getStats();
+	CI_LOG_I("recorded " << stats.written << " of " << stats.captured << " frames to " << mPath << ", dropped " << stats.dropped
+		<< ", at most " << stats.maxBusy << " of " << mSlots.size() << " buffers busy");
+}
+
+SkyRecorder::Stats SkyRecorder::getStats() const
+{
+	Stats stats = mStats;
+	stats.written = mWritten.load();
+	return stats;
+}
+
+void SkyRecorder::encodePng(const uint8_t *rgba, int width, int height, vector<uint8_t> &png)
+{
+	const size_t rowBytes = (size_t)width * 4;
+	const size_t rawBytes = (rowBytes + 1) * height;
+	const size_t blocks = (rawBytes + 65534) / 65535;
+	png.clear();
+	png.reserve(rawBytes + blocks * 5 + 64);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	png.insert(png.end(), signature, signature + 8);
+	uint8_t header[13] = { 0 };
+	for (int i = 0; i < 4; i++) {
+		header[i] = (uint8_t)(width >> (24 - 8 * i));
+		header[4 + i] = (uint8_t)(height >> (24 - 8 * i));
+	}
+	header[8] = 8;		// bits per channel
+	header[9] = 6;		// RGBA
+	putChunk(png, "IHDR", header, sizeof(header));
+
+	// zlib stream of stored blocks over the filtered rows, top row first
+	vector<uint8_t> idat;
+	idat.reserve(rawBytes + blocks * 5 + 6);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	uint32_t a = 1, b = 0;
+	size_t remaining = rawBytes, row = 0, column = 0;
+	while (remaining > 0) {
+		uint16_t length = (uint16_t)std::min<size_t>(remaining, 65535);
+		remaining -= length;
+		idat.push_back(remaining == 0 ? 1 : 0);
+		idat.push_back((uint8_t)length);
+		idat.push_back((uint8_t)(length >> 8));
+		idat.push_back((uint8_t)~length);
+		idat.push_back((uint8_t)(~length >> 8));
+		size_t left = length;
+		while (left > 0) {
+			if (column == 0) {
+				idat.push_back(0);		// no filter
+				b = (b + a) % 65521;
+				column = 1;
+				left--;
+				continue;
+			}
+			const uint8_t *src = rgba + (size_t)(height - 1 - row) * rowBytes + (column - 1);
+			size_t count = std::min(left, rowBytes + 1 - column);
+			idat.insert(idat.end(), src, src + count);
+			// adler32, deferring the modulo as long as the sums cannot overflow
+			for (size_t done = 0; done < count;) {
+				size_t chunk = std::min<size_t>(count - done, 5552);
+				for (size_t i = 0; i < chunk; i++) {
+					a += src[done + i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+				done += chunk;
+			}
+			column += count;
+			left -= count;
+			if (column == rowBytes + 1) {
+				column = 0;
+				row++;
+			}
+		}
+	}
+	putBigEndian(idat, (b << 16) | a);
+	putChunk(png, "IDAT", idat.data(), idat.size());
+	putChunk(png, "IEND", nullptr, 0);
+}
+
+void SkyRecorder::convertToI420(const uint8_t *rgba, int width, int height, vector<uint8_t> &yuv)
+{
+	const int chromaWidth = (width + 1) / 2;
+	const int chromaHeight = (height + 1) / 2;
+	yuv.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+	uint8_t *yPlane = yuv.data();
+	uint8_t *uPlane = yPlane + (size_t)width * height;
+	uint8_t *vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+	// fixed point, 16 fractional bits
+	for (int y = 0; y < height; y++) {
+		const uint8_t *src = rgba + (size_t)(height - 1 - y) * width * 4;
+		uint8_t *dst = yPlane + (size_t)y * width;
+		for (int x = 0; x < width; x++, src += 4) {
+			dst[x] = (uint8_t)((19595 * src[0] + 38470 * src[1] + 7471 * src[2] + 32768) >> 16);
+		}
+	}
+	for (int cy = 0; cy < chromaHeight; cy++) {
+		int y0 = std::min(2 * cy, height - 1), y1 = std::min(2 * cy + 1, height - 1);
+		const uint8_t *row0 = rgba + (size_t)(height - 1 - y0) * width * 4;
+		const uint8_t *row1 = rgba + (size_t)(height - 1 - y1) * width * 4;
+		for (int cx = 0; cx < chromaWidth; cx++) {
+			int x0 = 2 * cx * 4, x1 = std::min(2 * cx + 1, width - 1) * 4;
+			int r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+			int g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+			int bl = row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2];
+			// averaged over the four pixels, so the shift is two more
+			int u = (-11059 * r - 21709 * g + 32768 * bl + (128 << 18) + (1 << 17)) >> 18;
+			int v = (32768 * r - 27439 * g - 5329 * bl + (128 << 18) + (1 << 17)) >> 18;
+			uPlane[(size_t)cy * chromaWidth + cx] = (uint8_t)std::min(255, std::max(0, u));
+			vPlane[(size_t)cy * chromaWidth + cx] = (uint8_t)std::min(255, std::max(0, v));
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#include "SkyShaderCache.h"
+
+#include "cinder/Log.h"
+#include "cinder/Timer.h"
+
+using namespace ci;
+using namespace std;
+
+SkyShaderProgram::SkyShaderProgram(const gl::GlslProgRef &glsl, const SkyShaderPreprocessor::GeneratedRef &generated)
+	: mGlsl(glsl), mGenerated(generated)
+{
+	for (const auto &uniform : mGlsl->getActiveUniforms()) {
+		// arrays are reported as name[0]
+		string name = uniform.mName.substr(0, uniform.mName.find('['));
+		mSlots[name] = (int)mLocations.size();
+		mLocations.push_back(uniform.mLoc);
+	}
+	int unit = 0;
+	for (const auto &input : mGenerated->inputs) {
+		int slot = findSlot(input.name);
+		mInputSlots.push_back(slot);
+		bool image = input.type == SkyShaderPreprocessor::InputType::IMAGE || input.type == SkyShaderPreprocessor::InputType::AUDIO;
+		mInputUnits.push_back(image && slot >= 0 ? unit : -1);
+		if (image && slot >= 0) set(slot, unit++);
+	}
+	applyDefaults();
+}
+
+int SkyShaderProgram::findSlot(const string &name) const
+{
+	auto it = mSlots.find(name);
+	return it == mSlots.end() ? -1 : it->second;
+}
+
+void SkyShaderProgram::applyDefaults() const
+{
+	typedef SkyShaderPreprocessor::InputType InputType;
+	const auto &inputs = mGenerated->inputs;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		const float *v = inputs[i].value;
+		switch (inputs[i].type) {
+		case InputType::FLOAT: set(mInputSlots[i], v[0]); break;
+		case InputType::BOOL:
+		case InputType::EVENT:
+		case InputType::LONG: set(mInputSlots[i], (int)v[0]); break;
+		case InputType::POINT2D: set(mInputSlots[i], vec2(v[0], v[1])); break;
+		case InputType::COLOR: set(mInputSlots[i], vec4(v[0], v[1], v[2], v[3])); break;
+		default: break;
+		}
+	}
+}
+
+SkyShaderCache::SkyShaderCache(const string &preamble, const string &vertex)
+	: mPreprocessor(SkyShaderPreprocessor::create(preamble)), mVertex(vertex)
+{
+}
+
+SkyShaderProgramRef SkyShaderCache::get(const string &fragment)
+{
+	auto generated = preprocess(fragment);
+	SkyShaderProgramRef program;
+	if (find(generated->hash, program)) return program;
+
+	program = compile(getFormat(generated), generated);
+	insert(generated->hash, program);
+	return program;
+}
+
+SkyShaderPreprocessor::GeneratedRef SkyShaderCache::preprocess(const string &fragment)
+{
+	lock_guard<mutex> lock(mMutex);
+	return mPreprocessor->process(fragment);
+}
+
+gl::GlslProg::Format SkyShaderCache::getFormat(const SkyShaderPreprocessor::GeneratedRef &generated) const
+{
+	return gl::GlslProg::Format().vertex(mVertex).fragment(generated->source);
+}
+
+bool SkyShaderCache::find(uint64_t hash, SkyShaderProgramRef &program)
+{
+	lock_guard<mutex> lock(mMutex);
+	auto it = mPrograms.find(hash);
+	if (it == mPrograms.end()) return false;
+	program = it->second;
+	return true;
+}
+
+void SkyShaderCache::insert(uint64_t hash, const SkyShaderProgramRef &program)
+{
+	lock_guard<mutex> lock(mMutex);
+	mPrograms[hash] = program;
+}
+
+SkyShaderProgramRef SkyShaderCache::compile(const gl::GlslProg::Format &format, const SkyShaderPreprocessor::GeneratedRef &generated)
+{
+	SkyShaderProgramRef program;
+	Timer timer(true);
+	try {
+		program = make_shared<SkyShaderProgram>(gl::GlslProg::create(format), generated);
+		CI_LOG_I("compiled shader " << std::hex << generated->hash << std::dec << " in " << timer.getSeconds() * 1000.0 << "ms, kept "
+			<< generated->emitted << " preamble declarations, skipped " << generated->skipped);
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("shader " << std::hex << generated->hash, exc);
+	}
+	return program;
+}
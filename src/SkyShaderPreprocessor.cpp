@@ -0,0 +1,409 @@
+#include "SkyShaderPreprocessor.h"
+
+#include <cctype>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+	// ISF built-ins, only emitted when the shader uses them and the preamble does not provide them
+	const char *kIsfBuiltins =
+		"uniform vec2 RENDERSIZE;\n"
+		"uniform float TIME;\n"
+		"uniform float TIMEDELTA;\n"
+		"uniform int FRAMEINDEX;\n"
+		"uniform int PASSINDEX;\n"
+		"uniform vec4 DATE;\n"
+		"out vec4 fragColor;\n"
+		"vec2 isf_FragNormCoord = gl_FragCoord.xy / RENDERSIZE;\n"
+		"#define IMG_NORM_PIXEL(i, c) texture(i, c)\n"
+		"#define IMG_PIXEL(i, c) texture(i, (c) / vec2(textureSize(i, 0)))\n"
+		"#define IMG_THIS_NORM_PIXEL(i) texture(i, isf_FragNormCoord)\n"
+		"#define IMG_THIS_PIXEL(i) texture(i, isf_FragNormCoord)\n"
+		"#define IMG_SIZE(i) vec2(textureSize(i, 0))\n";
+
+	const unordered_set<string> kTypes = {
+		"void", "bool", "int", "uint", "float", "double",
+		"vec2", "vec3", "vec4", "ivec2", "ivec3", "ivec4", "uvec2", "uvec3", "uvec4", "bvec2", "bvec3", "bvec4",
+		"mat2", "mat3", "mat4", "sampler1D", "sampler2D", "sampler3D", "samplerCube", "sampler2DRect"
+	};
+
+	bool isIdentStart(char c) { return isalpha((unsigned char)c) || c == '_'; }
+	bool isIdentChar(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+	// minimal JSON reader, enough for ISF headers
+	struct JsonValue {
+		enum Kind { NUL, NUMBER, STRING, BOOL, ARRAY, OBJECT } kind = NUL;
+		double								number = 0.0;
+		string								text;
+		vector<JsonValue>					items;
+		vector<pair<string, JsonValue>>		members;
+
+		const JsonValue* find(const string &key) const
+		{
+			for (const auto &member : members) {
+				if (member.first == key) return &member.second;
+			}
+			return nullptr;
+		}
+	};
+
+	class JsonReader {
+	public:
+		JsonReader(const string &text, size_t pos, size_t end) : mText(text), mPos(pos), mEnd(end) {}
+
+		bool parse(JsonValue &value)
+		{
+			skip();
+			if (mPos >= mEnd) return false;
+			char c = mText[mPos];
+			if (c == '{') return parseObject(value);
+			if (c == '[') return parseArray(value);
+			if (c == '"') {
+				value.kind = JsonValue::STRING;
+				return parseString(value.text);
+			}
+			if (c == 't' || c == 'f' || c == 'n') {
+				size_t start = mPos;
+				while (mPos < mEnd && isalpha((unsigned char)mText[mPos])) mPos++;
+				string word = mText.substr(start, mPos - start);
+				value.kind = word == "null" ? JsonValue::NUL : JsonValue::BOOL;
+				value.number = word == "true" ? 1.0 : 0.0;
+				return word == "true" || word == "false" || word == "null";
+			}
+			char *stop = nullptr;
+			value.number = strtod(mText.c_str() + mPos, &stop);
+			if (stop == mText.c_str() + mPos) return false;
+			mPos = stop - mText.c_str();
+			value.kind = JsonValue::NUMBER;
+			return true;
+		}
+	private:
+		void skip()
+		{
+			while (mPos < mEnd && isspace((unsigned char)mText[mPos])) mPos++;
+		}
+		bool parseString(string &out)
+		{
+			for (mPos++; mPos < mEnd; mPos++) {
+				char c = mText[mPos];
+				if (c == '"') {
+					mPos++;
+					return true;
+				}
+				if (c == '\\' && mPos + 1 < mEnd) c = mText[++mPos];
+				out += c;
+			}
+			return false;
+		}
+		bool parseArray(JsonValue &value)
+		{
+			value.kind = JsonValue::ARRAY;
+			mPos++;
+			while (true) {
+				skip();
+				if (mPos >= mEnd) return false;
+				if (mText[mPos] == ']') {
+					mPos++;
+					return true;
+				}
+				value.items.emplace_back();
+				if (!parse(value.items.back())) return false;
+				skip();
+				if (mPos < mEnd && mText[mPos] == ',') mPos++;
+			}
+		}
+		bool parseObject(JsonValue &value)
+		{
+			value.kind = JsonValue::OBJECT;
+			mPos++;
+			while (true) {
+				skip();
+				if (mPos >= mEnd) return false;
+				if (mText[mPos] == '}') {
+					mPos++;
+					return true;
+				}
+				string key;
+				if (mText[mPos] != '"' || !parseString(key)) return false;
+				skip();
+				if (mPos >= mEnd || mText[mPos] != ':') return false;
+				mPos++;
+				value.members.emplace_back(key, JsonValue());
+				if (!parse(value.members.back().second)) return false;
+				skip();
+				if (mPos < mEnd && mText[mPos] == ',') mPos++;
+			}
+		}
+
+		const string	&mText;
+		size_t			mPos, mEnd;
+	};
+}
+
+SkyShaderPreprocessor::SkyShaderPreprocessor(const string &preamble)
+{
+	parseDeclarations(preamble, mPreamble, mVersion);
+	string unused;
+	parseDeclarations(kIsfBuiltins, mIsfBuiltins, unused);
+	if (mVersion.empty()) mVersion = "#version 150";
+	mPreambleHash = hash(preamble);
+}
+
+uint64_t SkyShaderPreprocessor::hash(const string &text, uint64_t seed)
+{
+	// FNV-1a
+	uint64_t h = seed;
+	for (unsigned char c : text) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+void SkyShaderPreprocessor::parseDeclarations(const string &text, vector<Declaration> &declarations, string &version)
+{
+	istringstream lines(text);
+	string line;
+	while (getline(lines, line)) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == string::npos) continue;
+		if (line[first] == '#') {
+			istringstream directive(line.substr(first + 1));
+			string keyword, name;
+			directive >> keyword >> name;
+			if (keyword == "version") {
+				version = line.substr(first);
+			}
+			else if (keyword == "define") {
+				// function-like macros carry their parameter list in the name token
+				name = name.substr(0, name.find('('));
+				declarations.push_back({ name, line.substr(first), false });
+			}
+			continue;
+		}
+		// several declarations may share a line, the trailing comment stays with the last one
+		string code = line.substr(0, line.find("//"));
+		size_t start = 0;
+		size_t semicolon;
+		while ((semicolon = code.find(';', start)) != string::npos) {
+			string statement = code.substr(start, semicolon + 1 - start);
+			start = semicolon + 1;
+			istringstream words(statement);
+			vector<string> tokens;
+			string word;
+			while (words >> word) tokens.push_back(word);
+			if (tokens.size() < 3) continue;
+			bool early = tokens[0] == "uniform" || tokens[0] == "out";
+			// the declared name is the third token for "uniform type name" and the second for "type name = ..."
+			string name = early ? tokens[2] : tokens[1];
+			size_t nameEnd = 0;
+			while (nameEnd < name.size() && isIdentChar(name[nameEnd])) nameEnd++;
+			name = name.substr(0, nameEnd);
+			if (name.empty()) continue;
+			size_t statementStart = statement.find_first_not_of(" \t");
+			declarations.push_back({ name, statement.substr(statementStart), early });
+		}
+	}
+}
+
+void SkyShaderPreprocessor::scanBody(const string &body, unordered_set<string> &identifiers, unordered_set<string> &declared, string &version)
+{
+	const size_t size = body.size();
+	bool lineStart = true;
+	int braces = 0, parens = 0;
+	string previous[2];
+	for (size_t i = 0; i < size;) {
+		char c = body[i];
+		if (c == '/' && i + 1 < size && body[i + 1] == '/') {
+			while (i < size && body[i] != '\n') i++;
+			continue;
+		}
+		if (c == '/' && i + 1 < size && body[i + 1] == '*') {
+			size_t end = body.find("*/", i + 2);
+			i = end == string::npos ? size : end + 2;
+			continue;
+		}
+		if (c == '\n') {
+			lineStart = true;
+			i++;
+			continue;
+		}
+		if (lineStart && c == '#') {
+			size_t end = body.find('\n', i);
+			if (end == string::npos) end = size;
+			string directive = body.substr(i, end - i);
+			istringstream words(directive.substr(1));
+			string keyword, name;
+			words >> keyword >> name;
+			if (keyword == "version") {
+				version = directive;
+			}
+			else {
+				if (keyword == "define") declared.insert(name.substr(0, name.find('(')));
+				// identifiers used inside the directive still count as references
+				for (size_t j = 1; j < directive.size();) {
+					if (isIdentStart(directive[j])) {
+						size_t k = j;
+						while (k < directive.size() && isIdentChar(directive[k])) k++;
+						identifiers.insert(directive.substr(j, k - j));
+						j = k;
+					}
+					else {
+						j++;
+					}
+				}
+			}
+			i = end;
+			continue;
+		}
+		if (!isspace((unsigned char)c)) lineStart = false;
+		if (isIdentStart(c)) {
+			size_t start = i;
+			while (i < size && isIdentChar(body[i])) i++;
+			string ident = body.substr(start, i - start);
+			if (ident == "lowp" || ident == "mediump" || ident == "highp") continue;
+			// "uniform type name", "out type name" or a global "type name" declares name in the body itself
+			if (previous[0] == "uniform" || previous[0] == "out" || (braces == 0 && parens == 0 && kTypes.count(previous[1]))) declared.insert(ident);
+			identifiers.insert(ident);
+			previous[0] = previous[1];
+			previous[1] = ident;
+			continue;
+		}
+		if (c == '{') braces++;
+		else if (c == '}') braces = max(0, braces - 1);
+		else if (c == '(') parens++;
+		else if (c == ')') parens = max(0, parens - 1);
+		if (!isspace((unsigned char)c) && c != '(' && c != ')') {
+			previous[0].clear();
+			previous[1].clear();
+		}
+		i++;
+	}
+}
+
+bool SkyShaderPreprocessor::parseIsfHeader(const string &shader, vector<Input> &inputs, size_t &headerEnd)
+{
+	size_t open = shader.find("/*");
+	if (open == string::npos || shader.find_first_not_of(" \t\r\n") != open) return false;
+	size_t brace = shader.find_first_not_of(" \t\r\n", open + 2);
+	if (brace == string::npos || shader[brace] != '{') return false;
+	size_t close = shader.find("*/", brace);
+	if (close == string::npos) return false;
+	headerEnd = close + 2;
+
+	JsonValue root;
+	JsonReader reader(shader, brace, close);
+	if (!reader.parse(root) || root.kind != JsonValue::OBJECT) return false;
+	const JsonValue *list = root.find("INPUTS");
+	if (!list || list->kind != JsonValue::ARRAY) return true;
+
+	for (const auto &item : list->items) {
+		const JsonValue *name = item.find("NAME");
+		const JsonValue *type = item.find("TYPE");
+		if (!name || !type || name->kind != JsonValue::STRING || type->kind != JsonValue::STRING) continue;
+		Input input;
+		input.name = name->text;
+		const string &t = type->text;
+		if (t == "image") input.type = InputType::IMAGE;
+		else if (t == "float") input.type = InputType::FLOAT;
+		else if (t == "bool") input.type = InputType::BOOL;
+		else if (t == "long") input.type = InputType::LONG;
+		else if (t == "point2D") input.type = InputType::POINT2D;
+		else if (t == "color") input.type = InputType::COLOR;
+		else if (t == "event") input.type = InputType::EVENT;
+		else if (t == "audio" || t == "audioFFT") input.type = InputType::AUDIO;
+		else continue;
+
+		if (const JsonValue *value = item.find("DEFAULT")) {
+			if (value->kind == JsonValue::ARRAY) {
+				for (size_t i = 0; i < value->items.size() && i < 4; i++) input.value[i] = (float)value->items[i].number;
+			}
+			else {
+				input.value[0] = (float)value->number;
+			}
+		}
+		inputs.push_back(input);
+	}
+	return true;
+}
+
+SkyShaderPreprocessor::GeneratedRef SkyShaderPreprocessor::process(const string &shader)
+{
+	uint64_t key = hash(shader, mPreambleHash);
+	auto cached = mCache.find(key);
+	if (cached != mCache.end()) return cached->second;
+
+	auto generated = make_shared<Generated>();
+	generated->hash = key;
+	size_t headerEnd = 0;
+	if (!parseIsfHeader(shader, generated->inputs, headerEnd)) headerEnd = 0;
+	const string body = shader.substr(headerEnd);
+
+	unordered_set<string> identifiers, declared;
+	string version;
+	scanBody(body, identifiers, declared, version);
+	if (version.empty()) version = mVersion;
+
+	// the body's own declarations win over ISF inputs, which win over the preamble, which wins over the ISF built-ins
+	vector<string> inputDecls;
+	for (auto &input : generated->inputs) {
+		input.referenced = identifiers.count(input.name) && !declared.count(input.name);
+		if (!input.referenced) continue;
+		static const char *glslTypes[] = { "sampler2D", "float", "bool", "int", "vec2", "vec4", "bool", "sampler2D" };
+		inputDecls.push_back(string("uniform ") + glslTypes[(int)input.type] + " " + input.name + ";");
+		declared.insert(input.name);
+	}
+
+	vector<const Declaration*> candidates;
+	unordered_set<string> provided;
+	for (const auto &decl : mPreamble) {
+		if (!declared.count(decl.name) && provided.insert(decl.name).second) candidates.push_back(&decl);
+	}
+	const size_t preambleCandidates = candidates.size();
+	for (const auto &decl : mIsfBuiltins) {
+		if (!declared.count(decl.name) && provided.insert(decl.name).second) candidates.push_back(&decl);
+	}
+
+	// emitted declarations may reference others, iterate until nothing new is pulled in
+	vector<bool> emit(candidates.size(), false);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			if (emit[i] || !identifiers.count(candidates[i]->name)) continue;
+			emit[i] = true;
+			changed = true;
+			unordered_set<string> unusedDeclared;
+			string unusedVersion;
+			scanBody(candidates[i]->text, identifiers, unusedDeclared, unusedVersion);
+		}
+	}
+
+	string &out = generated->source;
+	out.reserve(body.size() + 1024);
+	out += version + "\n";
+	for (const auto &decl : inputDecls) out += decl + "\n";
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < candidates.size(); i++) {
+			if (emit[i] && candidates[i]->early == (pass == 0)) out += candidates[i]->text + "\n";
+		}
+	}
+	for (size_t i = 0; i < preambleCandidates; i++) {
+		if (emit[i]) generated->emitted++;
+	}
+	generated->skipped = mPreamble.size() - generated->emitted;
+
+	// drop the body's own #version line, it has been moved to the top
+	istringstream lines(body);
+	string line;
+	while (getline(lines, line)) {
+		size_t first = line.find_first_not_of(" \t");
+		if (first != string::npos && line.compare(first, 8, "#version") == 0) continue;
+		out += line + "\n";
+	}
+	mCache[key] = generated;
+	return generated;
+}
@@ -0,0 +1,368 @@
+#include "SkyShmFrame.h"
+#include "SkyShmRegistry.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if !defined( _WIN32 )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const char kPrefix[] = "sky.";
+
+	inline int64_t nowNanoseconds()
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+static_assert(sizeof(SkyShmSegment::Header) <= 4096, "the segment header must fit before the pixels");
+
+string SkyShmSegment::getPath(const string &name)
+{
+	// one path component, slashes would name a directory
+	string path = string("/") + kPrefix + name;
+	for (size_t i = 1; i < path.size(); i++) {
+		if (path[i] == '/') path[i] = '_';
+	}
+	return path;
+}
+
+SkyShmSegment::~SkyShmSegment()
+{
+#if !defined( _WIN32 )
+	if (mData) munmap(mData, mSize);
+#endif
+}
+
+unique_ptr<SkyShmSegment> SkyShmSegment::create(const string &name, size_t capacity, size_t maxTiles)
+{
+#if defined( _WIN32 )
+	return nullptr;
+#else
+	const string path = getPath(name);
+	int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0666);
+	if (fd < 0) return nullptr;
+	// whole cache lines per slot
+	capacity = (capacity + 63) & ~(size_t)63;
+	size_t size = getPixelsOffset(maxTiles) + kNumSlots * capacity;
+	void *data = ftruncate(fd, (off_t)size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+
+	unique_ptr<SkyShmSegment> segment(new SkyShmSegment());
+	segment->mData = (uint8_t *)data;
+	segment->mSize = size;
+	Header *header = segment->getHeader();
+	header->magic = kMagic;
+	header->version = kVersion;
+	header->capacity = capacity;
+	header->maxTiles = maxTiles;
+	header->latest.store(0);
+	header->closed.store(0);
+	for (auto &slot : header->slots) {
+		slot.sequence.store(0);
+		slot.width.store(0);
+		slot.height.store(0);
+	}
+	return segment;
+#endif
+}
+
+unique_ptr<SkyShmSegment> SkyShmSegment::open(const string &name)
+{
+#if defined( _WIN32 )
+	return nullptr;
+#else
+	const string path = getPath(name);
+	int fd = shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0) return nullptr;
+	struct stat info;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && (size_t)info.st_size >= getHeaderSize()) {
+		data = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+
+	unique_ptr<SkyShmSegment> segment(new SkyShmSegment());
+	segment->mData = (uint8_t *)data;
+	segment->mSize = (size_t)info.st_size;
+	const Header *header = segment->getHeader();
+	if (header->magic != kMagic || header->version != kVersion || header->maxTiles > segment->mSize || getPixelsOffset(header->maxTiles) + kNumSlots * header->capacity > segment->mSize) return nullptr;
+	return segment;
+#endif
+}
+
+void SkyShmSegment::unlink(const string &name)
+{
+#if !defined( _WIN32 )
+	shm_unlink(getPath(name).c_str());
+#endif
+}
+
+vector<SkyShmSenderInfo> SkyShmSegment::list()
+{
+	auto registry = SkyShmRegistry::get();
+	return registry ? registry->list() : vector<SkyShmSenderInfo>();
+}
+
+SkyShmSender::~SkyShmSender()
+{
+	if (mSegment) {
+		mSegment->getHeader()->closed.store(1);
+		SkyShmSegment::unlink(mName);
+	}
+	if (mRegistry) mRegistry->remove(mName);
+}
+
+bool SkyShmSender::send(const uint8_t *rgba, int width, int height)
+{
+	const size_t bytes = (size_t)width * height * 4;
+	if (!mRegistry) {
+		// the name is claimed once, a second sender of the same name never touches the first one's segment
+		auto registry = SkyShmRegistry::get();
+		if (!registry || !registry->add(mName, width, height)) return false;
+		mRegistry = registry;
+		mWidth = width;
+		mHeight = height;
+	}
+	else if (width != mWidth || height != mHeight) {
+		mRegistry->update(mName, width, height);
+		mWidth = width;
+		mHeight = height;
+	}
+	const int numTiles = SkyTileCodec::getNumColumns(width) * SkyTileCodec::getNumRows(height);
+	if (!mSegment || mSegment->getHeader()->capacity < bytes || mSegment->getHeader()->maxTiles < (uint64_t)numTiles) {
+		// readers keep their mapping of the old segment until they see it closed
+		if (mSegment) mSegment->getHeader()->closed.store(1);
+		mSegment.reset();
+		SkyShmSegment::unlink(mName);
+		mSegment = SkyShmSegment::create(mName, bytes, numTiles);
+		if (!mSegment) return false;
+	}
+	// the slot after the newest frame is either free or held by a reader two frames behind
+	auto *header = mSegment->getHeader();
+	uint64_t frame = header->latest.load(memory_order_relaxed) + 1;
+	int index = (int)(frame % SkyShmSegment::kNumSlots);
+	auto &slot = header->slots[index];
+
+	mTileFrames.resize(numTiles, 0);
+	if (mTiled) mTiles.diff(rgba, width, height);
+	for (int tile = 0; tile < numTiles; tile++) {
+		if (!mTiled || mTiles.isDirty(tile)) mTileFrames[tile] = frame;
+	}
+	// the slot still holds the frame written three sends ago, only tiles changed since then are written
+	uint64_t slotFrame = slot.sequence.load(memory_order_relaxed) / 2;
+	if (slot.width.load(memory_order_relaxed) != (uint32_t)width || slot.height.load(memory_order_relaxed) != (uint32_t)height) slotFrame = 0;
+
+	slot.sequence.store(frame * 2 - 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot.width.store((uint32_t)width, memory_order_relaxed);
+	slot.height.store((uint32_t)height, memory_order_relaxed);
+	uint8_t *pixels = mSegment->getPixels(index);
+	uint64_t *tileFrames = mSegment->getTileFrames(index);
+	if (!mTiled || slotFrame == 0) {
+		memcpy(pixels, rgba, bytes);
+		mBytesSent += bytes;
+	}
+	else {
+		for (int tile = 0; tile < numTiles; tile++) {
+			if (mTileFrames[tile] <= slotFrame) continue;
+			SkyTileCodec::copyTile(pixels, rgba, width, height, tile);
+			mBytesSent += SkyTileCodec::getTileBytes(width, height, tile);
+		}
+	}
+	memcpy(tileFrames, mTileFrames.data(), numTiles * sizeof(uint64_t));
+	slot.sequence.store(frame * 2, memory_order_release);
+	header->latest.store(frame, memory_order_release);
+	mSent++;
+	return true;
+}
+
+SkyShmSender::BenchmarkResults SkyShmSender::benchmark(int width, int height, int numReaders, double seconds, double targetFps, bool tiled)
+{
+	BenchmarkResults results;
+	results.width = width;
+	results.height = height;
+	results.numReaders = numReaders;
+
+	const string name = "benchmark." + to_string(nowNanoseconds());
+	auto sender = SkyShmSender::create(name);
+	sender->setTiled(tiled);
+	vector<uint8_t> frame((size_t)width * height * 4, 0);
+	const int blockSize = min(256, min(width, height));
+	auto drawBlock = [&](uint64_t index, uint8_t value) {
+		int x = (int)(index * 16 % (uint64_t)(width - blockSize + 1));
+		int y = (height - blockSize) / 2;
+		for (int row = 0; row < blockSize; row++) memset(frame.data() + ((size_t)(y + row) * width + x) * 4, value, (size_t)blockSize * 4);
+	};
+	int64_t stamp = nowNanoseconds();
+	memcpy(frame.data(), &stamp, sizeof(stamp));
+	// the first frame creates the segment so every reader finds it
+	if (!sender->send(frame.data(), width, height)) return results;
+
+	struct ReaderStats {
+		uint64_t			frames = 0;
+		uint64_t			torn = 0;
+		uint64_t			bytes = 0;
+		double				latencyMs = 0.0;
+		double				latencyMaxMs = 0.0;
+	};
+	vector<ReaderStats> stats(numReaders);
+	atomic<bool> running(true);
+	vector<thread> readers;
+	for (int r = 0; r < numReaders; r++) {
+		readers.emplace_back([&, r] {
+			auto reader = SkyShmReader::open(name);
+			if (!reader) return;
+			vector<uint8_t> rgba;
+			int w, h;
+			auto &stat = stats[r];
+			while (running.load(memory_order_relaxed)) {
+				if (!reader->read(rgba, w, h)) {
+					this_thread::yield();
+					continue;
+				}
+				// the sender stamps each frame with the time it started sending
+				int64_t sent;
+				memcpy(&sent, rgba.data(), sizeof(sent));
+				double latency = (nowNanoseconds() - sent) * 1e-6;
+				stat.frames++;
+				stat.latencyMs += latency;
+				stat.latencyMaxMs = max(stat.latencyMaxMs, latency);
+			}
+			stat.torn = reader->getNumTorn();
+			stat.bytes = reader->getBytesRead();
+		});
+	}
+
+	const int64_t start = nowNanoseconds();
+	const int64_t end = start + (int64_t)(seconds * 1e9);
+	const int64_t interval = targetFps > 0.0 ? (int64_t)(1e9 / targetFps) : 0;
+	uint64_t sent = 0;
+	int64_t now = start;
+	while (now < end) {
+		drawBlock(sent, 0);
+		drawBlock(sent + 1, 0xc0);
+		stamp = nowNanoseconds();
+		memcpy(frame.data(), &stamp, sizeof(stamp));
+		sender->send(frame.data(), width, height);
+		now = nowNanoseconds();
+		results.writerMaxMs = max(results.writerMaxMs, (now - stamp) * 1e-6);
+		sent++;
+		if (interval) {
+			this_thread::sleep_for(chrono::nanoseconds(max<int64_t>(0, start + (int64_t)sent * interval - nowNanoseconds())));
+			now = nowNanoseconds();
+		}
+	}
+	const double elapsed = (now - start) * 1e-9;
+	running = false;
+	for (auto &reader : readers) reader.join();
+
+	results.writerFps = sent / elapsed;
+	results.readerMinFps = numReaders ? 1e9 : 0.0;
+	uint64_t frames = 0, bytesRead = 0;
+	for (const auto &stat : stats) {
+		bytesRead += stat.bytes;
+		results.readerFps += stat.frames / elapsed / numReaders;
+		results.readerMinFps = min(results.readerMinFps, stat.frames / elapsed);
+		results.latencyMs += stat.latencyMs;
+		results.latencyMaxMs = max(results.latencyMaxMs, stat.latencyMaxMs);
+		results.torn += stat.torn;
+		frames += stat.frames;
+	}
+	if (frames) {
+		results.latencyMs /= frames;
+		results.readBytesPerFrame = (double)bytesRead / frames;
+	}
+	results.fullBytesPerFrame = (double)frame.size();
+	results.sentBytesPerFrame = (double)sender->getBytesSent() / sender->getNumSent();
+
+	// what the same animation costs as compressed tile packets, as a network stream would send it
+	// the opening keyframe is left out
+	SkyTileEncoder encoder;
+	vector<uint8_t> packet;
+	encoder.encode(frame.data(), width, height, packet, true);
+	const uint64_t keyframeBytes = encoder.getStats().packetBytes;
+	for (uint64_t i = 0; i < 60; i++) {
+		drawBlock(sent + i, 0);
+		drawBlock(sent + i + 1, 0xc0);
+		encoder.encode(frame.data(), width, height, packet, true);
+	}
+	results.packetBytesPerFrame = (double)(encoder.getStats().packetBytes - keyframeBytes) / 60;
+	return results;
+}
+
+SkyShmReaderRef SkyShmReader::open(const string &name)
+{
+	auto segment = SkyShmSegment::open(name);
+	if (!segment) return nullptr;
+	return SkyShmReaderRef(new SkyShmReader(name, move(segment)));
+}
+
+SkyShmReader::SkyShmReader(const string &name, unique_ptr<SkyShmSegment> segment)
+	: mName(name), mSegment(move(segment))
+{
+}
+
+bool SkyShmReader::isClosed() const
+{
+	return mSegment->getHeader()->closed.load() != 0;
+}
+
+bool SkyShmReader::read(vector<uint8_t> &rgba, int &width, int &height)
+{
+	auto *header = mSegment->getHeader();
+	// a torn copy means the sender lapped us, the frame it published since is tried once more
+	for (int attempt = 0; attempt < 2; attempt++) {
+		uint64_t frame = header->latest.load(memory_order_acquire);
+		if (frame == 0 || frame == mLastFrame) return false;
+		int index = (int)(frame % SkyShmSegment::kNumSlots);
+		const auto &slot = header->slots[index];
+		if (slot.sequence.load(memory_order_acquire) != frame * 2) {
+			mTorn++;
+			continue;
+		}
+		width = (int)slot.width.load(memory_order_relaxed);
+		height = (int)slot.height.load(memory_order_relaxed);
+		size_t bytes = (size_t)width * height * 4;
+		const int numTiles = SkyTileCodec::getNumColumns(width) * SkyTileCodec::getNumRows(height);
+		if (bytes > header->capacity || (uint64_t)numTiles > header->maxTiles) return false;
+		rgba.resize(bytes);
+		// tiles are only worth it on top of the frame this buffer already holds
+		const uint8_t *pixels = mSegment->getPixels(index);
+		if (rgba.data() != mLastData || width != mWidth || height != mHeight) {
+			memcpy(rgba.data(), pixels, bytes);
+			mBytesRead += bytes;
+		}
+		else {
+			const uint64_t *tileFrames = mSegment->getTileFrames(index);
+			for (int tile = 0; tile < numTiles; tile++) {
+				if (tileFrames[tile] <= mLastFrame) continue;
+				SkyTileCodec::copyTile(rgba.data(), pixels, width, height, tile);
+				mBytesRead += SkyTileCodec::getTileBytes(width, height, tile);
+			}
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.sequence.load(memory_order_relaxed) != frame * 2) {
+			// part of the buffer may hold the next lap, copy it whole next time
+			mLastData = nullptr;
+			mTorn++;
+			continue;
+		}
+		mLastFrame = frame;
+		mLastData = rgba.data();
+		mWidth = width;
+		mHeight = height;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,399 @@
+#include "SkyShmRegistry.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if !defined( _WIN32 )
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const uint32_t kRegistryMagic = 0x52594B53;	// "SKYR"
+	const uint32_t kRegistryVersion = 1;
+
+	inline uint64_t pack(uint32_t hash, uint64_t generation, uint64_t kind)
+	{
+		return (uint64_t)hash << 32 | (generation & 0x3fffffff) << 2 | kind;
+	}
+	inline uint64_t kindOf(uint64_t state) { return state & 3; }
+	inline uint64_t generationOf(uint64_t state) { return (state >> 2) & 0x3fffffff; }
+	inline uint32_t hashOf(uint64_t state) { return (uint32_t)(state >> 32); }
+	// a slot being written with no name hash, only reclaim() makes these
+	inline bool isReserved(uint64_t state) { return (state & 3) == 1 && hashOf(state) == 0; }
+}
+
+SkyShmRegistryRef SkyShmRegistry::get()
+{
+	static mutex sMutex;
+	static weak_ptr<SkyShmRegistry> sRegistry;
+	lock_guard<mutex> lock(sMutex);
+	if (auto registry = sRegistry.lock()) return registry;
+#if defined( _WIN32 )
+	return nullptr;
+#else
+	auto registry = open("/sky-registry-" + to_string(getuid()));
+	sRegistry = registry;
+	return registry;
+#endif
+}
+
+SkyShmRegistryRef SkyShmRegistry::open(const string &path)
+{
+#if defined( _WIN32 )
+	return nullptr;
+#else
+	int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	const bool creator = fd >= 0;
+	if (!creator) fd = shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0) return nullptr;
+	if (creator && ftruncate(fd, sizeof(Header)) != 0) {
+		close(fd);
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+	// another process may still be between creating and sizing the table
+	struct stat info;
+	for (int i = 0; i < 1000 && (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)); i++) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	void *data = (size_t)info.st_size >= sizeof(Header) ? mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+
+	Header *header = (Header *)data;
+	if (creator) {
+		// the pages are zero filled, every slot starts empty
+		header->version = kRegistryVersion;
+		header->capacity = kCapacity;
+		header->magic.store(kRegistryMagic, memory_order_release);
+	}
+	else {
+		for (int i = 0; i < 1000 && header->magic.load(memory_order_acquire) != kRegistryMagic; i++) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		if (header->magic.load(memory_order_acquire) != kRegistryMagic || header->version != kRegistryVersion || header->capacity != kCapacity) {
+			munmap(data, sizeof(Header));
+			return nullptr;
+		}
+	}
+	return SkyShmRegistryRef(new SkyShmRegistry(header));
+#endif
+}
+
+SkyShmRegistry::~SkyShmRegistry()
+{
+#if !defined( _WIN32 )
+	munmap(mHeader, sizeof(Header));
+#endif
+}
+
+uint32_t SkyShmRegistry::hash(const string &name)
+{
+	// FNV-1a, never zero so an empty slot cannot match
+	uint32_t h = 2166136261u;
+	for (char c : name) {
+		h ^= (uint8_t)c;
+		h *= 16777619u;
+	}
+	return h ? h : 1;
+}
+
+bool SkyShmRegistry::isStale(Slot &slot, uint64_t state) const
+{
+#if defined( _WIN32 )
+	return false;
+#else
+	int32_t pid = slot.pid.load(memory_order_relaxed);
+	if (pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH) return false;
+	// the owner died without removing its entry
+	uint64_t expected = state;
+	if (slot.state.compare_exchange_strong(expected, pack(hashOf(state), generationOf(state), TOMBSTONE))) {
+		mHeader->count.fetch_sub(1);
+		reclaim((uint32_t)(&slot - mHeader->slots));
+	}
+	return true;
+#endif
+}
+
+void SkyShmRegistry::reclaim(uint32_t index) const
+{
+	// a tombstone only keeps probes going, one followed by an empty slot can be emptied without hiding anything
+	const uint32_t mask = kCapacity - 1;
+	uint32_t end = index;
+	for (uint32_t i = 0; i < kCapacity && kindOf(mHeader->slots[end].state.load(memory_order_acquire)) == TOMBSTONE; i++) {
+		end = (end + 1) & mask;
+	}
+	for (uint32_t i = 0; i < kCapacity; i++) {
+		Slot &next = mHeader->slots[end];
+		end = (end - 1) & mask;
+		Slot &slot = mHeader->slots[end];
+		uint64_t nextState = next.state.load(memory_order_acquire);
+		uint64_t state = slot.state.load(memory_order_acquire);
+		if (kindOf(nextState) != EMPTY || kindOf(state) != TOMBSTONE) return;
+		// while the empty slot is reserved no add can be placed at or past it, so none is hidden by the slot before it emptying
+		const uint64_t reserved = pack(0, generationOf(nextState) + 1, WRITING);
+		if (!next.state.compare_exchange_strong(nextState, reserved, memory_order_acquire)) return;
+#if !defined( _WIN32 )
+		next.pid.store((int32_t)getpid(), memory_order_relaxed);
+#endif
+		const bool emptied = slot.state.compare_exchange_strong(state, pack(0, generationOf(state) + 1, EMPTY));
+		uint64_t expected = reserved;
+		next.state.compare_exchange_strong(expected, pack(0, generationOf(reserved) + 1, EMPTY), memory_order_release);
+		if (!emptied) return;
+	}
+}
+
+uint64_t SkyShmRegistry::waitReserved(Slot &slot, uint64_t state) const
+{
+	const auto start = chrono::steady_clock::now();
+	while (isReserved(state)) {
+		this_thread::yield();
+		uint64_t current = slot.state.load(memory_order_acquire);
+		if (current != state) {
+			state = current;
+			continue;
+		}
+#if !defined( _WIN32 )
+		// a reclaim only holds the slot for two compare and swaps, one held for long died holding it
+		int32_t pid = slot.pid.load(memory_order_relaxed);
+		if (chrono::steady_clock::now() - start > chrono::milliseconds(100) && pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+			slot.state.compare_exchange_strong(current, pack(0, generationOf(current) + 1, EMPTY), memory_order_acquire);
+			state = slot.state.load(memory_order_acquire);
+		}
+#endif
+	}
+	return state;
+}
+
+int SkyShmRegistry::findSlot(const string &name, uint32_t nameHash) const
+{
+	const uint32_t mask = kCapacity - 1;
+	for (uint32_t i = 0; i < kCapacity; i++) {
+		uint32_t index = (nameHash + i) & mask;
+		const Slot &slot = mHeader->slots[index];
+		uint64_t state = slot.state.load(memory_order_acquire);
+		if (kindOf(state) == EMPTY) return -1;
+		if (kindOf(state) != LIVE || hashOf(state) != nameHash) continue;
+		// the name is only trusted if the slot did not change while it was compared
+		bool equal = strncmp(slot.name, name.c_str(), sizeof(slot.name)) == 0;
+		atomic_thread_fence(memory_order_acquire);
+		if (equal && slot.state.load(memory_order_relaxed) == state) return (int)index;
+	}
+	return -1;
+}
+
+bool SkyShmRegistry::add(const string &name, int width, int height)
+{
+	if (name.empty() || name.size() > kMaxNameLength) return false;
+	const uint32_t nameHash = hash(name);
+	const uint32_t mask = kCapacity - 1;
+	for (int attempt = 0; attempt < 4; attempt++) {
+		int existing = findSlot(name, nameHash);
+		if (existing >= 0) {
+			Slot &slot = mHeader->slots[existing];
+			if (!isStale(slot, slot.state.load(memory_order_acquire))) return false;
+		}
+		int claimed = -1;
+		for (uint32_t i = 0; i < kCapacity && claimed < 0; i++) {
+			uint32_t index = (nameHash + i) & mask;
+			Slot &slot = mHeader->slots[index];
+			uint64_t state = waitReserved(slot, slot.state.load(memory_order_acquire));
+			while (kindOf(state) == EMPTY || kindOf(state) == TOMBSTONE) {
+				if (slot.state.compare_exchange_weak(state, pack(nameHash, generationOf(state) + 1, WRITING), memory_order_acquire)) {
+					claimed = (int)index;
+					break;
+				}
+				state = waitReserved(slot, state);
+			}
+		}
+		if (claimed < 0) return false;
+
+		Slot &slot = mHeader->slots[claimed];
+		uint64_t generation = generationOf(slot.state.load(memory_order_relaxed));
+		memset(slot.name, 0, sizeof(slot.name));
+		memcpy(slot.name, name.data(), name.size());
+		slot.width.store((uint32_t)width, memory_order_relaxed);
+		slot.height.store((uint32_t)height, memory_order_relaxed);
+#if !defined( _WIN32 )
+		slot.pid.store((int32_t)getpid(), memory_order_relaxed);
+#endif
+		slot.state.store(pack(nameHash, generation, LIVE), memory_order_release);
+		mHeader->count.fetch_add(1);
+
+		// a concurrent add of the same name: wait for slots still being written, then the first one in probe order wins
+		for (uint32_t i = 0; i < kCapacity; i++) {
+			const Slot &other = mHeader->slots[(nameHash + i) & mask];
+			uint64_t state = other.state.load(memory_order_acquire);
+			if (kindOf(state) == EMPTY) break;
+			while (kindOf(state) == WRITING && hashOf(state) == nameHash) {
+				this_thread::yield();
+				state = other.state.load(memory_order_acquire);
+			}
+		}
+		int first = findSlot(name, nameHash);
+		if (first == claimed) return true;
+		uint64_t expected = pack(nameHash, generation, LIVE);
+		if (slot.state.compare_exchange_strong(expected, pack(nameHash, generation, TOMBSTONE))) {
+			mHeader->count.fetch_sub(1);
+			reclaim((uint32_t)claimed);
+		}
+		// another process owns the name, or it was removed meanwhile and the add is tried again
+		if (first >= 0) return false;
+	}
+	return false;
+}
+
+bool SkyShmRegistry::remove(const string &name)
+{
+	const uint32_t nameHash = hash(name);
+	int index = findSlot(name, nameHash);
+	if (index < 0) return false;
+	Slot &slot = mHeader->slots[index];
+	uint64_t state = slot.state.load(memory_order_acquire);
+	if (kindOf(state) != LIVE || !slot.state.compare_exchange_strong(state, pack(nameHash, generationOf(state), TOMBSTONE))) return false;
+	mHeader->count.fetch_sub(1);
+	reclaim((uint32_t)index);
+	return true;
+}
+
+bool SkyShmRegistry::update(const string &name, int width, int height)
+{
+	int index = findSlot(name, hash(name));
+	if (index < 0) return false;
+	mHeader->slots[index].width.store((uint32_t)width, memory_order_relaxed);
+	mHeader->slots[index].height.store((uint32_t)height, memory_order_relaxed);
+	return true;
+}
+
+bool SkyShmRegistry::find(const string &name, SkyShmSenderInfo *info) const
+{
+	int index = findSlot(name, hash(name));
+	if (index < 0) return false;
+	if (info) {
+		info->name = name;
+		info->width = (int)mHeader->slots[index].width.load(memory_order_relaxed);
+		info->height = (int)mHeader->slots[index].height.load(memory_order_relaxed);
+	}
+	return true;
+}
+
+vector<SkyShmSenderInfo> SkyShmRegistry::list() const
+{
+	vector<SkyShmSenderInfo> senders;
+	for (uint32_t i = 0; i < kCapacity; i++) {
+		Slot &slot = mHeader->slots[i];
+		uint64_t state = slot.state.load(memory_order_acquire);
+		if (kindOf(state) != LIVE || isStale(slot, state)) continue;
+		SkyShmSenderInfo info;
+		info.name.assign(slot.name, strnlen(slot.name, sizeof(slot.name)));
+		info.width = (int)slot.width.load(memory_order_relaxed);
+		info.height = (int)slot.height.load(memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.state.load(memory_order_relaxed) == state) senders.push_back(info);
+	}
+	return senders;
+}
+
+uint32_t SkyShmRegistry::getCount() const
+{
+	return mHeader->count.load();
+}
+
+SkyShmRegistry::StressResults SkyShmRegistry::stress(int processes, int operations, int rounds)
+{
+	StressResults results;
+#if !defined( _WIN32 )
+	// never the registry of this user, the churn must not be left in it
+	const string path = "/sky-registry-stress-" + to_string(getpid());
+	shm_unlink(path.c_str());
+	auto registry = open(path);
+	if (!registry) return results;
+	const uint32_t before = registry->getCount();
+	const auto start = chrono::steady_clock::now();
+
+	// the children only use the inherited mapping and names short enough not to allocate
+	vector<pid_t> children;
+	for (int p = 0; p < processes; p++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int wrong = 0;
+			char buffer[kMaxNameLength + 1];
+			for (int i = 0; i < operations; i++) {
+				// the odd processes fight over a few names, the even ones own theirs
+				const bool shared = (p & 1) != 0;
+				if (shared) snprintf(buffer, sizeof(buffer), "stress-s%d", i % 16);
+				else snprintf(buffer, sizeof(buffer), "stress-%d-%d", p, i);
+				const string name(buffer);
+				const bool added = registry->add(name, p, i);
+				if (!shared && !added) wrong++;
+				if (added) {
+					SkyShmSenderInfo info;
+					if (!registry->find(name, &info) || info.width != p || info.height != i) wrong++;
+					if (!registry->remove(name)) wrong++;
+				}
+			}
+			// the last one dies holding an entry
+			if (p == processes - 1) registry->add("stress-dead", p, 0);
+			_exit(wrong ? 1 : 0);
+		}
+		if (pid > 0) children.push_back(pid);
+	}
+	for (pid_t child : children) {
+		int status = 0;
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) results.failed++;
+	}
+	results.processes = (int)children.size();
+	// reclaims the entry of the dead one
+	registry->list();
+	const uint32_t after = registry->getCount();
+	results.leaked = after > before ? after - before : 0;
+
+	// sixteen processes add the same name at once, exactly one may get it
+	for (int round = 0; round < rounds; round++) {
+		int gate[2];
+		if (pipe(gate) != 0) break;
+		children.clear();
+		for (int p = 0; p < 16; p++) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				// released together when the parent closes the pipe
+				close(gate[1]);
+				char c;
+				while (read(gate[0], &c, 1) > 0) {}
+				const bool won = registry->add("stress-race", p, round);
+				usleep(50000);
+				if (won) registry->remove("stress-race");
+				_exit(won ? 1 : 0);
+			}
+			if (pid > 0) children.push_back(pid);
+		}
+		close(gate[0]);
+		close(gate[1]);
+		int winners = 0;
+		for (pid_t child : children) {
+			int status = 0;
+			waitpid(child, &status, 0);
+			if (WIFEXITED(status) && WEXITSTATUS(status) == 1) winners++;
+		}
+		results.rounds++;
+		if (winners != 1) results.contended++;
+	}
+	results.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	for (uint32_t i = 0; i < kCapacity; i++) {
+		if (kindOf(registry->mHeader->slots[i].state.load()) == TOMBSTONE) results.tombstones++;
+	}
+	shm_unlink(path.c_str());
+#endif
+	return results;
+}
@@ -0,0 +1,228 @@
+#include "SkyTextureService.h"
+
+#include "cinder/ImageIo.h"
+#include "cinder/Log.h"
+
+using namespace ci;
+using namespace std;
+
+SkyTextureService::SkyTextureService(const Format &format)
+	: mFormat(format)
+{
+	size_t numThreads = mFormat.mNumThreads ? mFormat.mNumThreads : max<size_t>(1, thread::hardware_concurrency() / 2);
+	for (size_t i = 0; i < numThreads; i++) {
+		mThreads.emplace_back(&SkyTextureService::workerFn, this);
+	}
+}
+
+SkyTextureService::~SkyTextureService()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for (auto &worker : mThreads) worker.join();
+}
+
+gl::Texture2dRef SkyTextureService::fetch(const fs::path &path)
+{
+	const string key = path.string();
+	auto it = mEntries.find(key);
+	if (it == mEntries.end()) {
+		mStats.misses++;
+		enqueue(key, path);
+		return nullptr;
+	}
+	if (it->second.state != State::RESIDENT) return nullptr;
+	mStats.hits++;
+	touch(it->second);
+	return it->second.texture;
+}
+
+void SkyTextureService::prefetch(const fs::path &path)
+{
+	const string key = path.string();
+	if (mEntries.find(key) == mEntries.end()) enqueue(key, path);
+}
+
+void SkyTextureService::enqueue(const string &key, const fs::path &path)
+{
+	mEntries[key].state = State::DECODING;
+	auto job = make_shared<Job>();
+	job->path = path;
+	{
+		lock_guard<mutex> lock(mMutex);
+		mJobs.push_back(job);
+	}
+	mCondition.notify_one();
+}
+
+void SkyTextureService::workerFn()
+{
+	while (true) {
+		JobRef job;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return !mRunning || !mJobs.empty(); });
+			if (!mRunning) return;
+			job = mJobs.front();
+			mJobs.pop_front();
+		}
+		try {
+			// always RGBA so every upload uses the same layout
+			job->surface = Surface8u::create(loadImage(loadFile(job->path)), SurfaceConstraintsDefault(), true);
+		}
+		catch (const std::exception &exc) {
+			CI_LOG_EXCEPTION("decoding " << job->path, exc);
+		}
+		lock_guard<mutex> lock(mMutex);
+		mFinished.push_back(job);
+	}
+}
+
+void SkyTextureService::update()
+{
+	deque<JobRef> finished;
+	{
+		lock_guard<mutex> lock(mMutex);
+		finished.swap(mFinished);
+	}
+	for (auto &job : finished) {
+		const string key = job->path.string();
+		auto it = mEntries.find(key);
+		// evicted, or made resident by insert() meanwhile
+		if (it == mEntries.end() || it->second.state != State::DECODING) continue;
+		if (!job->surface) {
+			it->second.state = State::FAILED;
+			mStats.failed++;
+			continue;
+		}
+		it->second.surface = job->surface;
+		it->second.state = State::DECODED;
+		mUploadQueue.push_back(key);
+		mStats.decoded++;
+	}
+
+	size_t budget = mFormat.mUploadBytesPerFrame;
+	while (budget > 0 && !mUploadQueue.empty()) {
+		const string key = mUploadQueue.front();
+		Entry &entry = mEntries[key];
+		if (entry.state == State::DECODED) {
+			const auto &surface = entry.surface;
+			entry.bytes = (size_t)surface->getWidth() * surface->getHeight() * 4;
+			if (mFormat.mMipmap) entry.bytes += entry.bytes / 3;
+			evictFor(entry.bytes, key);
+
+			entry.texture = gl::Texture2d::create(surface->getWidth(), surface->getHeight(), getTextureFormat());
+			entry.uploadedRows = 0;
+			entry.state = State::UPLOADING;
+			mLru.push_front(key);
+			entry.lru = mLru.begin();
+			mStats.residentBytes += entry.bytes;
+		}
+		if (!uploadSlice(entry, budget)) break;
+
+		entry.state = State::RESIDENT;
+		entry.surface.reset();
+		if (mFormat.mMipmap) {
+			gl::ScopedTextureBind scopedTex(entry.texture);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		mStats.residentCount++;
+		mUploadQueue.pop_front();
+	}
+	mStats.pendingCount = mEntries.size() - mStats.residentCount - (size_t)mStats.failed;
+}
+
+void SkyTextureService::insert(const fs::path &path, const gl::Texture2dRef &texture)
+{
+	const string key = path.string();
+	auto it = mEntries.find(key);
+	if (it != mEntries.end() && it->second.state == State::RESIDENT) {
+		touch(it->second);
+		return;
+	}
+	// a decode already queued for this path is dropped when it finishes
+	for (auto queued = mUploadQueue.begin(); queued != mUploadQueue.end(); ++queued) {
+		if (*queued == key) {
+			mUploadQueue.erase(queued);
+			break;
+		}
+	}
+	size_t bytes = (size_t)texture->getWidth() * texture->getHeight() * 4;
+	if (mFormat.mMipmap) bytes += bytes / 3;
+	evictFor(bytes, key);
+
+	Entry &entry = mEntries[key];
+	if (entry.state == State::UPLOADING) {
+		mStats.residentBytes -= entry.bytes;
+		mLru.erase(entry.lru);
+	}
+	else if (entry.state == State::FAILED) {
+		mStats.failed--;
+	}
+	entry.state = State::RESIDENT;
+	entry.surface.reset();
+	entry.texture = texture;
+	entry.bytes = bytes;
+	mLru.push_front(key);
+	entry.lru = mLru.begin();
+	mStats.residentBytes += bytes;
+	mStats.residentCount++;
+	mStats.pendingCount = mEntries.size() - mStats.residentCount - (size_t)mStats.failed;
+}
+
+gl::Texture2d::Format SkyTextureService::getTextureFormat() const
+{
+	return gl::Texture2d::Format().internalFormat(GL_RGBA8).loadTopDown()
+		.minFilter(mFormat.mMipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR).magFilter(GL_LINEAR).mipmap(mFormat.mMipmap);
+}
+
+bool SkyTextureService::uploadSlice(Entry &entry, size_t &budget)
+{
+	const auto &surface = entry.surface;
+	const int width = surface->getWidth();
+	const int height = surface->getHeight();
+	const size_t rowBytes = (size_t)width * 4;
+	int rows = min<int>(height - entry.uploadedRows, max<int>(1, (int)(budget / rowBytes)));
+
+	gl::ScopedTextureBind scopedTex(entry.texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(surface->getRowBytes() / 4));
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, entry.uploadedRows, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, surface->getData(ivec2(0, entry.uploadedRows)));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	entry.uploadedRows += rows;
+	budget -= min(budget, rows * rowBytes);
+	return entry.uploadedRows >= height;
+}
+
+void SkyTextureService::touch(Entry &entry)
+{
+	if (entry.lru != mLru.begin()) mLru.splice(mLru.begin(), mLru, entry.lru);
+}
+
+void SkyTextureService::evictFor(size_t bytes, const string &keep)
+{
+	// least recently used first, images still uploading are never evicted
+	auto it = mLru.end();
+	while (mStats.residentBytes + bytes > mFormat.mBudgetBytes && it != mLru.begin()) {
+		--it;
+		if (*it == keep) continue;
+		auto found = mEntries.find(*it);
+		if (found == mEntries.end() || found->second.state != State::RESIDENT) continue;
+
+		mStats.residentBytes -= found->second.bytes;
+		mStats.residentCount--;
+		mStats.evictions++;
+		mStats.evictedBytes += found->second.bytes;
+		mEntries.erase(found);
+		it = mLru.erase(it);
+	}
+}
+
+void SkyTextureService::setBudgetMegabytes(size_t megabytes)
+{
+	mFormat.mBudgetBytes = megabytes << 20;
+	evictFor(0, string());
+}
@@ -0,0 +1,313 @@
+#include "SkyTileCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SKY_TILE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+const int SkyTileCodec::kTileSize;
+
+namespace {
+	inline uint64_t mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		return h ^ (h >> 33);
+	}
+
+	inline uint32_t load32(const uint8_t *p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	void tileRect(int width, int height, int tile, int &x, int &y, int &w, int &h)
+	{
+		const int columns = SkyTileCodec::getNumColumns(width);
+		x = (tile % columns) * SkyTileCodec::kTileSize;
+		y = (tile / columns) * SkyTileCodec::kTileSize;
+		w = min(SkyTileCodec::kTileSize, width - x);
+		h = min(SkyTileCodec::kTileSize, height - y);
+	}
+
+	void writeLength(size_t length, vector<uint8_t> &dst)
+	{
+		for (; length >= 255; length -= 255) dst.push_back(255);
+		dst.push_back((uint8_t)length);
+	}
+
+	bool readLength(const uint8_t *&ip, const uint8_t *end, size_t &length)
+	{
+		uint8_t byte;
+		do {
+			if (ip == end) return false;
+			byte = *ip++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+}
+
+size_t SkyTileCodec::getTileBytes(int width, int height, int tile)
+{
+	int x, y, w, h;
+	tileRect(width, height, tile, x, y, w, h);
+	return (size_t)w * h * 4;
+}
+
+uint64_t SkyTileCodec::hashTile(const uint8_t *rgba, size_t rowBytes, int width, int height)
+{
+	const size_t bytes = (size_t)width * 4;
+	uint64_t tail = 0;
+#if SKY_TILE_SSE
+	__m128i a = _mm_set_epi64x(0x9e3779b97f4a7c15ll, (long long)bytes);
+	__m128i b = _mm_set_epi64x(0x632be59bd9b4e019ll, height);
+	const size_t vectorBytes = bytes & ~(size_t)15;
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = rgba + y * rowBytes;
+		for (size_t i = 0; i < vectorBytes; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+			a = _mm_xor_si128(a, v);
+			a = _mm_add_epi64(a, _mm_slli_epi64(a, 13));
+			a = _mm_xor_si128(a, _mm_srli_epi64(a, 7));
+			b = _mm_add_epi64(b, a);
+		}
+		for (size_t i = vectorBytes; i < bytes; i += 4) tail = mix(tail ^ load32(row + i));
+	}
+	uint64_t lanes[4];
+	_mm_storeu_si128((__m128i *)lanes, a);
+	_mm_storeu_si128((__m128i *)(lanes + 2), b);
+	return mix(lanes[0] ^ mix(lanes[1] ^ mix(lanes[2] ^ mix(lanes[3] ^ tail))));
+#else
+	uint64_t a = 0x9e3779b97f4a7c15ull ^ bytes, b = 0x632be59bd9b4e019ull ^ (uint64_t)height;
+	const size_t wordBytes = bytes & ~(size_t)7;
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = rgba + y * rowBytes;
+		for (size_t i = 0; i < wordBytes; i += 8) {
+			uint64_t v;
+			memcpy(&v, row + i, sizeof(v));
+			a ^= v;
+			a += a << 13;
+			a ^= a >> 7;
+			b += a;
+		}
+		for (size_t i = wordBytes; i < bytes; i += 4) tail = mix(tail ^ load32(row + i));
+	}
+	return mix(a ^ mix(b ^ tail));
+#endif
+}
+
+void SkyTileCodec::copyTile(uint8_t *dst, const uint8_t *src, int width, int height, int tile)
+{
+	int x, y, w, h;
+	tileRect(width, height, tile, x, y, w, h);
+	const size_t rowBytes = (size_t)width * 4;
+	const size_t offset = y * rowBytes + (size_t)x * 4;
+	for (int row = 0; row < h; row++) {
+		memcpy(dst + offset + row * rowBytes, src + offset + row * rowBytes, (size_t)w * 4);
+	}
+}
+
+void SkyTileCodec::compress(const uint8_t *src, size_t size, vector<uint8_t> &dst)
+{
+	// LZ4 style sequences: a token of literal and match lengths, the literals, a 16 bit offset
+	const int kHashBits = 14;
+	static thread_local vector<uint32_t> table;
+	table.assign((size_t)1 << kHashBits, 0);
+	const size_t kMinMatch = 4;
+	size_t anchor = 0, i = 0;
+	while (i + kMinMatch <= size) {
+		uint32_t value = load32(src + i);
+		uint32_t slot = (value * 2654435761u) >> (32 - kHashBits);
+		size_t candidate = table[slot];		// position + 1, 0 when empty
+		table[slot] = (uint32_t)(i + 1);
+		if (!candidate || i + 1 - candidate > 65535 || load32(src + candidate - 1) != value) {
+			// step faster through data that does not compress
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+		size_t match = candidate - 1;
+		size_t length = kMinMatch;
+		while (i + length < size && src[match + length] == src[i + length]) length++;
+
+		size_t literals = i - anchor;
+		size_t extra = length - kMinMatch;
+		dst.push_back((uint8_t)(min<size_t>(literals, 15) << 4 | min<size_t>(extra, 15)));
+		if (literals >= 15) writeLength(literals - 15, dst);
+		dst.insert(dst.end(), src + anchor, src + i);
+		uint16_t offset = (uint16_t)(i - match);
+		dst.push_back((uint8_t)offset);
+		dst.push_back((uint8_t)(offset >> 8));
+		if (extra >= 15) writeLength(extra - 15, dst);
+		i += length;
+		anchor = i;
+	}
+	// the last sequence is literals only and ends the block
+	size_t literals = size - anchor;
+	dst.push_back((uint8_t)(min<size_t>(literals, 15) << 4));
+	if (literals >= 15) writeLength(literals - 15, dst);
+	dst.insert(dst.end(), src + anchor, src + size);
+}
+
+bool SkyTileCodec::decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t size)
+{
+	const uint8_t *ip = src, *end = src + srcSize;
+	size_t op = 0;
+	while (ip < end) {
+		uint8_t token = *ip++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !readLength(ip, end, literals)) return false;
+		if (literals > (size_t)(end - ip) || literals > size - op) return false;
+		memcpy(dst + op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == end) break;
+
+		if (end - ip < 2) return false;
+		size_t offset = ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		size_t length = token & 15;
+		if (length == 15 && !readLength(ip, end, length)) return false;
+		length += 4;
+		if (offset == 0 || offset > op || length > size - op) return false;
+		// matches may overlap their own output
+		const uint8_t *match = dst + op - offset;
+		for (size_t k = 0; k < length; k++) dst[op + k] = match[k];
+		op += length;
+	}
+	return op == size;
+}
+
+int SkyTileEncoder::diff(const uint8_t *rgba, int width, int height)
+{
+	const int numTiles = SkyTileCodec::getNumColumns(width) * SkyTileCodec::getNumRows(height);
+	if (width != mWidth || height != mHeight) {
+		mWidth = width;
+		mHeight = height;
+		mHashes.assign(numTiles, 0);
+		mKeyframe = true;
+	}
+	mDirty.assign(numTiles, 0);
+	int changed = 0;
+	const size_t rowBytes = (size_t)width * 4;
+	for (int tile = 0; tile < numTiles; tile++) {
+		int x, y, w, h;
+		tileRect(width, height, tile, x, y, w, h);
+		uint64_t hash = SkyTileCodec::hashTile(rgba + y * rowBytes + (size_t)x * 4, rowBytes, w, h);
+		if (hash != mHashes[tile] || mKeyframe) {
+			mHashes[tile] = hash;
+			mDirty[tile] = 1;
+			changed++;
+		}
+	}
+	mKeyframe = false;
+	return changed;
+}
+
+void SkyTileEncoder::encode(const uint8_t *rgba, int width, int height, vector<uint8_t> &packet, bool compress)
+{
+	const bool keyframe = mKeyframe || width != mWidth || height != mHeight;
+	diff(rgba, width, height);
+	const int numTiles = (int)mDirty.size();
+	const size_t rowBytes = (size_t)width * 4;
+
+	SkyTileCodec::PacketHeader header;
+	header.magic = SkyTileCodec::kMagic;
+	header.width = (uint32_t)width;
+	header.height = (uint32_t)height;
+	header.frame = ++mFrame;
+	header.flags = (keyframe ? SkyTileCodec::KEYFRAME : 0) | (compress ? SkyTileCodec::COMPRESSED : 0);
+	header.numTiles = (uint32_t)numTiles;
+
+	packet.assign(sizeof(header) + (numTiles + 7) / 8, 0);
+	uint8_t *bitmap = packet.data() + sizeof(header);
+	mRaw.clear();
+	for (int tile = 0; tile < numTiles; tile++) {
+		if (!mDirty[tile]) continue;
+		bitmap[tile >> 3] |= (uint8_t)(1 << (tile & 7));
+		int x, y, w, h;
+		tileRect(width, height, tile, x, y, w, h);
+		for (int row = 0; row < h; row++) {
+			const uint8_t *src = rgba + (y + row) * rowBytes + (size_t)x * 4;
+			mRaw.insert(mRaw.end(), src, src + (size_t)w * 4);
+		}
+	}
+	header.rawBytes = (uint32_t)mRaw.size();
+	if (compress) SkyTileCodec::compress(mRaw.data(), mRaw.size(), packet);
+	else packet.insert(packet.end(), mRaw.begin(), mRaw.end());
+	header.payloadBytes = (uint32_t)(packet.size() - sizeof(header) - (numTiles + 7) / 8);
+	memcpy(packet.data(), &header, sizeof(header));
+
+	mStats.frames++;
+	mStats.fullBytes += (uint64_t)width * height * 4;
+	mStats.rawBytes += (numTiles + 7) / 8 + mRaw.size();
+	mStats.packetBytes += packet.size();
+}
+
+bool SkyTileDecoder::decode(const uint8_t *packet, size_t size)
+{
+	SkyTileCodec::PacketHeader header;
+	if (size < sizeof(header)) return false;
+	memcpy(&header, packet, sizeof(header));
+	if (header.width == 0 || header.height == 0 || header.width > (uint32_t)SkyTileCodec::kMaxDimension || header.height > (uint32_t)SkyTileCodec::kMaxDimension) return false;
+	const int width = (int)header.width, height = (int)header.height;
+	const int numTiles = SkyTileCodec::getNumColumns(width) * SkyTileCodec::getNumRows(height);
+	const size_t bitmapBytes = (size_t)(numTiles + 7) / 8;
+	if (header.magic != SkyTileCodec::kMagic || header.numTiles != (uint32_t)numTiles || size != sizeof(header) + bitmapBytes + header.payloadBytes) return false;
+	// the changed tiles never hold more than the whole frame
+	if (header.rawBytes > (size_t)width * height * 4) return false;
+
+	if (header.flags & SkyTileCodec::KEYFRAME) {
+		mWidth = width;
+		mHeight = height;
+		mPixels.assign((size_t)width * height * 4, 0);
+		mValid = true;
+	}
+	// a delta only applies on top of the frame before it
+	else if (!mValid || width != mWidth || height != mHeight || header.frame != mFrame + 1) {
+		mValid = false;
+		return false;
+	}
+
+	const uint8_t *bitmap = packet + sizeof(header);
+	const uint8_t *payload = bitmap + bitmapBytes;
+	if (header.flags & SkyTileCodec::COMPRESSED) {
+		mRaw.resize(header.rawBytes);
+		if (!SkyTileCodec::decompress(payload, header.payloadBytes, mRaw.data(), mRaw.size())) {
+			mValid = false;
+			return false;
+		}
+		payload = mRaw.data();
+	}
+	else if (header.payloadBytes != header.rawBytes) {
+		mValid = false;
+		return false;
+	}
+
+	const size_t rowBytes = (size_t)width * 4;
+	size_t offset = 0;
+	for (int tile = 0; tile < numTiles; tile++) {
+		if (!(bitmap[tile >> 3] & (1 << (tile & 7)))) continue;
+		int x, y, w, h;
+		tileRect(width, height, tile, x, y, w, h);
+		const size_t tileRowBytes = (size_t)w * 4;
+		if (offset + tileRowBytes * h > header.rawBytes) {
+			mValid = false;
+			return false;
+		}
+		for (int row = 0; row < h; row++) {
+			memcpy(mPixels.data() + (y + row) * rowBytes + (size_t)x * 4, payload + offset, tileRowBytes);
+			offset += tileRowBytes;
+		}
+	}
+	mFrame = header.frame;
+	return true;
+}
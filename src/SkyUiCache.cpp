@@ -0,0 +1,75 @@
+#include "SkyUiCache.h"
+
+#include "cinder/app/App.h"
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+SkyUiCache::SkyUiCache(const WindowRef &window, const Format &format)
+	: mFormat(format), mWindow(window)
+{
+	// any input may change what ImGui shows, it is not consumed here
+	mConnections.emplace_back(window->getSignalMouseDown().connect([this](MouseEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalMouseUp().connect([this](MouseEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalMouseMove().connect([this](MouseEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalMouseDrag().connect([this](MouseEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalMouseWheel().connect([this](MouseEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalKeyDown().connect([this](KeyEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalKeyUp().connect([this](KeyEvent&) { invalidate(); }));
+	mConnections.emplace_back(window->getSignalResize().connect([this] { invalidate(); }));
+	// higher priority slots run first, the ImGui block renders at the default priority
+	mConnections.emplace_back(window->getSignalPostDraw().connect(1, [this] { preRender(); }));
+	mConnections.emplace_back(window->getSignalPostDraw().connect(-1, [this] { postRender(); }));
+}
+
+bool SkyUiCache::beginFrame(uint64_t dataVersion)
+{
+	const double now = getElapsedSeconds();
+	const ivec2 size = mWindow->toPixels(mWindow->getSize());
+	mShown = true;
+	mRedraw = false;
+	mStats.frames++;
+	if (!mFbo || mFbo->getSize() != size) {
+		mFbo = gl::Fbo::create(size.x, size.y, gl::Fbo::Format().colorTexture(gl::Texture2d::Format().internalFormat(GL_RGBA8)).disableDepth());
+		mRedraw = true;
+	}
+	if (mInputFrames > 0) {
+		mInputFrames--;
+		mRedraw = true;
+	}
+	const double elapsed = now - mLastRedraw;
+	if (dataVersion != mVersion && elapsed >= 1.0 / mFormat.mMaxRate) mRedraw = true;
+	if (elapsed >= 1.0 / mFormat.mIdleRate) mRedraw = true;
+	if (mRedraw) {
+		mVersion = dataVersion;
+		mLastRedraw = now;
+		mBuildStart = now;
+		mStats.redraws++;
+	}
+	return mRedraw;
+}
+
+void SkyUiCache::preRender()
+{
+	if (!mShown || !mRedraw) return;
+	mFbo->bindFramebuffer();
+	gl::clear(ColorA(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+void SkyUiCache::postRender()
+{
+	if (!mShown) return;
+	mShown = false;
+	if (mRedraw) {
+		mFbo->unbindFramebuffer();
+		mStats.lastBuildMs = (getElapsedSeconds() - mBuildStart) * 1000.0;
+	}
+	// ImGui blends with source alpha, which leaves the colors premultiplied in the cleared target
+	gl::ScopedViewport viewport(ivec2(0), mFbo->getSize());
+	gl::ScopedMatrices matrices;
+	gl::setMatricesWindow(mFbo->getSize());
+	gl::ScopedBlendPremult blend;
+	gl::ScopedDepth depth(false);
+	gl::draw(mFbo->getColorTexture());
+}
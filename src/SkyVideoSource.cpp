@@ -0,0 +1,286 @@
+#include "SkyVideoSource.h"
+
+#include "cinder/app/App.h"
+#include "cinder/Log.h"
+
+#include <sstream>
+
+using namespace ci;
+using namespace std;
+
+SkyVideoSourceRef SkyVideoSource::create(const fs::path &path, size_t numSlots)
+{
+	SkyVideoSourceRef source(new SkyVideoSource(path));
+	if (!source->open()) return nullptr;
+	source->allocate(numSlots);
+	return source;
+}
+
+SkyVideoSource::SkyVideoSource(const fs::path &path)
+	: mPath(path)
+{
+}
+
+SkyVideoSource::~SkyVideoSource()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	if (mThread.joinable()) mThread.join();
+	for (auto &slot : mSlots) {
+		if (slot.data) {
+			gl::ScopedBuffer scopedPbo(slot.pbo);
+			slot.pbo->unmap();
+		}
+	}
+}
+
+bool SkyVideoSource::open()
+{
+	mStream.open(mPath.string(), ios::binary);
+	if (!mStream) {
+		CI_LOG_E("cannot open " << mPath);
+		return false;
+	}
+	string header;
+	if (!getline(mStream, header) || !parseHeader(header)) {
+		CI_LOG_E("not a supported Y4M stream: " << mPath);
+		return false;
+	}
+	mFirstFrame = mStream.tellg();
+	return true;
+}
+
+bool SkyVideoSource::parseHeader(const string &header)
+{
+	istringstream tokens(header);
+	string token;
+	tokens >> token;
+	if (token != "YUV4MPEG2") return false;
+
+	string colorspace = "420jpeg";
+	while (tokens >> token) {
+		switch (token[0]) {
+		case 'W': mWidth = stoi(token.substr(1)); break;
+		case 'H': mHeight = stoi(token.substr(1)); break;
+		case 'F': {
+			size_t colon = token.find(':');
+			if (colon != string::npos) {
+				float den = stof(token.substr(colon + 1));
+				if (den > 0.0f) mFps = stof(token.substr(1, colon - 1)) / den;
+			}
+			break;
+		}
+		case 'C': colorspace = token.substr(1); break;
+		case 'X': if (token == "XCOLORRANGE=FULL") mFullRange = true; break;
+		default: break;
+		}
+	}
+	if (mWidth <= 0 || mHeight <= 0 || mFps <= 0.0f) return false;
+
+	// 8 bit only, higher depths carry a "p" suffix such as 420p10
+	if (colorspace.compare(0, 3, "420") == 0 && colorspace.find('p', 3) == string::npos) {
+		mChroma = Chroma::C420;
+		mChromaWidth = (mWidth + 1) / 2;
+		mChromaHeight = (mHeight + 1) / 2;
+	}
+	else if (colorspace == "422") {
+		mChroma = Chroma::C422;
+		mChromaWidth = (mWidth + 1) / 2;
+		mChromaHeight = mHeight;
+	}
+	else if (colorspace == "444") {
+		mChroma = Chroma::C444;
+		mChromaWidth = mWidth;
+		mChromaHeight = mHeight;
+	}
+	else if (colorspace == "mono") {
+		mChroma = Chroma::MONO;
+		mChromaWidth = mChromaHeight = 0;
+	}
+	else {
+		CI_LOG_E("unsupported Y4M colorspace C" << colorspace);
+		return false;
+	}
+	mLumaBytes = (size_t)mWidth * mHeight;
+	mChromaBytes = (size_t)mChromaWidth * mChromaHeight;
+	mFrameBytes = mLumaBytes + 2 * mChromaBytes;
+	return true;
+}
+
+void SkyVideoSource::allocate(size_t numSlots)
+{
+	auto planeFormat = gl::Texture2d::Format().internalFormat(GL_R8).minFilter(GL_LINEAR).magFilter(GL_LINEAR).wrap(GL_CLAMP_TO_EDGE);
+	mTexY = gl::Texture2d::create(mWidth, mHeight, planeFormat);
+	if (mChroma == Chroma::MONO) {
+		// neutral chroma
+		const uint8_t grey = 128;
+		mTexU = gl::Texture2d::create(&grey, GL_RED, 1, 1, planeFormat);
+		mTexV = gl::Texture2d::create(&grey, GL_RED, 1, 1, planeFormat);
+	}
+	else {
+		mTexU = gl::Texture2d::create(mChromaWidth, mChromaHeight, planeFormat);
+		mTexV = gl::Texture2d::create(mChromaWidth, mChromaHeight, planeFormat);
+	}
+	mFbo = gl::Fbo::create(mWidth, mHeight, gl::Fbo::Format().colorTexture().disableDepth());
+	mTexture = mFbo->getColorTexture();
+
+	try {
+		mYuvShader = gl::GlslProg::create(app::loadAsset("video_texture.vs.glsl"), app::loadAsset("video_yuv.fs.glsl"));
+		mYuvShader->uniform("uTexY", 0);
+		mYuvShader->uniform("uTexU", 1);
+		mYuvShader->uniform("uTexV", 2);
+	}
+	catch (const std::exception &exc) {
+		CI_LOG_EXCEPTION("video yuv shader", exc);
+	}
+	// BT.709 for HD material, BT.601 below, limited range unless the stream says otherwise
+	float kr = mHeight >= 720 ? 0.2126f : 0.299f;
+	float kb = mHeight >= 720 ? 0.0722f : 0.114f;
+	float kg = 1.0f - kr - kb;
+	float ys = mFullRange ? 1.0f : 255.0f / 219.0f;
+	float cs = mFullRange ? 1.0f : 255.0f / 224.0f;
+	mYuvOffset = vec3(mFullRange ? 0.0f : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f);
+	mYuvToRgb = mat3(
+		vec3(ys, ys, ys),
+		vec3(0.0f, -2.0f * (1.0f - kb) * kb / kg * cs, 2.0f * (1.0f - kb) * cs),
+		vec3(2.0f * (1.0f - kr) * cs, -2.0f * (1.0f - kr) * kr / kg * cs, 0.0f));
+
+	mSlots.resize(max<size_t>(numSlots, 2));
+	for (size_t i = 0; i < mSlots.size(); i++) {
+		mSlots[i].pbo = gl::Pbo::create(GL_PIXEL_UNPACK_BUFFER, mFrameBytes, nullptr, GL_STREAM_DRAW);
+		mapSlot(i);
+		mFreeSlots.push_back(i);
+	}
+	mRunning = true;
+	mThread = thread(&SkyVideoSource::decodeThreadFn, this);
+	CI_LOG_I("video " << mPath.filename() << " " << mWidth << "x" << mHeight << " @ " << mFps << " fps, " << mSlots.size() << " slots");
+}
+
+void SkyVideoSource::mapSlot(size_t index)
+{
+	// the previous upload from this buffer has completed, so the driver does not need to synchronize
+	gl::ScopedBuffer scopedPbo(mSlots[index].pbo);
+	mSlots[index].data = (uint8_t *)mSlots[index].pbo->mapBufferRange(0, mFrameBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void SkyVideoSource::decodeThreadFn()
+{
+	while (true) {
+		size_t index;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return !mRunning || !mFreeSlots.empty(); });
+			if (!mRunning) return;
+			index = mFreeSlots.front();
+			mFreeSlots.pop_front();
+		}
+		if (!readFrame(mSlots[index].data)) {
+			// loop back to the first frame
+			mStream.clear();
+			mStream.seekg(mFirstFrame);
+			if (!readFrame(mSlots[index].data)) {
+				CI_LOG_E("no frames in " << mPath);
+				return;
+			}
+		}
+		lock_guard<mutex> lock(mMutex);
+		mSlots[index].frame = mDecoded++;
+		mReadySlots.push_back(index);
+	}
+}
+
+bool SkyVideoSource::readFrame(uint8_t *dst)
+{
+	// each frame starts with a "FRAME" line that may carry parameters
+	string marker;
+	if (!getline(mStream, marker) || marker.compare(0, 5, "FRAME") != 0) return false;
+	mStream.read((char *)dst, mFrameBytes);
+	return (size_t)mStream.gcount() == mFrameBytes;
+}
+
+void SkyVideoSource::update(double time)
+{
+	if (mStartTime < 0.0) mStartTime = time;
+	int64_t due = (int64_t)((time - mStartTime) * mFps);
+
+	// buffers whose upload has completed go back to the decoder
+	vector<size_t> recycled;
+	for (auto it = mFencedSlots.begin(); it != mFencedSlots.end();) {
+		Slot &slot = mSlots[*it];
+		if (slot.fence && slot.fence->clientWaitSync(0, 0) == GL_TIMEOUT_EXPIRED) {
+			++it;
+			continue;
+		}
+		slot.fence.reset();
+		mapSlot(*it);
+		recycled.push_back(*it);
+		it = mFencedSlots.erase(it);
+	}
+
+	// take every frame that is due, only the newest one is uploaded
+	int64_t show = -1;
+	{
+		lock_guard<mutex> lock(mMutex);
+		while (!mReadySlots.empty() && mSlots[mReadySlots.front()].frame <= due) {
+			if (show >= 0) {
+				recycled.push_back((size_t)show);
+				mDropped++;
+			}
+			show = (int64_t)mReadySlots.front();
+			mReadySlots.pop_front();
+		}
+		for (size_t index : recycled) mFreeSlots.push_back(index);
+	}
+	if (!recycled.empty()) mCondition.notify_one();
+
+	if (show < 0) {
+		if (due > mCurrentFrame && mCurrentFrame >= 0) mLate++;
+		return;
+	}
+	Slot &slot = mSlots[(size_t)show];
+	upload(slot);
+	mFencedSlots.push_back((size_t)show);
+	mCurrentFrame = slot.frame;
+	mShown++;
+	convert();
+}
+
+void SkyVideoSource::upload(Slot &slot)
+{
+	gl::ScopedBuffer scopedPbo(slot.pbo);
+	slot.pbo->unmap();
+	slot.data = nullptr;
+
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	mTexY->update(slot.pbo, GL_RED, GL_UNSIGNED_BYTE, 0, 0);
+	if (mChroma != Chroma::MONO) {
+		mTexU->update(slot.pbo, GL_RED, GL_UNSIGNED_BYTE, 0, mLumaBytes);
+		mTexV->update(slot.pbo, GL_RED, GL_UNSIGNED_BYTE, 0, mLumaBytes + mChromaBytes);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	slot.fence = gl::Sync::create();
+}
+
+void SkyVideoSource::convert()
+{
+	if (!mYuvShader) return;
+
+	gl::ScopedFramebuffer scopedFbo(mFbo);
+	gl::ScopedViewport scopedViewport(ivec2(0), mFbo->getSize());
+	gl::ScopedMatrices scopedMatrices;
+	gl::setMatricesWindow(mFbo->getSize());
+	gl::ScopedDepth scopedDepth(false);
+	gl::ScopedGlslProg scopedShader(mYuvShader);
+	gl::ScopedTextureBind scopedY(mTexY, 0);
+	gl::ScopedTextureBind scopedU(mTexU, 1);
+	gl::ScopedTextureBind scopedV(mTexV, 2);
+	mYuvShader->uniform("uYuvToRgb", mYuvToRgb);
+	mYuvShader->uniform("uYuvOffset", mYuvOffset);
+	// the planes are stored top row first
+	gl::drawSolidRect(mFbo->getBounds(), vec2(0.0f, 0.0f), vec2(1.0f, 1.0f));
+}